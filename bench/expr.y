@@ -0,0 +1,49 @@
+// Grammar for the parser runtime benchmark (parsebench.c).  The same
+// grammar is built with lempar.c, lempar.cpp and lempar.cxx; run lemon++
+// with -DCXX so that the class-based template gets its base class.
+
+%include {
+#include "parsebench.h"
+}
+
+%ifdef CXX
+%include {
+#include "lemon_base.h"
+#define LEMON_SUPER bench_parser
+}
+%code {
+  std::unique_ptr<bench_parser> bench_parser::create() {
+    return std::unique_ptr<bench_parser>(new yypParser());
+  }
+}
+%endif
+
+%token_type {int}
+%type expr {int}
+%type term {int}
+%type factor {int}
+%type list {int}
+
+// Grow the stack on demand, so deep input shows up as allocations.
+%stack_size 0
+
+%syntax_error { bench_nerror++; }
+%parse_failure { bench_nfailure++; }
+
+program ::= items.
+items ::= items item.
+items ::= .
+item ::= expr(A) SEMI. { bench_sum += A; bench_nreduce++; }
+item ::= error SEMI. { bench_nreduce++; }
+
+expr(A) ::= expr(B) PLUS term(C). { A = B + C; bench_nreduce++; }
+expr(A) ::= expr(B) MINUS term(C). { A = B - C; bench_nreduce++; }
+expr(A) ::= term(B). { A = B; bench_nreduce++; }
+term(A) ::= term(B) STAR factor(C). { A = B * C; bench_nreduce++; }
+term(A) ::= factor(B). { A = B; bench_nreduce++; }
+factor(A) ::= NUM(B). { A = B; bench_nreduce++; }
+factor(A) ::= LP expr(B) RP. { A = B; bench_nreduce++; }
+factor(A) ::= LB list(B) RB. { A = B; bench_nreduce++; }
+factor(A) ::= LB RB. { A = 0; bench_nreduce++; }
+list(A) ::= list(B) COMMA expr(C). { A = B + C; bench_nreduce++; }
+list(A) ::= expr(B). { A = B; bench_nreduce++; }
@@ -0,0 +1,169 @@
+/*
+** Write a synthetic grammar to standard output, for benchmarking the
+** LEMON parser generator itself.
+**
+** Usage:
+**
+**     mkgrammar [terminals=N] [rules=N] [depth=N] [lists=N] [seed=N]
+**
+** terminals   Number of distinct terminal symbols.  Default 100.
+** rules       Approximate number of grammar rules.  Default 500.
+** depth       Number of levels of nonterminals.  Each level refers only
+**             to the level below it, so this sets the nesting depth of
+**             the language.  Default 4.
+** lists       Percentage of nonterminals that also get a left-recursive
+**             comma-separated list form.  Default 10.
+** seed        Seed for the random number generator.  Default 1.
+**
+** Every alternative of a nonterminal begins with a different terminal,
+** so the grammar is LL(1) and lemon builds it without conflicts.  The
+** output is the same on every platform for the same arguments, which
+** keeps table sizes comparable from one machine to the next.
+**
+** The author of this program disclaims copyright.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned long rng_state = 1;
+
+/* A small linear congruential generator.  rand() is not used because
+** its sequence differs between C libraries. */
+static int rng(int n){
+  rng_state = (rng_state*1103515245UL + 12345UL) & 0xffffffffUL;
+  return (int)((rng_state>>8) % (unsigned long)n);
+}
+
+/* Name of the first nonterminal on each level */
+static int level_start(int iLevel, int nLevel, int nNonterm){
+  return (int)((long)nNonterm*iLevel/nLevel);
+}
+
+/* True if nonterminal i is used as a comma-separated list */
+static int has_list(int i, int pctList){
+  return (int)(((unsigned long)i*2654435761UL & 0xffffffffUL) % 100) < pctList;
+}
+
+int main(int argc, char **argv){
+  int nTerminal = 100;
+  int nRule = 500;
+  int nLevel = 4;
+  int pctList = 10;
+  int nNonterm, nAlt;
+  int iLevel, i, j, k;
+  int iUse = 0;             /* Round-robin over terminals, so all get used */
+  int *aFirst;              /* First terminals chosen for one nonterminal */
+  char *aUsed;              /* Which terminals are in aFirst[] */
+
+  for(i=1; i<argc; i++){
+    char *z = strchr(argv[i], '=');
+    int v;
+    if( z==0 ){
+      fprintf(stderr, "%s: bad argument \"%s\"\n", argv[0], argv[i]);
+      return 1;
+    }
+    v = atoi(z+1);
+    if( strncmp(argv[i], "terminals=", 10)==0 ) nTerminal = v;
+    else if( strncmp(argv[i], "rules=", 6)==0 ) nRule = v;
+    else if( strncmp(argv[i], "depth=", 6)==0 ) nLevel = v;
+    else if( strncmp(argv[i], "lists=", 6)==0 ) pctList = v;
+    else if( strncmp(argv[i], "seed=", 5)==0 ) rng_state = (unsigned long)v;
+    else{
+      fprintf(stderr, "%s: unknown option \"%s\"\n", argv[0], argv[i]);
+      return 1;
+    }
+  }
+  if( nTerminal<4 ) nTerminal = 4;
+  if( nLevel<1 ) nLevel = 1;
+  if( nRule<nLevel*2 ) nRule = nLevel*2;
+
+  /* About four alternatives per nonterminal, but never more alternatives
+  ** than there are terminals to start them with. */
+  nAlt = 4;
+  if( nAlt>nTerminal-2 ) nAlt = nTerminal-2;
+  nNonterm = nRule/nAlt;
+  if( nNonterm<nLevel ) nNonterm = nLevel;
+  aFirst = (int*)malloc( sizeof(int)*nTerminal );
+  aUsed = (char*)calloc( nTerminal, 1 );
+  if( aFirst==0 || aUsed==0 ){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  if( nNonterm/nLevel > nTerminal ){
+    fprintf(stderr, "%s: too few terminals for the top level\n", argv[0]);
+    return 1;
+  }
+
+  printf("// Synthetic grammar: terminals=%d rules=%d depth=%d lists=%d\n\n",
+         nTerminal, nRule, nLevel, pctList);
+  printf("%%token_type {int}\n");
+  printf("%%token_prefix TK_\n\n");
+  printf("program ::= items.\n");
+  printf("items ::= items item.\n");
+  printf("items ::= item.\n");
+
+  /* Each top-level nonterminal is introduced by its own keyword, so the
+  ** choice between them is made on the first token. */
+  for(i=0; i<level_start(1, nLevel, nNonterm); i++){
+    printf("item ::= T%d n%d SEMI.\n", i, i);
+  }
+
+  for(iLevel=0; iLevel<nLevel; iLevel++){
+    int iFirst = level_start(iLevel, nLevel, nNonterm);
+    int iLast = level_start(iLevel+1, nLevel, nNonterm);
+    int iBelow = iLast;
+    int nBelow = level_start(iLevel+2, nLevel, nNonterm) - iLast;
+    int iNext = 0;           /* Round-robin over the level below */
+    if( iLevel==nLevel-1 ) nBelow = 0;
+    for(i=iFirst; i<iLast; i++){
+      for(j=0; j<nAlt; j++){
+        int nSym;
+        /* A first terminal not used by an earlier alternative */
+        do{
+          k = iUse++ % nTerminal;
+          if( aUsed[k] ) k = rng(nTerminal);
+        }while( aUsed[k] );
+        aUsed[k] = 1;
+        aFirst[j] = k;
+        printf("n%d ::= T%d", i, k);
+
+        /* Up to three more symbols.  Until every nonterminal on the level
+        ** below has been used, each alternative uses at least one. */
+        nSym = rng(4);
+        if( nSym==0 && iNext<nBelow ) nSym = 1;
+        for(k=0; k<nSym; k++){
+          if( nBelow>0 && ((k==0 && iNext<nBelow) || rng(3)!=0) ){
+            int iSym;
+            if( iNext<nBelow ){
+              iSym = iBelow + iNext++;
+            }else{
+              iSym = iBelow + rng(nBelow);
+            }
+            if( has_list(iSym, pctList) ){
+              printf(" LP n%d_list RP", iSym);
+            }else{
+              printf(" n%d", iSym);
+            }
+          }else{
+            printf(" T%d", rng(nTerminal));
+          }
+        }
+        printf(". { /* %d.%d */ }\n", i, j);
+      }
+      for(j=0; j<nAlt; j++) aUsed[aFirst[j]] = 0;
+      if( iLevel>0 && has_list(i, pctList) ){
+        printf("n%d_list ::= n%d_list COMMA n%d.\n", i, i, i);
+        printf("n%d_list ::= n%d.\n", i, i);
+      }
+    }
+    if( iNext<nBelow ){
+      fprintf(stderr, "%s: too few rules for depth=%d\n", argv[0], nLevel);
+      return 1;
+    }
+  }
+  free(aFirst);
+  free(aUsed);
+  return 0;
+}
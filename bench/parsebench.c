@@ -0,0 +1,250 @@
+/*
+** Parser runtime benchmark.  This program is linked with a parser that
+** lemon generated from expr.y using one of the three driver templates,
+** and feeds it pre-tokenized input of several shapes:
+**
+**     flat     Long comma-separated lists.  The stack stays shallow.
+**     deep     Deeply nested parentheses.  The stack grows large.
+**     expr     Short arithmetic statements.
+**     errors   Like "expr", but half of the statements have a syntax
+**              error, so error recovery runs constantly.
+**
+** For each shape it prints tokens and reductions per second, allocations
+** per thousand tokens and the high-water mark of the parser stack.
+**
+** Compile as C for lempar.c, or as C++ for lempar.cpp and lempar.cxx
+** (add -DCXX for lempar.cxx).  The parser must be compiled with
+** -DYYTRACKMAXSTACKDEPTH.  If it is also compiled with -DYYPROFILE, the
+** counts of every parse are written to the file named by the third
+** argument, for lemon --profile=FILE.
+**
+** With -DBENCH_ACCEPTS the parser must come from expr.y with %recognizer
+** added.  Each stream is then checked with one call to ParseAccepts()
+** instead of being fed to Parse() a token at a time.  The "errors" shape
+** is skipped, because the check stops at the first error.
+**
+** The author of this program disclaims copyright.
+*/
+#include "parsebench.h"
+#include "expr.h"
+#include <string.h>
+#include <time.h>
+
+#undef malloc
+#undef calloc
+#undef realloc
+
+#ifndef TEMPLATE_NAME
+# define TEMPLATE_NAME "lempar"
+#endif
+
+unsigned long bench_nreduce = 0;
+unsigned long bench_nerror = 0;
+unsigned long bench_nfailure = 0;
+unsigned long bench_nalloc = 0;
+unsigned long bench_sum = 0;
+
+void *bench_malloc(size_t n){
+  bench_nalloc++;
+  return malloc(n);
+}
+void *bench_calloc(size_t n, size_t m){
+  bench_nalloc++;
+  return calloc(n, m);
+}
+void *bench_realloc(void *p, size_t n){
+  bench_nalloc++;
+  return realloc(p, n);
+}
+
+#ifdef __cplusplus
+/* The C++ templates allocate the parser itself with new */
+#include <new>
+void *operator new(size_t n){
+  void *p;
+  bench_nalloc++;
+  p = malloc(n);
+  if( p==0 ) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+#endif
+
+/* The interface to the parser differs between the templates */
+#ifdef CXX
+static std::unique_ptr<bench_parser> pParser;
+static void parser_new(void){ pParser = bench_parser::create(); }
+static void parser_token(int major, int minor){ pParser->parse(major, (int)minor); }
+static int parser_peak(void){ return pParser->stack_peak(); }
+static void parser_delete(void){ pParser.reset(); }
+#ifdef BENCH_ACCEPTS
+static int parser_accepts(const int *a, int n){ return pParser->accepts(a, n); }
+#endif
+#ifdef YYPROFILE
+static void parser_profile(FILE *out){ pParser->profile(out); }
+#endif
+#else
+void *ParseAlloc(void *(*)(size_t));
+void Parse(void *, int, int);
+void ParseFree(void *, void (*)(void*));
+int ParseStackPeak(void *);
+static void *pParser;
+static void parser_new(void){ pParser = ParseAlloc(bench_malloc); }
+static void parser_token(int major, int minor){ Parse(pParser, major, minor); }
+static int parser_peak(void){ return ParseStackPeak(pParser); }
+static void parser_delete(void){ ParseFree(pParser, free); }
+#ifdef BENCH_ACCEPTS
+int ParseAccepts(void *, const int *, int);
+static int parser_accepts(const int *a, int n){ return ParseAccepts(pParser, a, n); }
+#endif
+#ifdef YYPROFILE
+void ParseProfile(void *, FILE *);
+static void parser_profile(FILE *out){ ParseProfile(pParser, out); }
+#endif
+#endif
+
+/* A pre-tokenized input */
+struct stream {
+  int n;                 /* Number of tokens */
+  int nAlloc;            /* Space allocated in aMajor[] and aMinor[] */
+  int *aMajor;           /* Token codes */
+  int *aMinor;           /* Token values */
+};
+
+static void add(struct stream *p, int major, int minor){
+  if( p->n>=p->nAlloc ){
+    p->nAlloc = p->nAlloc*2 + 1000;
+    p->aMajor = (int*)realloc(p->aMajor, sizeof(int)*p->nAlloc);
+    p->aMinor = (int*)realloc(p->aMinor, sizeof(int)*p->nAlloc);
+    if( p->aMajor==0 || p->aMinor==0 ){
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+  }
+  p->aMajor[p->n] = major;
+  p->aMinor[p->n] = minor;
+  p->n++;
+}
+
+static unsigned long rng_state = 1;
+static int rng(int n){
+  rng_state = (rng_state*1103515245UL + 12345UL) & 0xffffffffUL;
+  return (int)((rng_state>>8) % (unsigned long)n);
+}
+
+/* One arithmetic statement, optionally with a syntax error in it */
+static void add_statement(struct stream *p, int bError){
+  int i, n = 1 + rng(8);
+  int iError = bError ? rng(n) : -1;
+  for(i=0; i<n; i++){
+    if( i>0 ){
+      static const int aOp[] = { PLUS, MINUS, STAR };
+      add(p, aOp[rng(3)], 0);
+    }
+    if( i==iError ){
+      add(p, rng(2) ? RP : PLUS, 0);
+    }else if( rng(4)==0 ){
+      add(p, LP, 0);
+      add(p, NUM, 1 + rng(9));
+      add(p, PLUS, 0);
+      add(p, NUM, 1 + rng(9));
+      add(p, RP, 0);
+    }else{
+      add(p, NUM, 1 + rng(9));
+    }
+  }
+  add(p, SEMI, 0);
+}
+
+static void make_stream(struct stream *p, const char *zShape, int nToken){
+  int i;
+  memset(p, 0, sizeof(*p));
+  rng_state = 1;
+  while( p->n<nToken ){
+    if( strcmp(zShape, "flat")==0 ){
+      add(p, LB, 0);
+      for(i=0; i<1000; i++){
+        if( i ) add(p, COMMA, 0);
+        add(p, NUM, 1 + rng(9));
+      }
+      add(p, RB, 0);
+      add(p, SEMI, 0);
+    }else if( strcmp(zShape, "deep")==0 ){
+      for(i=0; i<500; i++) add(p, LP, 0);
+      add(p, NUM, 1 + rng(9));
+      for(i=0; i<500; i++) add(p, RP, 0);
+      add(p, SEMI, 0);
+    }else if( strcmp(zShape, "expr")==0 ){
+      add_statement(p, 0);
+    }else{
+      add_statement(p, rng(2));
+    }
+  }
+}
+
+int main(int argc, char **argv){
+  static const char *azShape[] = { "flat", "deep", "expr", "errors" };
+  int nToken = 1000000;      /* Tokens in each stream */
+  double minTime = 0.5;      /* Seconds to spend on each shape */
+  int iShape;
+#ifdef YYPROFILE
+  FILE *pProfile;
+#endif
+
+  if( argc>1 ) nToken = atoi(argv[1]);
+  if( argc>2 ) minTime = atof(argv[2]);
+#ifdef YYPROFILE
+  pProfile = fopen(argc>3 ? argv[3] : "expr.prof", "w");
+  if( pProfile==0 ){
+    fprintf(stderr, "cannot write the profile\n");
+    return 1;
+  }
+#endif
+  printf("%-10s %-7s %12s %10s %10s %11s %8s\n", "template", "shape",
+         "tokens", "Mtok/s", "Mred/s", "allocs/ktok", "stack");
+  for(iShape=0; iShape<(int)(sizeof(azShape)/sizeof(azShape[0])); iShape++){
+    struct stream s;
+    unsigned long nTotal = 0, nReduce0, nAlloc0;
+    double elapsed;
+    clock_t start;
+    int peak = 0;
+
+#ifdef BENCH_ACCEPTS
+    if( strcmp(azShape[iShape], "errors")==0 ) continue;
+#endif
+    make_stream(&s, azShape[iShape], nToken);
+    nReduce0 = bench_nreduce;
+    nAlloc0 = bench_nalloc;
+    start = clock();
+    do{
+#ifdef BENCH_ACCEPTS
+      parser_new();
+      if( !parser_accepts(s.aMajor, s.n) ) bench_nerror++;
+#else
+      int i;
+      parser_new();
+      for(i=0; i<s.n; i++) parser_token(s.aMajor[i], s.aMinor[i]);
+      parser_token(0, 0);
+#endif
+      if( parser_peak()>peak ) peak = parser_peak();
+#ifdef YYPROFILE
+      parser_profile(pProfile);
+#endif
+      parser_delete();
+      nTotal += s.n + 1;
+      elapsed = (double)(clock() - start)/CLOCKS_PER_SEC;
+    }while( elapsed<minTime );
+    if( elapsed<=0.0 ) elapsed = 1e-9;
+    printf("%-10s %-7s %12lu %10.2f %10.2f %11.5f %8d\n",
+           TEMPLATE_NAME, azShape[iShape], nTotal,
+           nTotal/elapsed/1e6, (bench_nreduce - nReduce0)/elapsed/1e6,
+           (bench_nalloc - nAlloc0)*1000.0/nTotal, peak);
+    free(s.aMajor);
+    free(s.aMinor);
+  }
+#ifdef YYPROFILE
+  fclose(pProfile);
+#endif
+  return 0;
+}
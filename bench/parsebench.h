@@ -0,0 +1,44 @@
+/*
+** Declarations shared by the parser runtime benchmark (parsebench.c) and
+** the parsers it generates from expr.y.
+**
+** Every allocation the generated parsers make goes through the counting
+** wrappers below, so the benchmark can report allocations per token.
+** The macros that route malloc() and friends to them come last, after
+** every header this one includes.
+*/
+#ifndef PARSEBENCH_H
+#define PARSEBENCH_H
+#include <stdlib.h>
+#include <stdio.h>
+
+extern unsigned long bench_nreduce;   /* Reductions performed */
+extern unsigned long bench_nerror;    /* Syntax errors reported */
+extern unsigned long bench_nfailure;  /* Parses abandoned */
+extern unsigned long bench_nalloc;    /* Calls to the allocators */
+extern unsigned long bench_sum;       /* Keeps the actions from being dead */
+
+void *bench_malloc(size_t);
+void *bench_calloc(size_t, size_t);
+void *bench_realloc(void *, size_t);
+
+#ifdef CXX
+#include <memory>
+#include "lemon_base.h"
+
+/* Base class for the parser built with lempar.cxx */
+class bench_parser : public lemon_base<int> {
+public:
+  static std::unique_ptr<bench_parser> create();
+  virtual int stack_peak() const = 0;
+#ifdef YYPROFILE
+  virtual void profile(FILE *out) const = 0;
+#endif
+};
+#endif
+
+#define malloc(N) bench_malloc(N)
+#define calloc(N,M) bench_calloc(N,M)
+#define realloc(P,N) bench_realloc(P,N)
+
+#endif /* PARSEBENCH_H */
@@ -0,0 +1,549 @@
+// An SQL dialect of about the size and shape of a production SQL grammar:
+// statements, DDL with constraints, joins, compound selects, window
+// functions, CTEs, triggers and an expression grammar with the usual
+// precedence levels.  It is used only to benchmark the generator; the
+// actions are empty.
+
+%token_type {int}
+%token_prefix TK_
+%name sqlParser
+%start_symbol input
+
+%fallback ID
+  ABORT ACTION AFTER ANALYZE ASC ATTACH BEFORE BEGIN BY CASCADE CAST COLUMNKW
+  CONFLICT CURRENT DATABASE DEFERRED DESC DETACH DO EACH END EXCLUSIVE EXPLAIN
+  FAIL FILTER FIRST FOLLOWING FOR GENERATED IGNORE IMMEDIATE INITIALLY INSTEAD
+  LAST LIKE_KW MATCH NO NULLS OF OFFSET OTHERS OVER PARTITION PLAN PRAGMA
+  PRECEDING QUERY RANGE RAISE RECURSIVE REINDEX RELEASE RENAME REPLACE RESTRICT
+  ROLLBACK ROW ROWS SAVEPOINT TEMP TIES TRIGGER UNBOUNDED VACUUM VIEW VIRTUAL
+  WITHOUT ALWAYS MATERIALIZED.
+
+%wildcard ANY.
+
+%left OR.
+%left AND.
+%right NOT.
+%left IS MATCH LIKE_KW BETWEEN IN ISNULL NOTNULL NE EQ.
+%left GT LE LT GE.
+%right ESCAPE.
+%left BITAND BITOR LSHIFT RSHIFT.
+%left PLUS MINUS.
+%left STAR SLASH REM.
+%left CONCAT PTR.
+%left COLLATE.
+%right BITNOT.
+%nonassoc ON.
+
+input ::= cmdlist.
+cmdlist ::= cmdlist ecmd.
+cmdlist ::= ecmd.
+ecmd ::= SEMI.
+ecmd ::= cmdx SEMI.
+ecmd ::= explain cmdx SEMI.
+explain ::= EXPLAIN.
+explain ::= EXPLAIN QUERY PLAN.
+cmdx ::= cmd.
+
+///////////////////// Transactions ////////////////////////////
+cmd ::= BEGIN transtype trans_opt.
+trans_opt ::= .
+trans_opt ::= TRANSACTION.
+trans_opt ::= TRANSACTION nm.
+transtype ::= .
+transtype ::= DEFERRED.
+transtype ::= IMMEDIATE.
+transtype ::= EXCLUSIVE.
+cmd ::= COMMIT trans_opt.
+cmd ::= END trans_opt.
+cmd ::= ROLLBACK trans_opt.
+savepoint_opt ::= SAVEPOINT.
+savepoint_opt ::= .
+cmd ::= SAVEPOINT nm.
+cmd ::= RELEASE savepoint_opt nm.
+cmd ::= ROLLBACK trans_opt TO savepoint_opt nm.
+
+///////////////////// CREATE TABLE ////////////////////////////
+cmd ::= create_table create_table_args.
+create_table ::= createkw temp TABLE ifnotexists nm dbnm.
+createkw ::= CREATE.
+ifnotexists ::= .
+ifnotexists ::= IF NOT EXISTS.
+temp ::= TEMP.
+temp ::= .
+create_table_args ::= LP columnlist conslist_opt RP table_option_set.
+create_table_args ::= AS select.
+table_option_set ::= .
+table_option_set ::= table_option.
+table_option_set ::= table_option_set COMMA table_option.
+table_option ::= WITHOUT nm.
+table_option ::= nm.
+columnlist ::= columnlist COMMA columnname carglist.
+columnlist ::= columnname carglist.
+columnname ::= nm typetoken.
+
+nm ::= ID.
+nm ::= STRING.
+nm ::= JOIN_KW.
+
+typetoken ::= .
+typetoken ::= typename.
+typetoken ::= typename LP signed RP.
+typetoken ::= typename LP signed COMMA signed RP.
+typename ::= ID.
+typename ::= STRING.
+typename ::= typename ID.
+typename ::= typename STRING.
+signed ::= plus_num.
+signed ::= minus_num.
+
+scanpt ::= .
+carglist ::= carglist ccons.
+carglist ::= .
+ccons ::= CONSTRAINT nm.
+ccons ::= DEFAULT scantok term.
+ccons ::= DEFAULT LP expr RP.
+ccons ::= DEFAULT PLUS scantok term.
+ccons ::= DEFAULT MINUS scantok term.
+ccons ::= DEFAULT scantok ID.
+ccons ::= NULL onconf.
+ccons ::= NOT NULL onconf.
+ccons ::= PRIMARY KEY sortorder onconf autoinc.
+ccons ::= UNIQUE onconf.
+ccons ::= CHECK LP expr RP.
+ccons ::= REFERENCES nm eidlist_opt refargs.
+ccons ::= defer_subclause.
+ccons ::= COLLATE ID.
+ccons ::= COLLATE STRING.
+ccons ::= GENERATED ALWAYS AS generated.
+ccons ::= AS generated.
+generated ::= LP expr RP.
+generated ::= LP expr RP ID.
+scantok ::= .
+
+autoinc ::= .
+autoinc ::= AUTOINCR.
+
+refargs ::= .
+refargs ::= refargs refarg.
+refarg ::= MATCH nm.
+refarg ::= ON INSERT refact.
+refarg ::= ON DELETE refact.
+refarg ::= ON UPDATE refact.
+refact ::= SET NULL.
+refact ::= SET DEFAULT.
+refact ::= CASCADE.
+refact ::= RESTRICT.
+refact ::= NO ACTION.
+defer_subclause ::= NOT DEFERRABLE init_deferred_pred_opt.
+defer_subclause ::= DEFERRABLE init_deferred_pred_opt.
+init_deferred_pred_opt ::= .
+init_deferred_pred_opt ::= INITIALLY DEFERRED.
+init_deferred_pred_opt ::= INITIALLY IMMEDIATE.
+
+conslist_opt ::= .
+conslist_opt ::= COMMA conslist.
+conslist ::= conslist tconscomma tcons.
+conslist ::= tcons.
+tconscomma ::= COMMA.
+tconscomma ::= .
+tcons ::= CONSTRAINT nm.
+tcons ::= PRIMARY KEY LP sortlist autoinc RP onconf.
+tcons ::= UNIQUE LP sortlist RP onconf.
+tcons ::= CHECK LP expr RP onconf.
+tcons ::= FOREIGN KEY LP eidlist RP
+          REFERENCES nm eidlist_opt refargs defer_subclause_opt.
+defer_subclause_opt ::= .
+defer_subclause_opt ::= defer_subclause.
+
+onconf ::= .
+onconf ::= ON CONFLICT resolvetype.
+orconf ::= .
+orconf ::= OR resolvetype.
+resolvetype ::= raisetype.
+resolvetype ::= IGNORE.
+resolvetype ::= REPLACE.
+
+///////////////////// DROP TABLE and views ////////////////////
+cmd ::= DROP TABLE ifexists fullname.
+ifexists ::= IF EXISTS.
+ifexists ::= .
+cmd ::= createkw temp VIEW ifnotexists nm dbnm eidlist_opt AS select.
+cmd ::= DROP VIEW ifexists fullname.
+
+///////////////////// SELECT //////////////////////////////////
+cmd ::= select.
+
+select ::= WITH wqlist selectnowith.
+select ::= WITH RECURSIVE wqlist selectnowith.
+select ::= selectnowith.
+
+selectnowith ::= oneselect.
+selectnowith ::= selectnowith multiselect_op oneselect.
+multiselect_op ::= UNION.
+multiselect_op ::= UNION ALL.
+multiselect_op ::= EXCEPT.
+multiselect_op ::= INTERSECT.
+
+oneselect ::= SELECT distinct selcollist from where_opt groupby_opt having_opt
+              orderby_opt limit_opt.
+oneselect ::= SELECT distinct selcollist from where_opt groupby_opt having_opt
+              window_clause orderby_opt limit_opt.
+oneselect ::= values.
+values ::= VALUES LP nexprlist RP.
+values ::= values COMMA LP nexprlist RP.
+
+distinct ::= DISTINCT.
+distinct ::= ALL.
+distinct ::= .
+
+sclp ::= selcollist COMMA.
+sclp ::= .
+selcollist ::= sclp scanpt expr scanpt as.
+selcollist ::= sclp scanpt STAR.
+selcollist ::= sclp scanpt nm DOT STAR.
+
+as ::= AS nm.
+as ::= ID.
+as ::= STRING.
+as ::= .
+
+from ::= .
+from ::= FROM seltablist.
+
+stl_prefix ::= seltablist joinop.
+stl_prefix ::= .
+seltablist ::= stl_prefix nm dbnm as on_using.
+seltablist ::= stl_prefix nm dbnm as indexed_by on_using.
+seltablist ::= stl_prefix nm dbnm LP exprlist RP as on_using.
+seltablist ::= stl_prefix LP select RP as on_using.
+seltablist ::= stl_prefix LP seltablist RP as on_using.
+
+dbnm ::= .
+dbnm ::= DOT nm.
+
+fullname ::= nm.
+fullname ::= nm DOT nm.
+xfullname ::= nm.
+xfullname ::= nm DOT nm.
+xfullname ::= nm DOT nm AS nm.
+xfullname ::= nm AS nm.
+
+joinop ::= COMMA.
+joinop ::= JOIN.
+joinop ::= JOIN_KW JOIN.
+joinop ::= JOIN_KW nm JOIN.
+joinop ::= JOIN_KW nm nm JOIN.
+
+on_using ::= ON expr.
+on_using ::= USING LP idlist RP.
+on_using ::= . [OR]
+
+indexed_by ::= INDEXED BY nm.
+indexed_by ::= NOT INDEXED.
+
+orderby_opt ::= .
+orderby_opt ::= ORDER BY sortlist.
+sortlist ::= sortlist COMMA expr sortorder nulls.
+sortlist ::= expr sortorder nulls.
+sortorder ::= ASC.
+sortorder ::= DESC.
+sortorder ::= .
+nulls ::= NULLS FIRST.
+nulls ::= NULLS LAST.
+nulls ::= .
+
+groupby_opt ::= .
+groupby_opt ::= GROUP BY nexprlist.
+having_opt ::= .
+having_opt ::= HAVING expr.
+
+limit_opt ::= .
+limit_opt ::= LIMIT expr.
+limit_opt ::= LIMIT expr OFFSET expr.
+limit_opt ::= LIMIT expr COMMA expr.
+
+///////////////////// DELETE, UPDATE, INSERT //////////////////
+cmd ::= with DELETE FROM xfullname indexed_opt where_opt_ret orderby_opt
+        limit_opt.
+cmd ::= with UPDATE orconf xfullname indexed_opt SET setlist from
+        where_opt_ret orderby_opt limit_opt.
+cmd ::= with insert_cmd INTO xfullname idlist_opt select upsert.
+cmd ::= with insert_cmd INTO xfullname idlist_opt DEFAULT VALUES returning.
+
+with ::= .
+with ::= WITH wqlist.
+with ::= WITH RECURSIVE wqlist.
+
+indexed_opt ::= .
+indexed_opt ::= indexed_by.
+
+where_opt ::= .
+where_opt ::= WHERE expr.
+where_opt_ret ::= .
+where_opt_ret ::= WHERE expr.
+where_opt_ret ::= RETURNING selcollist.
+where_opt_ret ::= WHERE expr RETURNING selcollist.
+
+setlist ::= setlist COMMA nm EQ expr.
+setlist ::= setlist COMMA LP idlist RP EQ expr.
+setlist ::= nm EQ expr.
+setlist ::= LP idlist RP EQ expr.
+
+upsert ::= .
+upsert ::= RETURNING selcollist.
+upsert ::= ON CONFLICT LP sortlist RP where_opt
+              DO UPDATE SET setlist where_opt upsert.
+upsert ::= ON CONFLICT LP sortlist RP where_opt DO NOTHING upsert.
+upsert ::= ON CONFLICT DO NOTHING returning.
+upsert ::= ON CONFLICT DO UPDATE SET setlist where_opt returning.
+returning ::= RETURNING selcollist.
+returning ::= .
+
+insert_cmd ::= INSERT orconf.
+insert_cmd ::= REPLACE.
+
+idlist_opt ::= .
+idlist_opt ::= LP idlist RP.
+idlist ::= idlist COMMA nm.
+idlist ::= nm.
+
+///////////////////// Expressions /////////////////////////////
+expr ::= term.
+expr ::= LP expr RP.
+expr ::= ID.
+expr ::= JOIN_KW.
+expr ::= nm DOT nm.
+expr ::= nm DOT nm DOT nm.
+term ::= NULL.
+term ::= FLOAT.
+term ::= BLOB.
+term ::= STRING.
+term ::= INTEGER.
+expr ::= VARIABLE.
+expr ::= expr COLLATE ID.
+expr ::= expr COLLATE STRING.
+expr ::= CAST LP expr AS typetoken RP.
+expr ::= ID LP distinct exprlist RP.
+expr ::= ID LP distinct exprlist ORDER BY sortlist RP.
+expr ::= ID LP STAR RP.
+expr ::= ID LP distinct exprlist RP filter_over.
+expr ::= ID LP distinct exprlist ORDER BY sortlist RP filter_over.
+expr ::= ID LP STAR RP filter_over.
+term ::= CTIME_KW.
+expr ::= LP nexprlist COMMA expr RP.
+
+expr ::= expr AND expr.
+expr ::= expr OR expr.
+expr ::= expr LT expr.
+expr ::= expr GT expr.
+expr ::= expr GE expr.
+expr ::= expr LE expr.
+expr ::= expr EQ expr.
+expr ::= expr NE expr.
+expr ::= expr BITAND expr.
+expr ::= expr BITOR expr.
+expr ::= expr LSHIFT expr.
+expr ::= expr RSHIFT expr.
+expr ::= expr PLUS expr.
+expr ::= expr MINUS expr.
+expr ::= expr STAR expr.
+expr ::= expr SLASH expr.
+expr ::= expr REM expr.
+expr ::= expr CONCAT expr.
+likeop ::= LIKE_KW.
+likeop ::= NOT LIKE_KW.
+likeop ::= MATCH.
+likeop ::= NOT MATCH.
+expr ::= expr likeop expr. [LIKE_KW]
+expr ::= expr likeop expr ESCAPE expr. [LIKE_KW]
+expr ::= expr ISNULL.
+expr ::= expr NOTNULL.
+expr ::= expr NOT NULL.
+expr ::= expr IS expr.
+expr ::= expr IS NOT expr.
+expr ::= expr IS NOT DISTINCT FROM expr.
+expr ::= expr IS DISTINCT FROM expr.
+expr ::= NOT expr.
+expr ::= BITNOT expr.
+expr ::= PLUS expr. [BITNOT]
+expr ::= MINUS expr. [BITNOT]
+expr ::= expr PTR expr.
+
+between_op ::= BETWEEN.
+between_op ::= NOT BETWEEN.
+expr ::= expr between_op expr AND expr. [BETWEEN]
+in_op ::= IN.
+in_op ::= NOT IN.
+expr ::= expr in_op LP exprlist RP. [IN]
+expr ::= LP select RP.
+expr ::= expr in_op LP select RP. [IN]
+expr ::= expr in_op nm dbnm paren_exprlist. [IN]
+expr ::= EXISTS LP select RP.
+expr ::= CASE case_operand case_exprlist case_else END.
+case_exprlist ::= case_exprlist WHEN expr THEN expr.
+case_exprlist ::= WHEN expr THEN expr.
+case_else ::= ELSE expr.
+case_else ::= .
+case_operand ::= expr.
+case_operand ::= .
+
+exprlist ::= nexprlist.
+exprlist ::= .
+nexprlist ::= nexprlist COMMA expr.
+nexprlist ::= expr.
+
+paren_exprlist ::= .
+paren_exprlist ::= LP exprlist RP.
+
+expr ::= RAISE LP IGNORE RP.
+expr ::= RAISE LP raisetype COMMA nm RP.
+raisetype ::= ROLLBACK.
+raisetype ::= ABORT.
+raisetype ::= FAIL.
+
+///////////////////// CREATE INDEX ////////////////////////////
+cmd ::= createkw uniqueflag INDEX ifnotexists nm dbnm
+        ON nm LP sortlist RP where_opt.
+uniqueflag ::= UNIQUE.
+uniqueflag ::= .
+
+eidlist_opt ::= .
+eidlist_opt ::= LP eidlist RP.
+eidlist ::= eidlist COMMA nm collate sortorder.
+eidlist ::= nm collate sortorder.
+collate ::= .
+collate ::= COLLATE ID.
+collate ::= COLLATE STRING.
+
+cmd ::= DROP INDEX ifexists fullname.
+
+///////////////////// Maintenance /////////////////////////////
+cmd ::= VACUUM vinto.
+cmd ::= VACUUM nm vinto.
+vinto ::= INTO expr.
+vinto ::= .
+
+cmd ::= PRAGMA nm dbnm.
+cmd ::= PRAGMA nm dbnm EQ nmnum.
+cmd ::= PRAGMA nm dbnm LP nmnum RP.
+cmd ::= PRAGMA nm dbnm EQ minus_num.
+cmd ::= PRAGMA nm dbnm LP minus_num RP.
+nmnum ::= plus_num.
+nmnum ::= nm.
+nmnum ::= ON.
+nmnum ::= DELETE.
+nmnum ::= DEFAULT.
+plus_num ::= PLUS number.
+plus_num ::= number.
+minus_num ::= MINUS number.
+number ::= INTEGER.
+number ::= FLOAT.
+
+///////////////////// Triggers ////////////////////////////////
+cmd ::= createkw trigger_decl BEGIN trigger_cmd_list END.
+trigger_decl ::= temp TRIGGER ifnotexists nm dbnm trigger_time trigger_event
+                 ON fullname foreach_clause when_clause.
+trigger_time ::= BEFORE.
+trigger_time ::= AFTER.
+trigger_time ::= INSTEAD OF.
+trigger_time ::= .
+trigger_event ::= DELETE.
+trigger_event ::= INSERT.
+trigger_event ::= UPDATE.
+trigger_event ::= UPDATE OF idlist.
+foreach_clause ::= .
+foreach_clause ::= FOR EACH ROW.
+when_clause ::= .
+when_clause ::= WHEN expr.
+trigger_cmd_list ::= trigger_cmd_list trigger_cmd SEMI.
+trigger_cmd_list ::= trigger_cmd SEMI.
+trnm ::= nm.
+trnm ::= nm DOT nm.
+tridxby ::= .
+tridxby ::= INDEXED BY nm.
+tridxby ::= NOT INDEXED.
+trigger_cmd ::= UPDATE orconf trnm tridxby SET setlist from where_opt scanpt.
+trigger_cmd ::= scanpt insert_cmd INTO trnm idlist_opt select upsert scanpt.
+trigger_cmd ::= DELETE FROM trnm tridxby where_opt scanpt.
+trigger_cmd ::= scanpt select scanpt.
+cmd ::= DROP TRIGGER ifexists fullname.
+
+///////////////////// ATTACH, REINDEX, ANALYZE, ALTER /////////
+cmd ::= ATTACH database_kw_opt expr AS expr key_opt.
+cmd ::= DETACH database_kw_opt expr.
+key_opt ::= .
+key_opt ::= KEY expr.
+database_kw_opt ::= DATABASE.
+database_kw_opt ::= .
+cmd ::= REINDEX.
+cmd ::= REINDEX nm dbnm.
+cmd ::= ANALYZE.
+cmd ::= ANALYZE nm dbnm.
+cmd ::= ALTER TABLE fullname RENAME TO nm.
+cmd ::= ALTER TABLE add_column_fullname ADD kwcolumn_opt columnname carglist.
+cmd ::= ALTER TABLE fullname DROP kwcolumn_opt nm.
+add_column_fullname ::= fullname.
+cmd ::= ALTER TABLE fullname RENAME kwcolumn_opt nm TO nm.
+kwcolumn_opt ::= .
+kwcolumn_opt ::= COLUMNKW.
+
+///////////////////// Virtual tables //////////////////////////
+cmd ::= create_vtab.
+cmd ::= create_vtab LP vtabarglist RP.
+create_vtab ::= createkw VIRTUAL TABLE ifnotexists nm dbnm USING nm.
+vtabarglist ::= vtabarg.
+vtabarglist ::= vtabarglist COMMA vtabarg.
+vtabarg ::= .
+vtabarg ::= vtabarg vtabargtoken.
+vtabargtoken ::= ANY.
+vtabargtoken ::= lp anylist RP.
+lp ::= LP.
+anylist ::= .
+anylist ::= anylist LP anylist RP.
+anylist ::= anylist ANY.
+
+///////////////////// Common table expressions ///////////////
+wqas ::= AS.
+wqas ::= AS MATERIALIZED.
+wqas ::= AS NOT MATERIALIZED.
+wqitem ::= nm eidlist_opt wqas LP select RP.
+wqlist ::= wqitem.
+wqlist ::= wqlist COMMA wqitem.
+
+///////////////////// Window functions ////////////////////////
+windowdefn_list ::= windowdefn.
+windowdefn_list ::= windowdefn_list COMMA windowdefn.
+windowdefn ::= nm AS LP window RP.
+window ::= PARTITION BY nexprlist orderby_opt frame_opt.
+window ::= nm PARTITION BY nexprlist orderby_opt frame_opt.
+window ::= ORDER BY sortlist frame_opt.
+window ::= nm ORDER BY sortlist frame_opt.
+window ::= frame_opt.
+window ::= nm frame_opt.
+frame_opt ::= .
+frame_opt ::= range_or_rows frame_bound_s frame_exclude_opt.
+frame_opt ::= range_or_rows BETWEEN frame_bound_s AND
+                          frame_bound_e frame_exclude_opt.
+range_or_rows ::= RANGE.
+range_or_rows ::= ROWS.
+range_or_rows ::= GROUPS.
+frame_bound_s ::= frame_bound.
+frame_bound_s ::= UNBOUNDED PRECEDING.
+frame_bound_e ::= frame_bound.
+frame_bound_e ::= UNBOUNDED FOLLOWING.
+frame_bound ::= expr PRECEDING.
+frame_bound ::= expr FOLLOWING.
+frame_bound ::= CURRENT ROW.
+frame_exclude_opt ::= .
+frame_exclude_opt ::= EXCLUDE frame_exclude.
+frame_exclude ::= NO OTHERS.
+frame_exclude ::= CURRENT ROW.
+frame_exclude ::= GROUP.
+frame_exclude ::= TIES.
+window_clause ::= WINDOW windowdefn_list.
+filter_over ::= filter_clause over_clause.
+filter_over ::= over_clause.
+filter_over ::= filter_clause.
+over_clause ::= OVER LP window RP.
+over_clause ::= OVER nm.
+filter_clause ::= FILTER LP WHERE expr RP.
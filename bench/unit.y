@@ -0,0 +1,41 @@
+// expr.y with a longer precedence ladder whose unit rules have no code,
+// for comparing parsers built with and without lemon -u (make unit).
+// parsebench.c includes "expr.h", so the Makefile builds this grammar
+// under the name expr.y.
+
+%include {
+#include "parsebench.h"
+}
+
+%token_type {int}
+%type expr {int}
+%type term {int}
+%type unary {int}
+%type factor {int}
+%type primary {int}
+%type list {int}
+
+%stack_size 0
+
+%syntax_error { bench_nerror++; }
+%parse_failure { bench_nfailure++; }
+
+program ::= items.
+items ::= items item.
+items ::= .
+item ::= expr(A) SEMI. { bench_sum += A; bench_nreduce++; }
+item ::= error SEMI. { bench_nreduce++; }
+
+expr(A) ::= expr(B) PLUS term(C). { A = B + C; bench_nreduce++; }
+expr(A) ::= expr(B) MINUS term(C). { A = B - C; bench_nreduce++; }
+expr(A) ::= term(A).
+term(A) ::= term(B) STAR unary(C). { A = B * C; bench_nreduce++; }
+term(A) ::= unary(A).
+unary(A) ::= factor(A).
+factor(A) ::= primary(A).
+primary(A) ::= NUM(A).
+primary(A) ::= LP expr(B) RP. { A = B; bench_nreduce++; }
+primary(A) ::= LB list(B) RB. { A = B; bench_nreduce++; }
+primary(A) ::= LB RB. { A = 0; bench_nreduce++; }
+list(A) ::= list(B) COMMA expr(C). { A = B + C; bench_nreduce++; }
+list(A) ::= expr(A).
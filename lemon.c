@@ -6,12 +6,17 @@
 **
 ** The author of this program disclaims copyright.
 */
+#if !defined(_POSIX_C_SOURCE) && !defined(_WIN32) && !defined(WIN32)
+#define _POSIX_C_SOURCE 200112L   /* For clock_gettime() */
+#endif
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <setjmp.h>
+#include <time.h>
 
 #define ISSPACE(X) isspace((unsigned char)(X))
 #define ISDIGIT(X) isdigit((unsigned char)(X))
@@ -47,6 +52,14 @@ extern int access(const char *path, int mode);
 #include <unistd.h>
 #endif
 
+/* The command-line program can run independent grammars on a pool of
+** threads.  Define LEMON_NO_THREADS to build it without pthreads; the
+** grammars are then processed one after another. */
+#if !defined(LEMON_LIBRARY) && !defined(LEMON_NO_THREADS) && !defined(__WIN32__)
+#include <pthread.h>
+#define LEMON_THREADS 1
+#endif
+
 /* #define PRIVATE static */
 #define PRIVATE
 
@@ -57,7 +70,83 @@ extern int access(const char *path, int mode);
 #endif
 
 extern void memory_error();
-static int showPrecedenceConflict = 0;
+
+/*
+** Storage class used for the pointer to the current generator context.
+** Each thread that runs the generator gets its own context, so several
+** grammars can be processed at once without any locking.
+*/
+#ifndef LEMON_THREADLOCAL
+# if defined(_MSC_VER)
+#  define LEMON_THREADLOCAL __declspec(thread)
+# elif defined(__GNUC__) || defined(__clang__)
+#  define LEMON_THREADLOCAL __thread
+# elif defined(__STDC_VERSION__) && __STDC_VERSION__>=201112L
+#  define LEMON_THREADLOCAL _Thread_local
+# else
+#  define LEMON_THREADLOCAL
+# endif
+#endif
+
+/*
+** A growable in-memory text buffer.  See "buffer.c" below.
+*/
+struct lemon_buf {
+  char *z;              /* The text.  Always zero-terminated if not NULL */
+  int n;                /* Bytes of text in z[] */
+  int nAlloc;           /* Bytes allocated for z[] */
+};
+
+/*
+** All of the mutable state that the generator needs outside of
+** "struct lemon" lives here: the free lists, the configuration list
+** builder, the set size, the hash tables and the command-line settings.
+** Nothing else in this file is written after startup.
+*/
+struct lemon_context {
+  int showPrecedenceConflict;     /* Show conflicts resolved by precedence */
+  int nDefine;                    /* Number of -D options */
+  char **azDefine;                /* Name of the -D macros */
+  const char *outputDir;          /* Directory for output files, or NULL */
+  const char *user_templatename;  /* Template given with -T, or NULL */
+  struct action *actionfreelist;  /* Free parser actions */
+  struct plink *plink_freelist;   /* Free follow-set propagation links */
+  struct config *freelist;        /* List of free configurations */
+  struct config *current;         /* Top of list of configurations */
+  struct config **currentend;     /* Last on list of configs */
+  struct config *basis;           /* Top of list of basis configs */
+  struct config **basisend;       /* End of list of basis configs */
+  int size;                       /* Number of elements in every set */
+  char *zAppend;                  /* Text accumulated by append_str() */
+  int nAppendAlloc;               /* Bytes allocated for zAppend */
+  int nAppendUsed;                /* Bytes of zAppend in use */
+  struct s_x1 *x1a;               /* Strsafe hash table */
+  struct s_x2 *x2a;               /* Symbol hash table */
+  struct s_x3 *x3a;               /* State hash table */
+  struct s_x4 *x4a;               /* Configuration hash table */
+  union lemon_chunk *pChunk;      /* Every block allocated by lemon_malloc() */
+  size_t nMem;                    /* Bytes now allocated by lemon_malloc() */
+  size_t nMemPeak;                /* Most bytes allocated at once */
+  size_t nPhasePeak;              /* Most bytes allocated in this phase */
+  double phaseWall;               /* Wall-clock time the phase began */
+  double phaseCpu;                /* CPU time the phase began */
+  struct lemon_buf *pErr;         /* Collect error messages here, if not NULL */
+  jmp_buf *pAbort;                /* Where lemon_exit() returns to, if not NULL */
+  int exitCode;                   /* The code lemon_exit() was given */
+  struct lemon_buf source;        /* The generated parser */
+  struct lemon_buf header;        /* The generated header */
+  struct lemon_buf report;        /* The report, or the reprinted grammar */
+};
+
+/* The context used by the current thread */
+static LEMON_THREADLOCAL struct lemon_context *lemon_ctx = 0;
+
+static void *lemon_malloc(size_t);
+static void *lemon_calloc(size_t, size_t);
+static void *lemon_realloc(void *, size_t);
+static void lemon_free(void *);
+static void lemon_exit(int);
+
 static char *msort(char*,char**,int(*)(const char*,const char*));
 
 /*
@@ -143,7 +232,7 @@ static int lemon_vsprintf(char *str, const char *zFormat, va_list ap){
         lemon_addtext(str, &nUsed, "%", 1, 0);
       }else{
         fprintf(stderr, "illegal format\n");
-        exit(1);
+        lemon_exit(1);
       }
       j = i+1;
     }
@@ -167,6 +256,253 @@ static void lemon_strcat(char *dest, const char *src){
   lemon_strcpy(dest, src);
 }
 
+/*
+** Memory allocation.  Every block is threaded onto a list that belongs
+** to the current context.  The generator frees very little of what it
+** allocates, so this list is what lets lemon_generate() release all of
+** the memory used by one run when it is done.
+*/
+typedef union lemon_chunk lemon_chunk;
+union lemon_chunk {
+  struct {
+    lemon_chunk *pPrev;       /* Previous block on the list */
+    lemon_chunk *pNext;       /* Next block on the list */
+    size_t n;                 /* Bytes in the payload */
+  } h;
+  double notUsed1;            /* Force the payload to be aligned */
+  void *notUsed2;
+  long notUsed3;
+};
+static void lemon_chunk_link(lemon_chunk *p){
+  p->h.pPrev = 0;
+  p->h.pNext = lemon_ctx->pChunk;
+  if( p->h.pNext ) p->h.pNext->h.pPrev = p;
+  lemon_ctx->pChunk = p;
+  lemon_ctx->nMem += p->h.n;
+  if( lemon_ctx->nMem>lemon_ctx->nMemPeak ) lemon_ctx->nMemPeak = lemon_ctx->nMem;
+  if( lemon_ctx->nMem>lemon_ctx->nPhasePeak ) lemon_ctx->nPhasePeak = lemon_ctx->nMem;
+}
+static void lemon_chunk_unlink(lemon_chunk *p){
+  if( p->h.pPrev ) p->h.pPrev->h.pNext = p->h.pNext;
+  else lemon_ctx->pChunk = p->h.pNext;
+  if( p->h.pNext ) p->h.pNext->h.pPrev = p->h.pPrev;
+  lemon_ctx->nMem -= p->h.n;
+}
+static void *lemon_malloc(size_t n){
+  lemon_chunk *p = (lemon_chunk*)malloc( sizeof(lemon_chunk) + n );
+  if( p==0 ) return 0;
+  p->h.n = n;
+  lemon_chunk_link(p);
+  return (void*)&p[1];
+}
+static void *lemon_calloc(size_t n, size_t sz){
+  void *p = lemon_malloc( n*sz );
+  if( p ) memset(p, 0, n*sz);
+  return p;
+}
+static void *lemon_realloc(void *pOld, size_t n){
+  lemon_chunk *p;
+  if( pOld==0 ) return lemon_malloc(n);
+  p = &((lemon_chunk*)pOld)[-1];
+  lemon_chunk_unlink(p);
+  p = (lemon_chunk*)realloc(p, sizeof(lemon_chunk) + n);
+  if( p==0 ){
+    /* The original block is still valid.  Keep it on the list. */
+    lemon_chunk_link(&((lemon_chunk*)pOld)[-1]);
+    return 0;
+  }
+  p->h.n = n;
+  lemon_chunk_link(p);
+  return (void*)&p[1];
+}
+static void lemon_free(void *pOld){
+  lemon_chunk *p;
+  if( pOld==0 ) return;
+  p = &((lemon_chunk*)pOld)[-1];
+  lemon_chunk_unlink(p);
+  free(p);
+}
+/* Release every block still allocated in the current context */
+static void lemon_free_all(void){
+  lemon_chunk *p, *pNext;
+  for(p=lemon_ctx->pChunk; p; p=pNext){
+    pNext = p->h.pNext;
+    free(p);
+  }
+  lemon_ctx->pChunk = 0;
+  lemon_ctx->nMem = 0;
+}
+
+/*
+** Return the wall-clock time and the CPU time used by the calling
+** thread, both in seconds.  Only differences between two readings are
+** meaningful.
+*/
+static void lemon_clock(double *pWall, double *pCpu){
+#if defined(CLOCK_MONOTONIC)
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  *pWall = t.tv_sec + t.tv_nsec*1e-9;
+#else
+  *pWall = (double)time(0);
+#endif
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+  {
+    struct timespec c;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c);
+    *pCpu = c.tv_sec + c.tv_nsec*1e-9;
+  }
+#else
+  *pCpu = (double)clock()/CLOCKS_PER_SEC;
+#endif
+}
+
+/*
+** Abandon the current run.  A library caller gets control back inside
+** lemon_generate(), which returns the code.  Otherwise exit the program.
+*/
+static void lemon_exit(int code){
+  if( lemon_ctx && lemon_ctx->pAbort ){
+    lemon_ctx->exitCode = code ? code : 1;
+    longjmp(*lemon_ctx->pAbort, 1);
+  }
+  exit(code);
+}
+
+/*
+** Call xRun(pArg) so that lemon_exit() comes back here instead of ending
+** the program.  Return 0 if xRun() returns, or the code that was passed
+** to lemon_exit().  The setjmp() is kept in this small function so that
+** nothing it reads after a longjmp() is changed in between.
+*/
+static int lemon_protect(void (*xRun)(void*), void *pArg){
+  jmp_buf abortJmp;
+  lemon_ctx->exitCode = 0;
+  lemon_ctx->pAbort = &abortJmp;
+  if( setjmp(abortJmp)==0 ){
+    xRun(pArg);
+  }
+  lemon_ctx->pAbort = 0;
+  return lemon_ctx->exitCode;
+}
+
+/****************** From the file "buffer.c" ********************************/
+/*
+** A growable in-memory text buffer.  The parser source, the header and
+** the report are each accumulated in one of these and then written out
+** (or handed to a library caller) in a single operation.
+**
+** The formatter understands the conversions used by the rest of this
+** program:  %d, %i, %s and %%, with an optional "-" flag, an optional
+** width and an optional precision.  The width and precision may be "*".
+*/
+/* Make room for at least N more bytes plus a terminator */
+static void lemon_bgrow(struct lemon_buf *p, int N){
+  char *zNew;
+  int nNew;
+  if( p->n+N < p->nAlloc ) return;
+  nNew = p->nAlloc*2 + N + 1000;
+  zNew = (char*)realloc(p->z, nNew);
+  if( zNew==0 ) memory_error();
+  p->z = zNew;
+  p->nAlloc = nNew;
+}
+static void lemon_bappend(struct lemon_buf *p, const char *z, int n){
+  if( n<0 ) n = lemonStrlen(z);
+  lemon_bgrow(p, n);
+  memcpy(&p->z[p->n], z, n);
+  p->n += n;
+  p->z[p->n] = 0;
+}
+static void lemon_bputc(struct lemon_buf *p, int c){
+  lemon_bgrow(p, 1);
+  p->z[p->n++] = (char)c;
+  p->z[p->n] = 0;
+}
+static void lemon_bputs(struct lemon_buf *p, const char *z){
+  lemon_bappend(p, z, -1);
+}
+/* Append n bytes of z[], padded with spaces to iWidth.  Negative iWidth
+** means left justify. */
+static void lemon_bpad(struct lemon_buf *p, const char *z, int n, int iWidth){
+  int nPad = (iWidth<0 ? -iWidth : iWidth) - n;
+  if( iWidth>0 ) while( nPad-- > 0 ) lemon_bputc(p, ' ');
+  lemon_bappend(p, z, n);
+  if( iWidth<0 ) while( nPad-- > 0 ) lemon_bputc(p, ' ');
+}
+static void lemon_bvprintf(struct lemon_buf *p, const char *zFormat, va_list ap){
+  int i, j, k, c;
+  const char *z;
+  char zTemp[50];
+  for(i=j=0; (c = zFormat[i])!=0; i++){
+    if( c=='%' ){
+      int iWidth = 0;
+      int iPrec = -1;
+      int bLeft = 0;
+      if( i>j ) lemon_bappend(p, &zFormat[j], i-j);
+      c = zFormat[++i];
+      if( c=='-' ){ bLeft = 1; c = zFormat[++i]; }
+      if( c=='*' ){
+        iWidth = va_arg(ap, int);
+        if( iWidth<0 ){ bLeft = 1; iWidth = -iWidth; }
+        c = zFormat[++i];
+      }else{
+        while( ISDIGIT(c) ){ iWidth = iWidth*10 + c - '0'; c = zFormat[++i]; }
+      }
+      if( c=='.' ){
+        c = zFormat[++i];
+        if( c=='*' ){
+          iPrec = va_arg(ap, int);
+          c = zFormat[++i];
+        }else{
+          iPrec = 0;
+          while( ISDIGIT(c) ){ iPrec = iPrec*10 + c - '0'; c = zFormat[++i]; }
+        }
+      }
+      if( bLeft ) iWidth = -iWidth;
+      if( c=='d' || c=='i' ){
+        int v = va_arg(ap, int);
+        unsigned int u = v<0 ? -(unsigned int)v : (unsigned int)v;
+        k = 0;
+        do{
+          zTemp[sizeof(zTemp)-1-k++] = (char)((u%10) + '0');
+          u /= 10;
+        }while( u>0 );
+        if( v<0 ) zTemp[sizeof(zTemp)-1-k++] = '-';
+        lemon_bpad(p, &zTemp[sizeof(zTemp)-k], k, iWidth);
+      }else if( c=='s' ){
+        z = va_arg(ap, const char*);
+        if( z==0 ) z = "";
+        if( iPrec<0 ){
+          k = lemonStrlen(z);
+        }else{
+          for(k=0; k<iPrec && z[k]; k++){}
+        }
+        lemon_bpad(p, z, k, iWidth);
+      }else if( c=='%' ){
+        lemon_bputc(p, '%');
+      }else{
+        fprintf(stderr, "illegal format\n");
+        lemon_exit(1);
+      }
+      j = i+1;
+    }
+  }
+  if( i>j ) lemon_bappend(p, &zFormat[j], i-j);
+}
+static void lemon_bprintf(struct lemon_buf *p, const char *zFormat, ...){
+  va_list ap;
+  va_start(ap, zFormat);
+  lemon_bvprintf(p, zFormat, ap);
+  va_end(ap);
+}
+/* Release the memory held by a buffer */
+static void lemon_bfree(struct lemon_buf *p){
+  free(p->z);
+  p->z = 0;
+  p->n = p->nAlloc = 0;
+}
+
 
 /* a few forward declarations... */
 struct rule;
@@ -198,6 +534,7 @@ void Configlist_reset(void);
 
 /********* From the file "error.h" ***************************************/
 void ErrorMsg(const char *, int,const char *, ...);
+void lemon_error(const char *, ...);
 
 /****** From the file "option.h" ******************************************/
 enum option_type { OPT_FLAG=1,  OPT_INT,  OPT_DBL,  OPT_STR,
@@ -224,12 +561,26 @@ void Plink_copy(struct plink **, struct plink *);
 void Plink_delete(struct plink *);
 
 /********** From the file "report.h" *************************************/
-void Reprint(struct lemon *);
-void ReportOutput(struct lemon *);
-void ReportTable(struct lemon *, int);
-void ReportHeader(struct lemon *);
+void Reprint(struct lemon *, struct lemon_buf *);
+void ReportOutput(struct lemon *, struct lemon_buf *);
+void ReportTable(struct lemon *, int, const char *, struct lemon_buf *);
+void ReportHeader(struct lemon *, struct lemon_buf *);
 void CompressTables(struct lemon *);
+int FoldFallback(struct lemon *);
+int MinimizeStates(struct lemon *);
+void ReadProfile(struct lemon *, const char *);
 void ResortStates(struct lemon *, int);
+void StackBound(struct lemon *);
+
+/********** From the file "scan.h" ***************************************/
+struct scanner;
+struct symbol;
+const char *ScanAddPattern(struct lemon *, struct symbol *, const char *);
+int ScanBuild(struct lemon *);
+void ReportScanner(struct lemon *, struct lemon_buf *, int *);
+
+/********** From the file "liblemon.h" ***********************************/
+#include "liblemon.h"
 
 /********** From the file "set.h" ****************************************/
 void  SetSize(int);             /* All sets will be of size N */
@@ -265,6 +616,8 @@ struct symbol {
   enum symbol_type type;   /* Symbols are all either TERMINALS or NTs */
   struct rule *rule;       /* Linked list of rules of this (if an NT) */
   struct symbol *fallback; /* fallback token in case this token doesn't parse */
+  const char *keyword;     /* Spelling given by %keywords, or NULL */
+  int bSync;               /* True if named by %sync */
   int prec;                /* Precedence if defined (-1 otherwise) */
   enum e_assoc assoc;      /* Associativity if precedence is defined */
   char *firstset;          /* First-set for all rules of this symbol */
@@ -302,11 +655,13 @@ struct rule {
   const char *codeSuffix;  /* Breakdown code after code[] above */
   int noCode;              /* True if this rule has no associated C code */
   int codeEmitted;         /* True if the code has been emitted already */
+  int lhsMinor;            /* True if the code uses yylhsminor */
   struct symbol *precsym;  /* Precedence symbol for this rule */
   int index;               /* An index number for this rule */
   int iRule;               /* Rule number as used in the generated tables */
   Boolean canReduce;       /* True if this rule is ever reduced */
   Boolean doesReduce;      /* Reduce actions occur after optimization */
+  unsigned long nHit;      /* Reductions counted by a profile */
   struct rule *nextlhs;    /* Next rule with the same LHS */
   struct rule *next;       /* Next rule in the global list */
 };
@@ -371,6 +726,9 @@ struct state {
   int iDfltReduce;         /* Default action is to REDUCE by this rule */
   struct rule *pDfltReduce;/* The default REDUCE rule. */
   int autoReduce;          /* True if this is an auto-reduce state */
+  int iId;                 /* Number before ResortStates(), for profiles */
+  unsigned long nTknHit;   /* Token row lookups counted by a profile */
+  unsigned long nNtHit;    /* Goto row lookups counted by a profile */
 };
 #define NO_OFFSET (-2147483647)
 
@@ -405,6 +763,11 @@ struct lemon {
   int errorcnt;            /* Number of errors */
   struct symbol *errsym;   /* The error symbol */
   struct symbol *wildcard; /* Token that matches anything */
+  struct symbol **keywords; /* Tokens named by %keywords, in order */
+  int nkeyword;            /* Number of entries in keywords[] */
+  struct scanner *scanner; /* From %token_pattern and %token_skip, or NULL */
+  int nsync;               /* Number of tokens named by %sync */
+  int recognizer;          /* True for %recognizer: accept or reject only */
   char *name;              /* Name of the generated parser */
   char *arg;               /* Declaration of the 3th argument to parser */
   char *ctx;               /* Declaration of 2nd argument to constructor */
@@ -422,6 +785,8 @@ struct lemon {
   char *tokendest;         /* Code to execute to destroy token data */
   char *vardest;           /* Code for the default non-terminal destructor */
   char *filename;          /* Name of the input file */
+  const char *zInput;      /* Text of the input file, or NULL to read it */
+  int nInput;              /* Bytes in zInput, or -1 if zero-terminated */
   char *outname;           /* Name of the current output file */
   char *tokenprefix;       /* A prefix added to token names in the .h file */
   int nconflict;           /* Number of parsing conflicts */
@@ -431,6 +796,16 @@ struct lemon {
   int basisflag;           /* Print only basis configurations */
   int has_fallback;        /* True if any %fallback is seen in the grammar */
   int nolinenosflag;       /* True if #line statements should not be printed */
+  int reduceTable;         /* True to emit reduce actions as functions */
+  int nfolded;             /* Actions added by FoldFallback(), or -1 if off */
+  int tokenClasses;        /* True to index token rows by terminal class */
+  int unitRules;           /* True to skip unit rules on terminals too */
+  int nunit;               /* Terminal actions rewritten by unitRules, or -1 */
+  int profiled;            /* True if the tables follow a profile */
+  int nclass;              /* Number of terminal classes, or -1 if off */
+  int nmerged;             /* States removed by MinimizeStates(), or -1 */
+  int stackBound;          /* Deepest the parser stack can get, or 0 */
+  int stackHeadroom;       /* Most stack entries one token pushes, or 0 */
   char *argv0;             /* Name of the program */
 };
 
@@ -493,22 +868,21 @@ void Configtable_clear(int(*)(struct config *));
 
 /* Allocate a new parser action */
 static struct action *Action_new(void){
-  static struct action *actionfreelist = 0;
   struct action *newaction;
 
-  if( actionfreelist==0 ){
+  if( lemon_ctx->actionfreelist==0 ){
     int i;
     int amt = 100;
-    actionfreelist = (struct action *)calloc(amt, sizeof(struct action));
-    if( actionfreelist==0 ){
-      fprintf(stderr,"Unable to allocate memory for a new parser action.");
-      exit(1);
+    lemon_ctx->actionfreelist = (struct action *)lemon_calloc(amt, sizeof(struct action));
+    if( lemon_ctx->actionfreelist==0 ){
+      lemon_error("Unable to allocate memory for a new parser action.");
+      lemon_exit(1);
     }
-    for(i=0; i<amt-1; i++) actionfreelist[i].next = &actionfreelist[i+1];
-    actionfreelist[amt-1].next = 0;
+    for(i=0; i<amt-1; i++) lemon_ctx->actionfreelist[i].next = &lemon_ctx->actionfreelist[i+1];
+    lemon_ctx->actionfreelist[amt-1].next = 0;
   }
-  newaction = actionfreelist;
-  actionfreelist = actionfreelist->next;
+  newaction = lemon_ctx->actionfreelist;
+  lemon_ctx->actionfreelist = lemon_ctx->actionfreelist->next;
   return newaction;
 }
 
@@ -618,17 +992,17 @@ struct acttab {
 
 /* Free all memory associated with the given acttab */
 void acttab_free(acttab *p){
-  free( p->aAction );
-  free( p->aLookahead );
-  free( p );
+  lemon_free( p->aAction );
+  lemon_free( p->aLookahead );
+  lemon_free( p );
 }
 
 /* Allocate a new acttab structure */
 acttab *acttab_alloc(int nsymbol, int nterminal){
-  acttab *p = (acttab *) calloc( 1, sizeof(*p) );
+  acttab *p = (acttab *) lemon_calloc( 1, sizeof(*p) );
   if( p==0 ){
-    fprintf(stderr,"Unable to allocate memory for a new acttab.");
-    exit(1);
+    lemon_error("Unable to allocate memory for a new acttab.");
+    lemon_exit(1);
   }
   memset(p, 0, sizeof(*p));
   p->nsymbol = nsymbol;
@@ -644,11 +1018,11 @@ acttab *acttab_alloc(int nsymbol, int nterminal){
 void acttab_action(acttab *p, int lookahead, int action){
   if( p->nLookahead>=p->nLookaheadAlloc ){
     p->nLookaheadAlloc += 25;
-    p->aLookahead = (struct lookahead_action *) realloc( p->aLookahead,
+    p->aLookahead = (struct lookahead_action *) lemon_realloc( p->aLookahead,
                              sizeof(p->aLookahead[0])*p->nLookaheadAlloc );
     if( p->aLookahead==0 ){
-      fprintf(stderr,"malloc failed\n");
-      exit(1);
+      lemon_error("malloc failed\n");
+      lemon_exit(1);
     }
   }
   if( p->nLookahead==0 ){
@@ -694,11 +1068,11 @@ int acttab_insert(acttab *p, int makeItSafe){
   if( p->nAction + n >= p->nActionAlloc ){
     int oldAlloc = p->nActionAlloc;
     p->nActionAlloc = p->nAction + n + p->nActionAlloc + 20;
-    p->aAction = (struct lookahead_action *) realloc( p->aAction,
+    p->aAction = (struct lookahead_action *) lemon_realloc( p->aAction,
                           sizeof(p->aAction[0])*p->nActionAlloc);
     if( p->aAction==0 ){
-      fprintf(stderr,"malloc failed\n");
-      exit(1);
+      lemon_error("malloc failed\n");
+      lemon_exit(1);
     }
     for(i=oldAlloc; i<p->nActionAlloc; i++){
       p->aAction[i].lookahead = -1;
@@ -1296,54 +1670,49 @@ static int resolve_conflict(
 ** in the LEMON parser generator.
 */
 
-static struct config *freelist = 0;      /* List of free configurations */
-static struct config *current = 0;       /* Top of list of configurations */
-static struct config **currentend = 0;   /* Last on list of configs */
-static struct config *basis = 0;         /* Top of list of basis configs */
-static struct config **basisend = 0;     /* End of list of basis configs */
 
 /* Return a pointer to a new configuration */
 PRIVATE struct config *newconfig(void){
   struct config *newcfg;
-  if( freelist==0 ){
+  if( lemon_ctx->freelist==0 ){
     int i;
     int amt = 3;
-    freelist = (struct config *)calloc( amt, sizeof(struct config) );
-    if( freelist==0 ){
-      fprintf(stderr,"Unable to allocate memory for a new configuration.");
-      exit(1);
+    lemon_ctx->freelist = (struct config *)lemon_calloc( amt, sizeof(struct config) );
+    if( lemon_ctx->freelist==0 ){
+      lemon_error("Unable to allocate memory for a new configuration.");
+      lemon_exit(1);
     }
-    for(i=0; i<amt-1; i++) freelist[i].next = &freelist[i+1];
-    freelist[amt-1].next = 0;
+    for(i=0; i<amt-1; i++) lemon_ctx->freelist[i].next = &lemon_ctx->freelist[i+1];
+    lemon_ctx->freelist[amt-1].next = 0;
   }
-  newcfg = freelist;
-  freelist = freelist->next;
+  newcfg = lemon_ctx->freelist;
+  lemon_ctx->freelist = lemon_ctx->freelist->next;
   return newcfg;
 }
 
 /* The configuration "old" is no longer used */
 PRIVATE void deleteconfig(struct config *old)
 {
-  old->next = freelist;
-  freelist = old;
+  old->next = lemon_ctx->freelist;
+  lemon_ctx->freelist = old;
 }
 
 /* Initialized the configuration list builder */
 void Configlist_init(void){
-  current = 0;
-  currentend = &current;
-  basis = 0;
-  basisend = &basis;
+  lemon_ctx->current = 0;
+  lemon_ctx->currentend = &lemon_ctx->current;
+  lemon_ctx->basis = 0;
+  lemon_ctx->basisend = &lemon_ctx->basis;
   Configtable_init();
   return;
 }
 
 /* Initialized the configuration list builder */
 void Configlist_reset(void){
-  current = 0;
-  currentend = &current;
-  basis = 0;
-  basisend = &basis;
+  lemon_ctx->current = 0;
+  lemon_ctx->currentend = &lemon_ctx->current;
+  lemon_ctx->basis = 0;
+  lemon_ctx->basisend = &lemon_ctx->basis;
   Configtable_clear(0);
   return;
 }
@@ -1355,7 +1724,7 @@ struct config *Configlist_add(
 ){
   struct config *cfp, model;
 
-  assert( currentend!=0 );
+  assert( lemon_ctx->currentend!=0 );
   model.rp = rp;
   model.dot = dot;
   cfp = Configtable_find(&model);
@@ -1368,8 +1737,8 @@ struct config *Configlist_add(
     cfp->fplp = cfp->bplp = 0;
     cfp->next = 0;
     cfp->bp = 0;
-    *currentend = cfp;
-    currentend = &cfp->next;
+    *lemon_ctx->currentend = cfp;
+    lemon_ctx->currentend = &cfp->next;
     Configtable_insert(cfp);
   }
   return cfp;
@@ -1380,8 +1749,8 @@ struct config *Configlist_addbasis(struct rule *rp, int dot)
 {
   struct config *cfp, model;
 
-  assert( basisend!=0 );
-  assert( currentend!=0 );
+  assert( lemon_ctx->basisend!=0 );
+  assert( lemon_ctx->currentend!=0 );
   model.rp = rp;
   model.dot = dot;
   cfp = Configtable_find(&model);
@@ -1394,10 +1763,10 @@ struct config *Configlist_addbasis(struct rule *rp, int dot)
     cfp->fplp = cfp->bplp = 0;
     cfp->next = 0;
     cfp->bp = 0;
-    *currentend = cfp;
-    currentend = &cfp->next;
-    *basisend = cfp;
-    basisend = &cfp->bp;
+    *lemon_ctx->currentend = cfp;
+    lemon_ctx->currentend = &cfp->next;
+    *lemon_ctx->basisend = cfp;
+    lemon_ctx->basisend = &cfp->bp;
     Configtable_insert(cfp);
   }
   return cfp;
@@ -1411,8 +1780,8 @@ void Configlist_closure(struct lemon *lemp)
   struct symbol *sp, *xsp;
   int i, dot;
 
-  assert( currentend!=0 );
-  for(cfp=current; cfp; cfp=cfp->next){
+  assert( lemon_ctx->currentend!=0 );
+  for(cfp=lemon_ctx->current; cfp; cfp=cfp->next){
     rp = cfp->rp;
     dot = cfp->dot;
     if( dot>=rp->nrhs ) continue;
@@ -1450,17 +1819,17 @@ void Configlist_closure(struct lemon *lemp)
 
 /* Sort the configuration list */
 void Configlist_sort(void){
-  current = (struct config*)msort((char*)current,(char**)&(current->next),
+  lemon_ctx->current = (struct config*)msort((char*)lemon_ctx->current,(char**)&(lemon_ctx->current->next),
                                   Configcmp);
-  currentend = 0;
+  lemon_ctx->currentend = 0;
   return;
 }
 
 /* Sort the basis configuration list */
 void Configlist_sortbasis(void){
-  basis = (struct config*)msort((char*)current,(char**)&(current->bp),
+  lemon_ctx->basis = (struct config*)msort((char*)lemon_ctx->current,(char**)&(lemon_ctx->current->bp),
                                 Configcmp);
-  basisend = 0;
+  lemon_ctx->basisend = 0;
   return;
 }
 
@@ -1468,9 +1837,9 @@ void Configlist_sortbasis(void){
 ** reset the list */
 struct config *Configlist_return(void){
   struct config *old;
-  old = current;
-  current = 0;
-  currentend = 0;
+  old = lemon_ctx->current;
+  lemon_ctx->current = 0;
+  lemon_ctx->currentend = 0;
   return old;
 }
 
@@ -1478,9 +1847,9 @@ struct config *Configlist_return(void){
 ** reset the list */
 struct config *Configlist_basis(void){
   struct config *old;
-  old = basis;
-  basis = 0;
-  basisend = 0;
+  old = lemon_ctx->basis;
+  lemon_ctx->basis = 0;
+  lemon_ctx->basisend = 0;
   return old;
 }
 
@@ -1502,13 +1871,31 @@ void Configlist_eat(struct config *cfp)
 ** Code for printing error message.
 */
 
+/*
+** Messages go to standard error unless the current context is collecting
+** them for a library caller.
+*/
+static void lemon_verror(const char *format, va_list ap){
+  if( lemon_ctx && lemon_ctx->pErr ){
+    lemon_bvprintf(lemon_ctx->pErr, format, ap);
+  }else{
+    vfprintf(stderr, format, ap);
+  }
+}
+void lemon_error(const char *format, ...){
+  va_list ap;
+  va_start(ap, format);
+  lemon_verror(format, ap);
+  va_end(ap);
+}
+
 void ErrorMsg(const char *filename, int lineno, const char *format, ...){
   va_list ap;
-  fprintf(stderr, "%s:%d: ", filename, lineno);
+  lemon_error("%s:%d: ", filename, lineno);
   va_start(ap, format);
-  vfprintf(stderr,format,ap);
+  lemon_verror(format, ap);
   va_end(ap);
-  fprintf(stderr, "\n");
+  lemon_error("\n");
 }
 /**************** From the file "main.c" ************************************/
 /*
@@ -1519,55 +1906,40 @@ void ErrorMsg(const char *filename, int lineno, const char *format, ...){
 ** is used mostly by the "MemoryCheck" macro in struct.h
 */
 void memory_error(void){
-  fprintf(stderr,"Out of memory.  Aborting...\n");
-  exit(1);
+  lemon_error("Out of memory.  Aborting...\n");
+  lemon_exit(1);
 }
 
-static int nDefine = 0;      /* Number of -D options on the command line */
-static char **azDefine = 0;  /* Name of the -D macros */
+
+#ifndef LEMON_LIBRARY
+/* Settings gathered from the command line */
+static struct lemon_options cmdopt;
 
 /* This routine is called with the argument to each -D command-line option.
 ** Add the macro defined to the azDefine array.
 */
 static void handle_D_option(char *z){
-  char **paz;
-  nDefine++;
-  azDefine = (char **) realloc(azDefine, sizeof(azDefine[0])*nDefine);
-  if( azDefine==0 ){
-    fprintf(stderr,"out of memory\n");
-    exit(1);
-  }
-  paz = &azDefine[nDefine-1];
-  *paz = (char *) malloc( lemonStrlen(z)+1 );
-  if( *paz==0 ){
+  const char **az;
+  az = (const char **) realloc((void*)cmdopt.azDefine,
+                               sizeof(cmdopt.azDefine[0])*(cmdopt.nDefine+1));
+  if( az==0 ){
     fprintf(stderr,"out of memory\n");
     exit(1);
   }
-  lemon_strcpy(*paz, z);
-  for(z=*paz; *z && *z!='='; z++){}
-  *z = 0;
+  cmdopt.azDefine = az;
+  cmdopt.azDefine[cmdopt.nDefine++] = z;
 }
 
 /* Rember the name of the output directory 
 */
-static char *outputDir = NULL;
 static void handle_d_option(char *z){
-  outputDir = (char *) malloc( lemonStrlen(z)+1 );
-  if( outputDir==0 ){
-    fprintf(stderr,"out of memory\n");
-    exit(1);
-  }
-  lemon_strcpy(outputDir, z);
+  cmdopt.zOutputDir = z;
 }
 
-static char *user_templatename = NULL;
 static void handle_T_option(char *z){
-  user_templatename = (char *) malloc( lemonStrlen(z)+1 );
-  if( user_templatename==0 ){
-    memory_error();
-  }
-  lemon_strcpy(user_templatename, z);
+  cmdopt.zTemplateName = z;
 }
+#endif /* LEMON_LIBRARY */
 
 /* Merge together to lists of rules ordered by rule.iRule */
 static struct rule *Rule_merge(struct rule *pA, struct rule *pB){
@@ -1617,9 +1989,15 @@ static struct rule *Rule_sort(struct rule *rp){
   return rp;
 }
 
-/* forward reference */
+/* forward references */
 static const char *minimum_size_type(int lwr, int upr, int *pnByte);
+PRIVATE char *file_makename(struct lemon *, const char *);
+PRIVATE FILE *file_open(struct lemon *, const char *, const char *);
+PRIVATE char *file_read(const char *, int *);
+PRIVATE const char *tplt_name(struct lemon *, char *);
+PRIVATE char *tplt_open(struct lemon *);
 
+#ifndef LEMON_LIBRARY
 /* Print a single line of the "Parser Stats" output
 */
 static void stats_line(const char *zLabel, int iValue){
@@ -1629,224 +2007,857 @@ static void stats_line(const char *zLabel, int iValue){
          iValue);
 }
 
-/* The main program.  Parse the command line and do it... */
-int main(int argc, char **argv)
-{
-  static int version = 0;
-  static int rpflag = 0;
-  static int basisflag = 0;
-  static int compress = 0;
-  static int quiet = 0;
-  static int statistics = 0;
-  static int mhflag = 0;
-  static int nolinenosflag = 0;
-  static int noResort = 0;
-  static int nconflict = 0;
+/* Print the cost of one phase in the "Parser Stats" output
+*/
+static void phase_line(const char *zLabel, double wall, double cpu, long nByte){
+  int nLabel = lemonStrlen(zLabel);
+  printf("  %s%.*s %9.3f %9.3f %9ld\n", zLabel,
+         35-nLabel, "................................",
+         wall*1000.0, cpu*1000.0, (nByte+1023)/1024);
+}
 
-  static struct s_options options[] = {
-    {OPT_FLAG, "b", (char*)&basisflag, "Print only the basis in report."},
-    {OPT_FLAG, "c", (char*)&compress, "Don't compress the action table."},
-    {OPT_FSTR, "d", (char*)&handle_d_option, "Output directory.  Default '.'"},
-    {OPT_FSTR, "D", (char*)handle_D_option, "Define an %ifdef macro."},
-    {OPT_FSTR, "f", 0, "Ignored.  (Placeholder for -f compiler options.)"},
-    {OPT_FLAG, "g", (char*)&rpflag, "Print grammar without actions."},
-    {OPT_FSTR, "I", 0, "Ignored.  (Placeholder for '-I' compiler options.)"},
-    {OPT_FLAG, "m", (char*)&mhflag, "Output a makeheaders compatible file."},
-    {OPT_FLAG, "l", (char*)&nolinenosflag, "Do not print #line statements."},
-    {OPT_FSTR, "O", 0, "Ignored.  (Placeholder for '-O' compiler options.)"},
-    {OPT_FLAG, "p", (char*)&showPrecedenceConflict,
-                    "Show conflicts resolved by precedence rules"},
-    {OPT_FLAG, "q", (char*)&quiet, "(Quiet) Don't print the report file."},
-    {OPT_FLAG, "r", (char*)&noResort, "Do not sort or renumber states"},
-    {OPT_FLAG, "s", (char*)&statistics,
-                                   "Print parser stats to standard output."},
-    {OPT_FLAG, "x", (char*)&version, "Print the version number."},
-    {OPT_FSTR, "T", (char*)handle_T_option, "Specify a template file."},
-    {OPT_FSTR, "W", 0, "Ignored.  (Placeholder for '-W' compiler options.)"},
-    {OPT_INT,  "nconflicts", (char *)&nconflict, "Expect N shift/reduce conflicts."},
-    {OPT_FLAG,0,0,0}
-  };
+/* Write z[] to stdout as a JSON string */
+static void json_string(const char *z){
+  putchar('"');
+  for(; *z; z++){
+    if( *z=='"' || *z=='\\' ){
+      printf("\\%c", *z);
+    }else if( (unsigned char)*z<0x20 ){
+      printf("\\u%04x", (unsigned char)*z);
+    }else{
+      putchar(*z);
+    }
+  }
+  putchar('"');
+}
+
+/* Print the statistics for one grammar as a JSON object */
+static void stats_json(const char *zFilename, const struct lemon_output *p){
+  int i;
+  printf("  {\"grammar\": ");
+  json_string(zFilename);
+  printf(",\n   \"terminals\": %d, \"nonterminals\": %d, \"symbols\": %d,"
+         " \"rules\": %d, \"states\": %d, \"conflicts\": %d,\n",
+         p->nterminal, p->nsymbol - p->nterminal, p->nsymbol,
+         p->nrule, p->nstate, p->nconflict);
+  printf("   \"actionEntries\": %d, \"lookaheadEntries\": %d,"
+         " \"tableBytes\": %d,\n",
+         p->nactiontab, p->nlookaheadtab, p->tablesize);
+  if( p->nfolded>=0 ){
+    printf("   \"foldedActions\": %d,\n", p->nfolded);
+  }
+  if( p->nclass>=0 ){
+    printf("   \"tokenClasses\": %d,\n", p->nclass);
+  }
+  if( p->nmerged>=0 ){
+    printf("   \"mergedStates\": %d,\n", p->nmerged);
+  }
+  if( p->nunit>=0 ){
+    printf("   \"unitActions\": %d,\n", p->nunit);
+  }
+  if( p->nstackbound>0 ){
+    printf("   \"stackBound\": %d,\n", p->nstackbound);
+  }
+  if( p->nheadroom>0 ){
+    printf("   \"stackHeadroom\": %d,\n", p->nheadroom);
+  }
+  printf("   \"wallTime\": %.6f, \"cpuTime\": %.6f, \"peakBytes\": %ld,\n",
+         p->wallTime, p->cpuTime, p->nPeakBytes);
+  printf("   \"phases\": [");
+  for(i=0; i<p->nPhase; i++){
+    const struct lemon_phase *pPhase = &p->aPhase[i];
+    printf("%s\n    {\"name\": \"%s\", \"wallTime\": %.6f, \"cpuTime\": %.6f,"
+           " \"peakBytes\": %ld}", i ? "," : "", pPhase->zName,
+           pPhase->wallTime, pPhase->cpuTime, pPhase->nPeakBytes);
+  }
+  printf("]}");
+}
+#endif /* LEMON_LIBRARY */
+
+/*
+** Write n bytes of z[] into the output file with the given suffix.  If
+** onlyIfChanged is true and the file already holds exactly that text,
+** leave it alone so that its modification time does not change.
+*/
+PRIVATE void file_write(
+  struct lemon *lemp,
+  const char *suffix,
+  const char *z,
+  int n,
+  int onlyIfChanged
+){
+  FILE *fp;
+  if( onlyIfChanged ){
+    int nOld;
+    char *zOld;
+    if( lemp->outname ) lemon_free(lemp->outname);
+    lemp->outname = file_makename(lemp, suffix);
+    zOld = file_read(lemp->outname, &nOld);
+    if( zOld && nOld==n && memcmp(zOld, z, n)==0 ){
+      lemon_free(zOld);
+      return;
+    }
+    lemon_free(zOld);
+  }
+  fp = file_open(lemp, suffix, "wb");
+  if( fp==0 ) return;
+  if( n>0 && fwrite(z, 1, n, fp)!=(size_t)n ){
+    lemon_error("Can't write file \"%s\".\n", lemp->outname);
+    lemp->errorcnt++;
+  }
+  fclose(fp);
+}
+
+/*
+** Start timing a phase of the generator.  Its cost is recorded in
+** pOut->aPhase[] by the matching phase_end().
+*/
+static void phase_begin(struct lemon_output *pOut, const char *zName){
+  struct lemon_context *ctx = lemon_ctx;
+  if( pOut->nPhase>=LEMON_MAX_PHASE ) return;
+  pOut->aPhase[pOut->nPhase].zName = zName;
+  ctx->nPhasePeak = ctx->nMem;
+  lemon_clock(&ctx->phaseWall, &ctx->phaseCpu);
+}
+static void phase_end(struct lemon_output *pOut){
+  struct lemon_context *ctx = lemon_ctx;
+  struct lemon_phase *p;
+  double wall, cpu;
+  if( pOut->nPhase>=LEMON_MAX_PHASE ) return;
+  lemon_clock(&wall, &cpu);
+  p = &pOut->aPhase[pOut->nPhase++];
+  p->wallTime = wall - ctx->phaseWall;
+  p->cpuTime = cpu - ctx->phaseCpu;
+  p->nPeakBytes = (long)ctx->nPhasePeak;
+}
+
+/*
+** Run every phase of the generator for one grammar, using the context
+** that is already installed in lemon_ctx.  The generated text is left
+** in the context's buffers.  Return the exit code the command-line
+** program would use.
+*/
+static int lemon_run(
+  struct lemon *lemp,
+  const struct lemon_options *pOpt,
+  struct lemon_output *pOut     /* Phase timings are recorded here */
+){
+  struct lemon_context *ctx = lemon_ctx;
   int i;
   int exitcode;
-  struct lemon lem;
   struct rule *rp;
-
   struct symbol *dollar;
+  char *zTemplate = 0;
 
+  /* Initialize the machine */
+  Strsafe_init();
+  Symbol_init();
+  State_init();
 
+  /* Copy the settings into the context.  Each %ifdef macro name ends
+  ** at the first "=", if there is one. */
+  ctx->showPrecedenceConflict = pOpt->showPrecedenceConflict;
+  ctx->outputDir = pOpt->zOutputDir;
+  ctx->user_templatename = pOpt->zTemplateName;
+  ctx->azDefine = (char **) lemon_calloc(pOpt->nDefine+1, sizeof(char*));
+  if( ctx->azDefine==0 ) memory_error();
+  for(i=0; i<pOpt->nDefine; i++){
+    char *z = (char*)Strsafe(pOpt->azDefine[i]);
+    int n;
+    for(n=0; z[n] && z[n]!='='; n++){}
+    if( z[n] ){
+      char *zCopy = (char *) lemon_malloc( n+1 );
+      if( zCopy==0 ) memory_error();
+      memcpy(zCopy, z, n);
+      zCopy[n] = 0;
+      z = zCopy;
+    }
+    ctx->azDefine[ctx->nDefine++] = z;
+  }
 #ifdef LEMONPLUSPLUS
   /* %define lemonplusplus */
-  handle_D_option("__lemonplusplus");
+  ctx->azDefine[ctx->nDefine++] = "__lemonplusplus";
 #endif
 
-  OptInit(argv,options,stderr);
-  if( version ){
-    #ifdef LEMONPLUSPLUS
-     printf("Lemon-- version 1.0\n");
-   #else
-     printf("Lemon version 1.0\n");
-   #endif
-     exit(0);
-  }
-  if( OptNArgs()!=1 ){
-    fprintf(stderr,"Exactly one filename argument is required.\n");
-    exit(1);
-  }
-  memset(&lem, 0, sizeof(lem));
-  lem.errorcnt = 0;
-
-  /* Initialize the machine */
-  Strsafe_init();
-  Symbol_init();
-  State_init();
-  lem.argv0 = argv[0];
-  lem.filename = OptArg(0);
-  lem.basisflag = basisflag;
-  lem.nolinenosflag = nolinenosflag;
+  lemp->argv0 = (char*)pOpt->zArgv0;
+  lemp->filename = (char*)pOpt->zFilename;
+  lemp->zInput = pOpt->zGrammar;
+  lemp->nInput = pOpt->zGrammar ? pOpt->nGrammar : 0;
+  lemp->basisflag = pOpt->basisflag;
+  lemp->nolinenosflag = pOpt->nolinenosflag;
+  lemp->reduceTable = pOpt->reduceTable;
+  lemp->nfolded = -1;
+  lemp->tokenClasses = pOpt->tokenClasses;
+  lemp->nclass = -1;
+  lemp->nmerged = -1;
+  lemp->unitRules = pOpt->unitRules;
+  lemp->nunit = -1;
   dollar = Symbol_new("$");
 #ifdef LEMONPLUSPLUS
   dollar->datatype = "void";
 #endif
 
   /* Parse the input file */
-  Parse(&lem);
-  if( lem.errorcnt ) exit(lem.errorcnt);
-  if( lem.nrule==0 ){
-    fprintf(stderr,"Empty grammar.\n");
-    exit(1);
+  phase_begin(pOut, "Parse");
+  Parse(lemp);
+  phase_end(pOut);
+  if( lemp->nsync && lemp->scanner==0 ){
+    ErrorMsg(lemp->filename, 0, "%%sync needs a %%token_pattern scanner");
+    lemp->errorcnt++;
+  }
+  if( lemp->errorcnt ) return lemp->errorcnt;
+
+  /* A %recognizer only accepts or rejects its input, so the code of the
+  ** rules and the labels that feed it are dropped. */
+  if( lemp->recognizer ){
+    for(rp=lemp->rule; rp; rp=rp->next){
+      rp->code = 0;
+      rp->lhsalias = 0;
+      for(i=0; i<rp->nrhs; i++) rp->rhsalias[i] = 0;
+    }
+  }
+
+  /* Build the DFA for %token_pattern */
+  if( lemp->scanner ){
+    phase_begin(pOut, "ScanBuild");
+    lemp->errorcnt += ScanBuild(lemp);
+    phase_end(pOut);
+    if( lemp->errorcnt ) return lemp->errorcnt;
   }
-  lem.errsym = Symbol_find("error");
+  if( lemp->nrule==0 ){
+    lemon_error("Empty grammar.\n");
+    return 1;
+  }
+  lemp->errsym = Symbol_find("error");
 #ifdef LEMONPLUSPLUS
-  if (lem.errsym) lem.errsym->datatype = "void";
+  if (lemp->errsym) lemp->errsym->datatype = "void";
 #endif
 
 
   /* Count and index the symbols of the grammar */
   Symbol_new("{default}");
-  lem.nsymbol = Symbol_count();
-  lem.symbols = Symbol_arrayof();
-  for(i=0; i<lem.nsymbol; i++) lem.symbols[i]->index = i;
-  qsort(lem.symbols,lem.nsymbol,sizeof(struct symbol*), Symbolcmpp);
-  for(i=0; i<lem.nsymbol; i++) lem.symbols[i]->index = i;
-  while( lem.symbols[i-1]->type==MULTITERMINAL ){ i--; }
-  assert( strcmp(lem.symbols[i-1]->name,"{default}")==0 );
-  lem.nsymbol = i - 1;
-  for(i=1; ISUPPER(lem.symbols[i]->name[0]); i++);
-  lem.nterminal = i;
+  lemp->nsymbol = Symbol_count();
+  lemp->symbols = Symbol_arrayof();
+  for(i=0; i<lemp->nsymbol; i++) lemp->symbols[i]->index = i;
+  qsort(lemp->symbols,lemp->nsymbol,sizeof(struct symbol*), Symbolcmpp);
+  for(i=0; i<lemp->nsymbol; i++) lemp->symbols[i]->index = i;
+  while( lemp->symbols[i-1]->type==MULTITERMINAL ){ i--; }
+  assert( strcmp(lemp->symbols[i-1]->name,"{default}")==0 );
+  lemp->nsymbol = i - 1;
+  for(i=1; ISUPPER(lemp->symbols[i]->name[0]); i++);
+  lemp->nterminal = i;
 
   /* Assign sequential rule numbers.  Start with 0.  Put rules that have no
   ** reduce action C-code associated with them last, so that the switch()
   ** statement that selects reduction actions will have a smaller jump table.
   */
-  for(i=0, rp=lem.rule; rp; rp=rp->next){
+  for(i=0, rp=lemp->rule; rp; rp=rp->next){
     rp->iRule = rp->code ? i++ : -1;
   }
-  for(rp=lem.rule; rp; rp=rp->next){
+  for(rp=lemp->rule; rp; rp=rp->next){
     if( rp->iRule<0 ) rp->iRule = i++;
   }
-  lem.startRule = lem.rule;
-  lem.rule = Rule_sort(lem.rule);
+  lemp->startRule = lemp->rule;
+  lemp->rule = Rule_sort(lemp->rule);
 
   /* Generate a reprint of the grammar, if requested on the command line */
-  if( rpflag ){
-    Reprint(&lem);
+  if( pOpt->rpflag ){
+    Reprint(lemp, &ctx->report);
   }else{
     /* Initialize the size for all follow and first sets */
-    SetSize(lem.nterminal+1);
+    SetSize(lemp->nterminal+1);
 
     /* Find the precedence for every production rule (that has one) */
-    FindRulePrecedences(&lem);
+    FindRulePrecedences(lemp);
 
     /* Compute the lambda-nonterminals and the first-sets for every
     ** nonterminal */
-    FindFirstSets(&lem);
+    phase_begin(pOut, "FindFirstSets");
+    FindFirstSets(lemp);
+    phase_end(pOut);
 
     /* Compute all LR(0) states.  Also record follow-set propagation
     ** links so that the follow-set can be computed later */
-    lem.nstate = 0;
-    FindStates(&lem);
-    lem.sorted = State_arrayof();
+    lemp->nstate = 0;
+    phase_begin(pOut, "FindStates");
+    FindStates(lemp);
+    lemp->sorted = State_arrayof();
+    phase_end(pOut);
 
     /* Tie up loose ends on the propagation links */
-    FindLinks(&lem);
+    phase_begin(pOut, "FindLinks");
+    FindLinks(lemp);
+    phase_end(pOut);
 
     /* Compute the follow set of every reducible configuration */
-    FindFollowSets(&lem);
+    phase_begin(pOut, "FindFollowSets");
+    FindFollowSets(lemp);
+    phase_end(pOut);
 
     /* Compute the action tables */
-    FindActions(&lem);
+    phase_begin(pOut, "FindActions");
+    FindActions(lemp);
+    phase_end(pOut);
 
     /* Compress the action tables */
-    if( compress==0 ) CompressTables(&lem);
+    if( pOpt->noCompress==0 ){
+      phase_begin(pOut, "CompressTables");
+      CompressTables(lemp);
+      phase_end(pOut);
+    }
+
+    /* Resolve %fallback and %wildcard into the action tables */
+    if( pOpt->foldFallback && (lemp->has_fallback || lemp->wildcard) ){
+      phase_begin(pOut, "FoldFallback");
+      lemp->nfolded = FoldFallback(lemp);
+      phase_end(pOut);
+    }
+
+    /* Merge states that have the same actions */
+    if( pOpt->mergeStates ){
+      phase_begin(pOut, "MinimizeStates");
+      lemp->nmerged = MinimizeStates(lemp);
+      phase_end(pOut);
+    }
+
+    /* Read the counts of a profiled run */
+    if( pOpt->zProfile ){
+      phase_begin(pOut, "ReadProfile");
+      ReadProfile(lemp, pOpt->zProfile);
+      phase_end(pOut);
+    }
 
     /* Reorder and renumber the states so that states with fewer choices
     ** occur at the end.  This is an optimization that helps make the
     ** generated parser tables smaller. */
-    /* if( noResort==0 ) */ ResortStates(&lem, noResort);
+    phase_begin(pOut, "ResortStates");
+    /* if( noResort==0 ) */ ResortStates(lemp, pOpt->noResort);
+    phase_end(pOut);
+
+    /* Find how deep the parser stack can get */
+    phase_begin(pOut, "StackBound");
+    StackBound(lemp);
+    phase_end(pOut);
 
     /* Generate a report of the parser generated.  (the "y.output" file) */
-    if( !quiet ) ReportOutput(&lem);
+    if( !pOpt->quiet ){
+      ReportOutput(lemp, &ctx->report);
+      if( pOpt->writeFiles ){
+        file_write(lemp, ".out", ctx->report.z, ctx->report.n, 0);
+      }
+    }
 
     /* Generate the source code for the parser */
-    ReportTable(&lem, mhflag);
+    if( pOpt->zTemplate ){
+      phase_begin(pOut, "ReportTable");
+      ReportTable(lemp, pOpt->mhflag, pOpt->zTemplate, &ctx->source);
+      phase_end(pOut);
+    }else if( (zTemplate = tplt_open(lemp))!=0 ){
+      phase_begin(pOut, "ReportTable");
+      ReportTable(lemp, pOpt->mhflag, zTemplate, &ctx->source);
+      phase_end(pOut);
+      lemon_free(zTemplate);
+    }
+    if( pOpt->writeFiles && (pOpt->zTemplate || zTemplate) ){
+      file_write(lemp, FILE_EXTENSION, ctx->source.z, ctx->source.n, 0);
+    }
 
     /* Produce a header file for use by the scanner.  (This step is
     ** omitted if the "-m" option is used because makeheaders will
     ** generate the file for us.) */
-    if( !mhflag ) ReportHeader(&lem);
-  }
-  if( statistics ){
-    printf("Parser statistics:\n");
-    stats_line("terminal symbols", lem.nterminal);
-    stats_line("non-terminal symbols", lem.nsymbol - lem.nterminal);
-    stats_line("total symbols", lem.nsymbol);
-    stats_line("rules", lem.nrule);
-    stats_line("states", lem.nxstate);
-    stats_line("conflicts", lem.nconflict);
-    stats_line("action table entries", lem.nactiontab);
-    stats_line("lookahead table entries", lem.nlookaheadtab);
-    stats_line("total table size (bytes)", lem.tablesize);
-  }
-  if( lem.nconflict > 0 ){
-    fprintf(stderr,"%d parsing conflicts.\n",lem.nconflict);
+    if( !pOpt->mhflag ){
+      ReportHeader(lemp, &ctx->header);
+      if( pOpt->writeFiles ){
+        file_write(lemp, ".h", ctx->header.z, ctx->header.n, 1);
+      }
+    }
   }
 
   /* return 0 on success, 1 on failure. */
   exitcode = 0;
-  if (lem.errorcnt > 0) exitcode = 1;
-  if (lem.nconflict && lem.nconflict != nconflict) exitcode = 1;
-  /* exitcode = ((lem.errorcnt > 0) || (lem.nconflict > 0)) ? 1 : 0; */
-  exit(exitcode);
-  return (exitcode);
+  if (lemp->errorcnt > 0) exitcode = 1;
+  if (lemp->nconflict && lemp->nconflict != pOpt->nconflict) exitcode = 1;
+  /* exitcode = ((lemp->errorcnt > 0) || (lemp->nconflict > 0)) ? 1 : 0; */
+  return exitcode;
+}
+
+/* The arguments of lemon_run() under lemon_protect() */
+struct generate_args {
+  struct lemon *lemp;
+  const struct lemon_options *pOpt;
+  struct lemon_output *pOut;
+  int rc;                      /* What lemon_run() returned */
+};
+
+static void generate_run(void *pArg){
+  struct generate_args *p = (struct generate_args*)pArg;
+  p->rc = lemon_run(p->lemp, p->pOpt, p->pOut);
 }
-/******************** From the file "msort.c" *******************************/
+
 /*
-** A generic merge-sort program.
-**
-** USAGE:
-** Let "ptr" be a pointer to some structure which is at the head of
-** a null-terminated list.  Then to sort the list call:
-**
-**     ptr = msort(ptr,&(ptr->next),cmpfnc);
-**
-** In the above, "cmpfnc" is a pointer to a function which compares
-** two instances of the structure and returns an integer, as in
-** strcmp.  The second argument is a pointer to the pointer to the
-** second element of the linked list.  This address is used to compute
-** the offset to the "next" field within the structure.  The offset to
-** the "next" field must be constant for all structures in the list.
-**
-** The function returns a new pointer which is the head of the list
-** after sorting.
+** Generate a parser.  This is the entry point for programs that link
+** against lemon as a library.  The grammar and the template may be
+** supplied as text, and the generated source, header and report are
+** returned in *pOut.  Nothing is written to disk unless
+** pOpt->writeFiles is set.
 **
-** ALGORITHM:
-** Merge-sort.
+** Every failure, including running out of memory, comes back as a
+** non-zero return code rather than terminating the program.  All memory
+** used during generation is released before returning; the buffers in
+** *pOut belong to the caller, who should pass them to
+** lemon_output_free().  Separate threads may call this concurrently.
 */
+int lemon_generate(const struct lemon_options *pOpt, struct lemon_output *pOut){
+  struct lemon_context ctx;
+  struct lemon_context *pSaved = lemon_ctx;
+  struct lemon lem;
+  struct lemon_buf err;
+  struct generate_args args;
+  int rc;
+  double wall, cpu;
+
+  memset(&ctx, 0, sizeof(ctx));
+  memset(&lem, 0, sizeof(lem));
+  memset(&err, 0, sizeof(err));
+  memset(pOut, 0, sizeof(*pOut));
+  pOut->nfolded = -1;
+  pOut->nclass = -1;
+  pOut->nmerged = -1;
+  pOut->nunit = -1;
+  if( pOpt->captureErrors ) ctx.pErr = &err;
+  lemon_ctx = &ctx;
+  lemon_clock(&wall, &cpu);
+  args.lemp = &lem;
+  args.pOpt = pOpt;
+  args.pOut = pOut;
+  args.rc = 0;
+  rc = lemon_protect(generate_run, &args);
+  if( rc==0 ){
+    rc = args.rc;
+    pOut->zSource = ctx.source.z;   pOut->nSource = ctx.source.n;
+    pOut->zHeader = ctx.header.z;   pOut->nHeader = ctx.header.n;
+    pOut->zReport = ctx.report.z;   pOut->nReport = ctx.report.n;
+    pOut->nterminal = lem.nterminal;
+    pOut->nsymbol = lem.nsymbol;
+    pOut->nrule = lem.nrule;
+    pOut->nstate = lem.nxstate;
+    pOut->nconflict = lem.nconflict;
+    pOut->nactiontab = lem.nactiontab;
+    pOut->nlookaheadtab = lem.nlookaheadtab;
+    pOut->tablesize = lem.tablesize;
+    pOut->nfolded = lem.nfolded;
+    pOut->nclass = lem.nclass;
+    pOut->nmerged = lem.nmerged;
+    pOut->nunit = lem.nunit;
+    pOut->nstackbound = lem.stackBound;
+    pOut->nheadroom = lem.stackHeadroom;
+  }else{
+    lemon_bfree(&ctx.source);
+    lemon_bfree(&ctx.header);
+    lemon_bfree(&ctx.report);
+  }
+  pOut->zErrors = err.z;
+  pOut->nErrors = err.n;
+  pOut->nPeakBytes = (long)ctx.nMemPeak;
+  lemon_free_all();
+  {
+    double wallEnd, cpuEnd;
+    lemon_clock(&wallEnd, &cpuEnd);
+    pOut->wallTime = wallEnd - wall;
+    pOut->cpuTime = cpuEnd - cpu;
+  }
+  lemon_ctx = pSaved;
+  return rc;
+}
+
+/* Release the buffers returned by lemon_generate() */
+void lemon_output_free(struct lemon_output *pOut){
+  free(pOut->zSource);
+  free(pOut->zHeader);
+  free(pOut->zReport);
+  free(pOut->zErrors);
+  memset(pOut, 0, sizeof(*pOut));
+}
+
+#ifndef LEMON_LIBRARY
+/* The state of template_load() under lemon_protect() */
+struct template_args {
+  struct lemon *lemp;
+  char **pzName;               /* OUT: Name of the template file */
+  char *zText;                 /* OUT: Its text */
+};
+
+static void template_find(void *pArg){
+  struct template_args *p = (struct template_args*)pArg;
+  char buf[1000];
+  const char *zName;
+  int nText;
+
+  zName = tplt_name(p->lemp, buf);
+  if( zName ){
+    char *z = file_read(zName, &nText);
+    if( z ){
+      p->zText = (char*)malloc( nText+1 );
+      *p->pzName = (char*)malloc( lemonStrlen(zName)+1 );
+      if( p->zText==0 || *p->pzName==0 ){
+        free(p->zText);
+        free(*p->pzName);
+        p->zText = *p->pzName = 0;
+      }else{
+        memcpy(p->zText, z, nText+1);
+        lemon_strcpy(*p->pzName, zName);
+      }
+    }
+  }
+}
 
 /*
-** Return a pointer to the next structure in the linked list.
+** Find the driver template that lemon_generate() would use for the
+** grammar in pOpt and read it.  The text is returned in memory from
+** malloc(), and the name of the file it came from in *pzName.  Return
+** NULL if the template cannot be found or read; lemon_generate() will
+** then report the problem itself.
 */
-#define NEXT(A) (*(char**)(((char*)A)+offset))
+static char *template_load(const struct lemon_options *pOpt, char **pzName){
+  struct lemon_context ctx;
+  struct lemon_context *pSaved = lemon_ctx;
+  struct lemon lem;
+  struct lemon_buf err;
+  struct template_args args;
+
+  *pzName = 0;
+  memset(&ctx, 0, sizeof(ctx));
+  memset(&lem, 0, sizeof(lem));
+  memset(&err, 0, sizeof(err));
+  ctx.pErr = &err;
+  ctx.user_templatename = pOpt->zTemplateName;
+  lem.filename = (char*)pOpt->zFilename;
+  lem.argv0 = (char*)pOpt->zArgv0;
+  lemon_ctx = &ctx;
+  args.lemp = &lem;
+  args.pzName = pzName;
+  args.zText = 0;
+  lemon_protect(template_find, &args);
+  lemon_bfree(&err);
+  lemon_free_all();
+  lemon_ctx = pSaved;
+  return args.zText;
+}
+
+/* One grammar of a batch */
+struct batch_job {
+  struct lemon_options opt;    /* Settings for this grammar */
+  struct lemon_output out;     /* What lemon_generate() returned */
+  int rc;                      /* Its return code */
+};
+
+/* The queue of grammars shared by the worker threads */
+struct batch {
+  struct batch_job *aJob;      /* Every grammar, in command-line order */
+  int nJob;                    /* Number of entries in aJob[] */
+  int iNext;                   /* Next job to hand out */
+#ifdef LEMON_THREADS
+  pthread_mutex_t mutex;       /* Protects iNext */
+#endif
+};
+
+/* Take jobs off the queue and run them until the queue is empty */
+static void *batch_worker(void *pArg){
+  struct batch *p = (struct batch*)pArg;
+  for(;;){
+    int i;
+#ifdef LEMON_THREADS
+    pthread_mutex_lock(&p->mutex);
+#endif
+    i = p->iNext++;
+#ifdef LEMON_THREADS
+    pthread_mutex_unlock(&p->mutex);
+#endif
+    if( i>=p->nJob ) break;
+    p->aJob[i].rc = lemon_generate(&p->aJob[i].opt, &p->aJob[i].out);
+  }
+  return 0;
+}
+
+/* Run every job in the batch, using up to nThread threads */
+static void batch_run(struct batch *p, int nThread){
+#ifdef LEMON_THREADS
+  pthread_t *aThread;
+  int i, nStarted = 0;
+  if( nThread>p->nJob ) nThread = p->nJob;
+  if( nThread>1 ){
+    aThread = (pthread_t*)malloc( sizeof(aThread[0])*(nThread-1) );
+    pthread_mutex_init(&p->mutex, 0);
+    for(i=0; aThread && i<nThread-1; i++){
+      if( pthread_create(&aThread[i], 0, batch_worker, p)!=0 ) break;
+      nStarted++;
+    }
+    batch_worker(p);
+    for(i=0; i<nStarted; i++) pthread_join(aThread[i], 0);
+    pthread_mutex_destroy(&p->mutex);
+    free(aThread);
+    return;
+  }
+#endif
+  (void)nThread;
+  batch_worker(p);
+}
+
+/* Return the number of processors available, or 1 if unknown */
+static int processor_count(void){
+#if defined(LEMON_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if( n>1 ) return (int)n;
+#endif
+  return 1;
+}
+
+/* Append zName to the list of grammars named on the command line */
+static void add_grammar(const char ***pazName, int *pnName, const char *zName){
+  const char **az;
+  az = (const char **) realloc((void*)*pazName, sizeof(az[0])*(*pnName+1));
+  if( az==0 ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  az[(*pnName)++] = zName;
+  *pazName = az;
+}
+
+/* Add the grammars listed in the manifest file zManifest, one per line.
+** Blank lines and lines that begin with "#" are ignored. */
+static void read_manifest(const char *zManifest, const char ***pazName, int *pnName){
+  FILE *in;
+  char zLine[1000];
+  in = fopen(zManifest,"rb");
+  if( in==0 ){
+    fprintf(stderr,"Can't open the manifest \"%s\".\n",zManifest);
+    exit(1);
+  }
+  while( fgets(zLine, sizeof(zLine), in) ){
+    char *z = zLine;
+    char *zCopy;
+    int n;
+    while( ISSPACE(*z) ) z++;
+    n = lemonStrlen(z);
+    while( n>0 && ISSPACE(z[n-1]) ) n--;
+    if( n==0 || z[0]=='#' ) continue;
+    zCopy = (char*)malloc( n+1 );
+    if( zCopy==0 ){
+      fprintf(stderr,"out of memory\n");
+      exit(1);
+    }
+    memcpy(zCopy, z, n);
+    zCopy[n] = 0;
+    add_grammar(pazName, pnName, zCopy);
+  }
+  fclose(in);
+}
+
+/* The main program.  Parse the command line and do it... */
+int main(int argc, char **argv)
+{
+  static int version = 0;
+  static int statistics = 0;
+  static int jsonStats = 0;
+  static int jobs = 0;
+  static char *manifest = 0;
+
+  static struct s_options options[] = {
+    {OPT_FLAG, "b", (char*)&cmdopt.basisflag, "Print only the basis in report."},
+    {OPT_FLAG, "c", (char*)&cmdopt.noCompress, "Don't compress the action table."},
+    {OPT_FSTR, "d", (char*)&handle_d_option, "Output directory.  Default '.'"},
+    {OPT_FSTR, "D", (char*)handle_D_option, "Define an %ifdef macro."},
+    {OPT_FLAG, "e", (char*)&cmdopt.tokenClasses,
+                "Merge terminals with the same actions into classes."},
+    {OPT_FSTR, "f", 0, "Ignored.  (Placeholder for -f compiler options.)"},
+    {OPT_FLAG, "F", (char*)&cmdopt.foldFallback,
+                "Resolve %fallback and %wildcard in the action table."},
+    {OPT_FLAG, "g", (char*)&cmdopt.rpflag, "Print grammar without actions."},
+    {OPT_FSTR, "I", 0, "Ignored.  (Placeholder for '-I' compiler options.)"},
+    {OPT_FLAG, "m", (char*)&cmdopt.mhflag, "Output a makeheaders compatible file."},
+    {OPT_FLAG, "M", (char*)&cmdopt.mergeStates,
+                "Merge states that have the same actions."},
+    {OPT_FLAG, "l", (char*)&cmdopt.nolinenosflag, "Do not print #line statements."},
+    {OPT_FSTR, "O", 0, "Ignored.  (Placeholder for '-O' compiler options.)"},
+    {OPT_FLAG, "p", (char*)&cmdopt.showPrecedenceConflict,
+                    "Show conflicts resolved by precedence rules"},
+    {OPT_FLAG, "q", (char*)&cmdopt.quiet, "(Quiet) Don't print the report file."},
+    {OPT_FLAG, "r", (char*)&cmdopt.noResort, "Do not sort or renumber states"},
+    {OPT_FLAG, "R", (char*)&cmdopt.reduceTable,
+                    "Emit each reduce action as a function, not a switch case."},
+    {OPT_FLAG, "s", (char*)&statistics,
+                                   "Print parser stats to standard output."},
+    {OPT_FLAG, "S", (char*)&jsonStats,
+                           "Print parser stats to standard output as JSON."},
+    {OPT_FLAG, "u", (char*)&cmdopt.unitRules,
+                "Skip code-less unit rules on terminals too."},
+    {OPT_FLAG, "x", (char*)&version, "Print the version number."},
+    {OPT_FSTR, "T", (char*)handle_T_option, "Specify a template file."},
+    {OPT_FSTR, "W", 0, "Ignored.  (Placeholder for '-W' compiler options.)"},
+    {OPT_INT,  "nconflicts", (char *)&cmdopt.nconflict, "Expect N shift/reduce conflicts."},
+    {OPT_INT,  "jobs", (char *)&jobs,
+                   "Grammars to process at once.  Default: one per CPU."},
+    {OPT_STR,  "manifest", (char *)&manifest,
+                   "Also process each grammar listed in the named file."},
+    {OPT_STR,  "profile", (char *)&cmdopt.zProfile,
+                   "Lay out the tables for the counts in this profile."},
+    {OPT_FLAG,0,0,0}
+  };
+  int exitcode = 0;
+  int i, j;
+  const char **azName = 0;
+  int nName = 0;
+  char **azTemplate = 0;    /* Text of each distinct template */
+  char **azTemplateName = 0;/* File each template came from */
+  int nTemplate = 0;
+  struct batch batch;
+
+  OptInit(argv,options,stderr);
+  if( version ){
+    #ifdef LEMONPLUSPLUS
+     printf("Lemon-- version 1.0\n");
+   #else
+     printf("Lemon version 1.0\n");
+   #endif
+     exit(0);
+  }
+  for(i=0; i<OptNArgs(); i++) add_grammar(&azName, &nName, OptArg(i));
+  if( manifest ) read_manifest(manifest, &azName, &nName);
+  if( nName==0 ){
+    fprintf(stderr,"At least one filename argument is required.\n");
+    exit(1);
+  }
+  cmdopt.zArgv0 = argv[0];
+  cmdopt.writeFiles = 1;
+
+  /* Set up one job per grammar.  When there is more than one, errors are
+  ** collected and printed in order after all the jobs finish, and each
+  ** driver template is read only once and shared by every grammar that
+  ** uses it. */
+  memset(&batch, 0, sizeof(batch));
+  batch.nJob = nName;
+  batch.aJob = (struct batch_job*)calloc(nName, sizeof(batch.aJob[0]));
+  if( nName>1 ){
+    azTemplate = (char**)calloc(nName, sizeof(char*));
+    azTemplateName = (char**)calloc(nName, sizeof(char*));
+  }
+  if( batch.aJob==0 || (nName>1 && (azTemplate==0 || azTemplateName==0)) ){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  for(i=0; i<nName; i++){
+    struct lemon_options *pOpt = &batch.aJob[i].opt;
+    *pOpt = cmdopt;
+    pOpt->zFilename = azName[i];
+    if( nName>1 ){
+      char *zName;
+      char *zText;
+      pOpt->captureErrors = 1;
+      zText = template_load(pOpt, &zName);
+      if( zText==0 ) continue;
+      for(j=0; j<nTemplate && strcmp(azTemplateName[j],zName)!=0; j++){}
+      if( j<nTemplate ){
+        free(zText);
+        free(zName);
+      }else{
+        azTemplate[nTemplate] = zText;
+        azTemplateName[nTemplate++] = zName;
+      }
+      pOpt->zTemplate = azTemplate[j];
+    }
+  }
+  batch_run(&batch, jobs>0 ? jobs : processor_count());
+
+  for(i=0; i<nName; i++){
+    struct lemon_output *pOut = &batch.aJob[i].out;
+    if( pOut->nErrors ) fputs(pOut->zErrors, stderr);
+    if( cmdopt.rpflag && pOut->zReport ) fputs(pOut->zReport, stdout);
+    if( statistics && !jsonStats ){
+      if( nName>1 ){
+        printf("Parser statistics for %s:\n", azName[i]);
+      }else{
+        printf("Parser statistics:\n");
+      }
+      stats_line("terminal symbols", pOut->nterminal);
+      stats_line("non-terminal symbols", pOut->nsymbol - pOut->nterminal);
+      stats_line("total symbols", pOut->nsymbol);
+      stats_line("rules", pOut->nrule);
+      stats_line("states", pOut->nstate);
+      stats_line("conflicts", pOut->nconflict);
+      stats_line("action table entries", pOut->nactiontab);
+      stats_line("lookahead table entries", pOut->nlookaheadtab);
+      stats_line("total table size (bytes)", pOut->tablesize);
+      if( pOut->nfolded>=0 ){
+        stats_line("actions added by -F", pOut->nfolded);
+      }
+      if( pOut->nclass>=0 ){
+        stats_line("terminal classes (-e)", pOut->nclass);
+      }
+      if( pOut->nmerged>=0 ){
+        stats_line("states removed by -M", pOut->nmerged);
+      }
+      if( pOut->nunit>=0 ){
+        stats_line("terminal actions changed by -u", pOut->nunit);
+      }
+      if( pOut->nstackbound>0 ){
+        stats_line("stack depth bound", pOut->nstackbound);
+      }
+      if( pOut->nheadroom>0 ){
+        stats_line("stack entries pushed per token", pOut->nheadroom);
+      }
+      printf("  Generator phases:%*s %9s %9s %9s\n", 18, "",
+             "wall ms", "cpu ms", "peak KB");
+      for(j=0; j<pOut->nPhase; j++){
+        phase_line(pOut->aPhase[j].zName, pOut->aPhase[j].wallTime,
+                   pOut->aPhase[j].cpuTime, pOut->aPhase[j].nPeakBytes);
+      }
+      phase_line("total", pOut->wallTime, pOut->cpuTime, pOut->nPeakBytes);
+    }
+    if( jsonStats ){
+      printf("%s\n", i ? "," : "[");
+      stats_json(azName[i], pOut);
+      if( i==nName-1 ) printf("\n]\n");
+    }
+    if( pOut->nconflict > 0 ){
+      if( nName>1 ) fprintf(stderr,"%s: ", azName[i]);
+      fprintf(stderr,"%d parsing conflicts.\n",pOut->nconflict);
+    }
+    if( batch.aJob[i].rc && exitcode==0 ) exitcode = batch.aJob[i].rc;
+    lemon_output_free(pOut);
+  }
+  exit(exitcode);
+  return (exitcode);
+}
+#endif /* LEMON_LIBRARY */
+/******************** From the file "msort.c" *******************************/
+/*
+** A generic merge-sort program.
+**
+** USAGE:
+** Let "ptr" be a pointer to some structure which is at the head of
+** a null-terminated list.  Then to sort the list call:
+**
+**     ptr = msort(ptr,&(ptr->next),cmpfnc);
+**
+** In the above, "cmpfnc" is a pointer to a function which compares
+** two instances of the structure and returns an integer, as in
+** strcmp.  The second argument is a pointer to the pointer to the
+** second element of the linked list.  This address is used to compute
+** the offset to the "next" field within the structure.  The offset to
+** the "next" field must be constant for all structures in the list.
+**
+** The function returns a new pointer which is the head of the list
+** after sorting.
+**
+** ALGORITHM:
+** Merge-sort.
+*/
+
+/*
+** Return a pointer to the next structure in the linked list.
+*/
+#define NEXT(A) (*(char**)(((char*)A)+offset))
 
 /*
 ** Inputs:
@@ -2244,6 +3255,11 @@ enum e_state {
   WAITING_FOR_DATATYPE_SYMBOL,
   WAITING_FOR_FALLBACK_ID,
   WAITING_FOR_WILDCARD_ID,
+  WAITING_FOR_KEYWORD_ID,
+  WAITING_FOR_PATTERN_ID,
+  WAITING_FOR_PATTERN,
+  WAITING_FOR_SKIP_PATTERN,
+  WAITING_FOR_SYNC_ID,
   WAITING_FOR_CLASS_ID,
   WAITING_FOR_CLASS_TOKEN,
   WAITING_FOR_TOKEN_NAME
@@ -2257,6 +3273,8 @@ struct pstate {
   enum e_state state;        /* The state of the parser */
   struct symbol *fallback;   /* The fallback token */
   struct symbol *tkclass;    /* Token class symbol */
+  struct symbol *keyword;    /* Last token named by %keywords */
+  struct symbol *pattern;    /* Token of the %token_pattern being read */
   struct symbol *lhs;        /* Left-hand side of current rule */
   const char *lhsalias;      /* Alias for the LHS */
   int nrhs;                  /* Number of right-hand side symbols seen */
@@ -2265,6 +3283,7 @@ struct pstate {
   struct rule *prevrule;     /* Previous rule parsed */
   const char *declkeyword;   /* Keyword of a declaration */
   char **declargslot;        /* Where the declaration argument should be put */
+  char *declignored;         /* Sink for deprecated declaration arguments */
   int insertLineMacro;       /* Add #line before declaration insert */
   int *decllinenoslot;       /* Where to write declaration line number */
   enum e_assoc declassoc;    /* Assign this association to decl arguments */
@@ -2273,6 +3292,36 @@ struct pstate {
   struct rule *lastrule;     /* Pointer to the most recently parsed rule */
 };
 
+/* Fold ASCII upper case to lower case, and nothing else */
+#define KEYWORD_FOLD(C) ((C)>='A' && (C)<='Z' ? (C)+0x20 : (C))
+
+/* Compare two keyword spellings, ignoring the case of ASCII letters.
+** Return true if they are the same.
+*/
+static int keyword_same(const char *a, const char *b){
+  while( *a && KEYWORD_FOLD(*a)==KEYWORD_FOLD(*b) ){ a++; b++; }
+  return *a==0 && *b==0;
+}
+
+/* Report an error if the spelling of keyword sp, now final, is already
+** used by another keyword.  The generated lookup folds case, so two
+** spellings that differ only in case conflict.
+*/
+static void keyword_check(struct pstate *psp, struct symbol *sp)
+{
+  struct lemon *gp = psp->gp;
+  int i;
+  for(i=0; i<gp->nkeyword && gp->keywords[i]!=sp; i++){
+    if( keyword_same(gp->keywords[i]->keyword, sp->keyword) ){
+      ErrorMsg(psp->filename, psp->tokenlineno,
+        "Keyword \"%s\" is used by both %s and %s", sp->keyword,
+        gp->keywords[i]->name, sp->name);
+      psp->errorcnt++;
+      break;
+    }
+  }
+}
+
 /* Parse a single token */
 static void parseonetoken(struct pstate *psp)
 {
@@ -2398,7 +3447,7 @@ to follow the previous rule.");
     case IN_RHS:
       if( x[0]=='.' ){
         struct rule *rp;
-        rp = (struct rule *)calloc( sizeof(struct rule) +
+        rp = (struct rule *)lemon_calloc( sizeof(struct rule) +
              sizeof(struct symbol*)*psp->nrhs + sizeof(char*)*psp->nrhs, 1);
         if( rp==0 ){
           ErrorMsg(psp->filename,psp->tokenlineno,
@@ -2450,17 +3499,17 @@ to follow the previous rule.");
         struct symbol *msp = psp->rhs[psp->nrhs-1];
         if( msp->type!=MULTITERMINAL ){
           struct symbol *origsp = msp;
-          msp = (struct symbol *) calloc(1,sizeof(*msp));
+          msp = (struct symbol *) lemon_calloc(1,sizeof(*msp));
           memset(msp, 0, sizeof(*msp));
           msp->type = MULTITERMINAL;
           msp->nsubsym = 1;
-          msp->subsym = (struct symbol **) calloc(1,sizeof(struct symbol*));
+          msp->subsym = (struct symbol **) lemon_calloc(1,sizeof(struct symbol*));
           msp->subsym[0] = origsp;
           msp->name = origsp->name;
           psp->rhs[psp->nrhs-1] = msp;
         }
         msp->nsubsym++;
-        msp->subsym = (struct symbol **) realloc(msp->subsym,
+        msp->subsym = (struct symbol **) lemon_realloc(msp->subsym,
           sizeof(struct symbol*)*msp->nsubsym);
         msp->subsym[msp->nsubsym-1] = Symbol_new(&x[1]);
         if( ISLOWER(x[1]) || ISLOWER(msp->subsym[0]->name[0]) ){
@@ -2518,19 +3567,17 @@ to follow the previous rule.");
           psp->insertLineMacro = 0;
         }else if( strcmp(x,"token_destructor")==0 ){
         #ifdef LEMONPLUSPLUS
-          static char *tmp;
           ErrorMsg(psp->filename,psp->tokenlineno,
             "%%token_destructor is deprecated in lemon--.  Use object destructors instead.");
-          psp->declargslot = &tmp;
+          psp->declargslot = &psp->declignored;
         #else
           psp->declargslot = &psp->gp->tokendest;
         #endif
         }else if( strcmp(x,"default_destructor")==0 ){
         #ifdef LEMONPLUSPLUS
-          static char *tmp;
           ErrorMsg(psp->filename,psp->tokenlineno,
             "%%default_destructor is deprecated in lemon--.  Use object destructors instead.");
-          psp->declargslot = &tmp;
+          psp->declargslot = &psp->declignored;
         #else
           psp->declargslot = &psp->gp->vardest;
         #endif
@@ -2592,8 +3639,20 @@ to follow the previous rule.");
           psp->state = WAITING_FOR_TOKEN_NAME;
         }else if( strcmp(x,"wildcard")==0 ){
           psp->state = WAITING_FOR_WILDCARD_ID;
+        }else if( strcmp(x,"keywords")==0 ){
+          psp->keyword = 0;
+          psp->state = WAITING_FOR_KEYWORD_ID;
+        }else if( strcmp(x,"token_pattern")==0 ){
+          psp->state = WAITING_FOR_PATTERN_ID;
+        }else if( strcmp(x,"token_skip")==0 ){
+          psp->state = WAITING_FOR_SKIP_PATTERN;
+        }else if( strcmp(x,"sync")==0 ){
+          psp->state = WAITING_FOR_SYNC_ID;
         }else if( strcmp(x,"token_class")==0 ){
           psp->state = WAITING_FOR_CLASS_ID;
+        }else if( strcmp(x,"recognizer")==0 ){
+          psp->gp->recognizer = 1;
+          psp->state = WAITING_FOR_DECL_OR_RULE;
         }else{
           ErrorMsg(psp->filename,psp->tokenlineno,
             "Unknown declaration keyword: \"%%%s\".",x);
@@ -2691,7 +3750,7 @@ to follow the previous rule.");
           nLine = lemonStrlen(zLine);
           n += nLine + lemonStrlen(psp->filename) + nBack;
         }
-        *psp->declargslot = (char *) realloc(*psp->declargslot, n);
+        *psp->declargslot = (char *) lemon_realloc(*psp->declargslot, n);
         zBuf = *psp->declargslot + nOld;
         if( addLineMacro ){
           if( nOld && zBuf[-1]!='\n' ){
@@ -2782,6 +3841,128 @@ to follow the previous rule.");
         }
       }
       break;
+    case WAITING_FOR_KEYWORD_ID:
+      /* Each token is followed by an optional string which gives its
+      ** spelling.  The default spelling is the name of the token.
+      **
+      **     %keywords SELECT FROM WHERE ID_IF "if".
+      **
+      ** A spelling is only final once the next argument has been seen,
+      ** so that is when it is compared against the others.
+      */
+      if( x[0]=='"' ){
+        if( psp->keyword==0 ){
+          ErrorMsg(psp->filename, psp->tokenlineno,
+            "%%keywords spelling %s\" should follow a token", x);
+          psp->errorcnt++;
+        }else if( x[1]==0 || lemonStrlen(x+1)>255 ){
+          ErrorMsg(psp->filename, psp->tokenlineno,
+            "%%keywords spelling for %s must be 1 to 255 bytes",
+            psp->keyword->name);
+          psp->errorcnt++;
+        }else if( psp->keyword->keyword!=psp->keyword->name ){
+          ErrorMsg(psp->filename, psp->tokenlineno,
+            "More than one spelling given for keyword %s",
+            psp->keyword->name);
+          psp->errorcnt++;
+        }else{
+          psp->keyword->keyword = Strsafe(x+1);
+        }
+        break;
+      }
+      if( psp->keyword ){
+        keyword_check(psp, psp->keyword);
+        psp->keyword = 0;
+      }
+      if( x[0]=='.' ){
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+      }else if( !ISUPPER(x[0]) ){
+        ErrorMsg(psp->filename, psp->tokenlineno,
+          "%%keywords argument \"%s\" should be a token", x);
+        psp->errorcnt++;
+      }else{
+        struct symbol *sp = Symbol_new(x);
+        struct lemon *gp = psp->gp;
+        if( sp->keyword ){
+          ErrorMsg(psp->filename, psp->tokenlineno,
+            "Token %s is already a keyword", x);
+          psp->errorcnt++;
+        }else{
+          sp->keyword = sp->name;
+          gp->keywords = (struct symbol **) lemon_realloc(gp->keywords,
+            sizeof(struct symbol*)*(gp->nkeyword+1));
+          MemoryCheck(gp->keywords);
+          gp->keywords[gp->nkeyword++] = sp;
+          psp->keyword = sp;
+        }
+      }
+      break;
+    case WAITING_FOR_PATTERN_ID:
+      /* Each token is followed by a pattern (a regular expression in a
+      ** string) for the scanner:
+      **
+      **     %token_pattern NUM "[0-9]+" ID "[A-Za-z_][A-Za-z_0-9]*".
+      **     %token_skip "[ \t\r\n]+" "#[^\n]*".
+      **
+      ** When several patterns match the longest possible text, the one
+      ** declared first wins.
+      */
+      if( x[0]=='.' ){
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+      }else if( !ISUPPER(x[0]) ){
+        ErrorMsg(psp->filename, psp->tokenlineno,
+          "%%token_pattern argument \"%s\" should be a token", x);
+        psp->errorcnt++;
+        psp->state = RESYNC_AFTER_DECL_ERROR;
+      }else{
+        psp->pattern = Symbol_new(x);
+        psp->state = WAITING_FOR_PATTERN;
+      }
+      break;
+    case WAITING_FOR_PATTERN:
+    case WAITING_FOR_SKIP_PATTERN:
+      if( x[0]=='.' && psp->state==WAITING_FOR_SKIP_PATTERN ){
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+      }else if( x[0]!='"' ){
+        ErrorMsg(psp->filename, psp->tokenlineno,
+          "Expected a pattern string but found \"%s\"", x);
+        psp->errorcnt++;
+        psp->state = RESYNC_AFTER_DECL_ERROR;
+      }else{
+        struct symbol *sp = 0;
+        const char *zErr;
+        if( psp->state==WAITING_FOR_PATTERN ){
+          sp = psp->pattern;
+          psp->state = WAITING_FOR_PATTERN_ID;
+        }
+        zErr = ScanAddPattern(psp->gp, sp, x+1);
+        if( zErr ){
+          ErrorMsg(psp->filename, psp->tokenlineno,
+            "Bad pattern %s\": %s", x, zErr);
+          psp->errorcnt++;
+        }
+      }
+      break;
+    case WAITING_FOR_SYNC_ID:
+      /* Tokens that end a top-level statement.  The input can be split
+      ** after any of them and the pieces parsed independently.
+      **
+      **     %sync SEMI NEWLINE.
+      */
+      if( x[0]=='.' ){
+        psp->state = WAITING_FOR_DECL_OR_RULE;
+      }else if( !ISUPPER(x[0]) ){
+        ErrorMsg(psp->filename, psp->tokenlineno,
+          "%%sync argument \"%s\" should be a token", x);
+        psp->errorcnt++;
+      }else{
+        struct symbol *sp = Symbol_new(x);
+        if( !sp->bSync ){
+          sp->bSync = 1;
+          psp->gp->nsync++;
+        }
+      }
+      break;
     case WAITING_FOR_CLASS_ID:
       if( !ISLOWER(x[0]) ){
         ErrorMsg(psp->filename, psp->tokenlineno,
@@ -2805,7 +3986,7 @@ to follow the previous rule.");
       }else if( ISUPPER(x[0]) || ((x[0]=='|' || x[0]=='/') && ISUPPER(x[1])) ){
         struct symbol *msp = psp->tkclass;
         msp->nsubsym++;
-        msp->subsym = (struct symbol **) realloc(msp->subsym,
+        msp->subsym = (struct symbol **) lemon_realloc(msp->subsym,
           sizeof(struct symbol*)*msp->nsubsym);
         if( !ISUPPER(x[0]) ) x++;
         msp->subsym[msp->nsubsym-1] = Symbol_new(x);
@@ -2856,8 +4037,8 @@ static void preprocess_input(char *z){
         for(j=i+7; ISSPACE(z[j]); j++){}
         for(n=0; z[j+n] && !ISSPACE(z[j+n]); n++){}
         exclude = 1;
-        for(k=0; k<nDefine; k++){
-          if( strncmp(azDefine[k],&z[j],n)==0 && lemonStrlen(azDefine[k])==n ){
+        for(k=0; k<lemon_ctx->nDefine; k++){
+          if( strncmp(lemon_ctx->azDefine[k],&z[j],n)==0 && lemonStrlen(lemon_ctx->azDefine[k])==n ){
             exclude = 0;
             break;
           }
@@ -2872,8 +4053,8 @@ static void preprocess_input(char *z){
     }
   }
   if( exclude ){
-    fprintf(stderr,"unterminated %%ifdef starting on line %d\n", start_lineno);
-    exit(1);
+    lemon_error("unterminated %%ifdef starting on line %d\n", start_lineno);
+    lemon_exit(1);
   }
 }
 
@@ -2899,34 +4080,48 @@ void Parse(struct lemon *gp)
   ps.errorcnt = 0;
   ps.state = INITIALIZE;
 
-  /* Begin by reading the input file */
-  fp = fopen(ps.filename,"rb");
-  if( fp==0 ){
-    ErrorMsg(ps.filename,0,"Can't open this file for reading.");
-    gp->errorcnt++;
-    return;
-  }
-  fseek(fp,0,2);
-  filesize = ftell(fp);
-  rewind(fp);
-  filebuf = (char *)malloc( filesize+1 );
-  if( filesize>100000000 || filebuf==0 ){
-    ErrorMsg(ps.filename,0,"Input file too large.");
-    free(filebuf);
-    gp->errorcnt++;
-    fclose(fp);
-    return;
-  }
-  if( fread(filebuf,1,filesize,fp)!=filesize ){
-    ErrorMsg(ps.filename,0,"Can't read in all %d bytes of this file.",
-      filesize);
-    free(filebuf);
-    gp->errorcnt++;
+  /* Begin by reading the input file, unless the text was supplied
+  ** by a library caller.  Either way, work on a private copy because
+  ** the scanner writes into the buffer. */
+  if( gp->zInput ){
+    filesize = gp->nInput>=0 ? gp->nInput : lemonStrlen(gp->zInput);
+    filebuf = (char *)lemon_malloc( filesize+1 );
+    if( filebuf==0 ){
+      ErrorMsg(ps.filename,0,"Input file too large.");
+      gp->errorcnt++;
+      return;
+    }
+    memcpy(filebuf, gp->zInput, filesize);
+    filebuf[filesize] = 0;
+  }else{
+    fp = fopen(ps.filename,"rb");
+    if( fp==0 ){
+      ErrorMsg(ps.filename,0,"Can't open this file for reading.");
+      gp->errorcnt++;
+      return;
+    }
+    fseek(fp,0,2);
+    filesize = ftell(fp);
+    rewind(fp);
+    filebuf = (char *)lemon_malloc( filesize+1 );
+    if( filesize>100000000 || filebuf==0 ){
+      ErrorMsg(ps.filename,0,"Input file too large.");
+      lemon_free(filebuf);
+      gp->errorcnt++;
+      fclose(fp);
+      return;
+    }
+    if( fread(filebuf,1,filesize,fp)!=filesize ){
+      ErrorMsg(ps.filename,0,"Can't read in all %d bytes of this file.",
+        filesize);
+      lemon_free(filebuf);
+      gp->errorcnt++;
+      fclose(fp);
+      return;
+    }
     fclose(fp);
-    return;
+    filebuf[filesize] = 0;
   }
-  fclose(fp);
-  filebuf[filesize] = 0;
 
   /* Make an initial pass through the file to handle %ifdef and %ifndef */
   preprocess_input(filebuf);
@@ -3025,7 +4220,7 @@ void Parse(struct lemon *gp)
     *cp = (char)c;                  /* Restore the buffer */
     cp = nextcp;
   }
-  free(filebuf);                    /* Release the buffer after parsing */
+  lemon_free(filebuf);                    /* Release the buffer after parsing */
   gp->rule = ps.firstrule;
   gp->errorcnt = ps.errorcnt;
 }
@@ -3034,26 +4229,25 @@ void Parse(struct lemon *gp)
 ** Routines processing configuration follow-set propagation links
 ** in the LEMON parser generator.
 */
-static struct plink *plink_freelist = 0;
 
 /* Allocate a new plink */
 struct plink *Plink_new(void){
   struct plink *newlink;
 
-  if( plink_freelist==0 ){
+  if( lemon_ctx->plink_freelist==0 ){
     int i;
     int amt = 100;
-    plink_freelist = (struct plink *)calloc( amt, sizeof(struct plink) );
-    if( plink_freelist==0 ){
-      fprintf(stderr,
+    lemon_ctx->plink_freelist = (struct plink *)lemon_calloc( amt, sizeof(struct plink) );
+    if( lemon_ctx->plink_freelist==0 ){
+      lemon_error(
       "Unable to allocate memory for a new follow-set propagation link.\n");
-      exit(1);
+      lemon_exit(1);
     }
-    for(i=0; i<amt-1; i++) plink_freelist[i].next = &plink_freelist[i+1];
-    plink_freelist[amt-1].next = 0;
+    for(i=0; i<amt-1; i++) lemon_ctx->plink_freelist[i].next = &lemon_ctx->plink_freelist[i+1];
+    lemon_ctx->plink_freelist[amt-1].next = 0;
   }
-  newlink = plink_freelist;
-  plink_freelist = plink_freelist->next;
+  newlink = lemon_ctx->plink_freelist;
+  lemon_ctx->plink_freelist = lemon_ctx->plink_freelist->next;
   return newlink;
 }
 
@@ -3086,8 +4280,8 @@ void Plink_delete(struct plink *plp)
 
   while( plp ){
     nextpl = plp->next;
-    plp->next = plink_freelist;
-    plink_freelist = plp;
+    plp->next = lemon_ctx->plink_freelist;
+    lemon_ctx->plink_freelist = plp;
     plp = nextpl;
   }
 }
@@ -3097,7 +4291,7 @@ void Plink_delete(struct plink *plp)
 */
 
 /* Generate a filename with the given suffix.  Space to hold the
-** name comes from malloc() and must be freed by the calling
+** name comes from lemon_malloc() and must be freed by the calling
 ** function.
 */
 PRIVATE char *file_makename(struct lemon *lemp, const char *suffix)
@@ -3107,22 +4301,22 @@ PRIVATE char *file_makename(struct lemon *lemp, const char *suffix)
   char *filename = lemp->filename;
   int sz;
 
-  if( outputDir ){
+  if( lemon_ctx->outputDir ){
     cp = strrchr(filename, '/');
     if( cp ) filename = cp + 1;
   }
   sz = lemonStrlen(filename);
   sz += lemonStrlen(suffix);
-  if( outputDir ) sz += lemonStrlen(outputDir) + 1;
+  if( lemon_ctx->outputDir ) sz += lemonStrlen(lemon_ctx->outputDir) + 1;
   sz += 5;
-  name = (char*)malloc( sz );
+  name = (char*)lemon_malloc( sz );
   if( name==0 ){
-    fprintf(stderr,"Can't allocate space for a filename.\n");
-    exit(1);
+    lemon_error("Can't allocate space for a filename.\n");
+    lemon_exit(1);
   }
   name[0] = 0;
-  if( outputDir ){
-    lemon_strcpy(name, outputDir);
+  if( lemon_ctx->outputDir ){
+    lemon_strcpy(name, lemon_ctx->outputDir);
     lemon_strcat(name, "/");
   }
   lemon_strcat(name,filename);
@@ -3142,11 +4336,11 @@ PRIVATE FILE *file_open(
 ){
   FILE *fp;
 
-  if( lemp->outname ) free(lemp->outname);
+  if( lemp->outname ) lemon_free(lemp->outname);
   lemp->outname = file_makename(lemp, suffix);
   fp = fopen(lemp->outname,mode);
   if( fp==0 && *mode=='w' ){
-    fprintf(stderr,"Can't open file \"%s\".\n",lemp->outname);
+    lemon_error("Can't open file \"%s\".\n",lemp->outname);
     lemp->errorcnt++;
     return 0;
   }
@@ -3155,33 +4349,33 @@ PRIVATE FILE *file_open(
 
 /* Print the text of a rule
 */
-void rule_print(FILE *out, struct rule *rp){
+void rule_print(struct lemon_buf *out, struct rule *rp){
   int i, j;
-  fprintf(out, "%s",rp->lhs->name);
-  /*    if( rp->lhsalias ) fprintf(out,"(%s)",rp->lhsalias); */
-  fprintf(out," ::=");
+  lemon_bprintf(out, "%s",rp->lhs->name);
+  /*    if( rp->lhsalias ) lemon_bprintf(out,"(%s)",rp->lhsalias); */
+  lemon_bprintf(out," ::=");
   for(i=0; i<rp->nrhs; i++){
     struct symbol *sp = rp->rhs[i];
     if( sp->type==MULTITERMINAL ){
-      fprintf(out," %s", sp->subsym[0]->name);
+      lemon_bprintf(out," %s", sp->subsym[0]->name);
       for(j=1; j<sp->nsubsym; j++){
-        fprintf(out,"|%s", sp->subsym[j]->name);
+        lemon_bprintf(out,"|%s", sp->subsym[j]->name);
       }
     }else{
-      fprintf(out," %s", sp->name);
+      lemon_bprintf(out," %s", sp->name);
     }
-    /* if( rp->rhsalias[i] ) fprintf(out,"(%s)",rp->rhsalias[i]); */
+    /* if( rp->rhsalias[i] ) lemon_bprintf(out,"(%s)",rp->rhsalias[i]); */
   }
 }
 
 /* Duplicate the input file without comments and without actions
 ** on rules */
-void Reprint(struct lemon *lemp)
+void Reprint(struct lemon *lemp, struct lemon_buf *out)
 {
   struct rule *rp;
   struct symbol *sp;
   int i, j, maxlen, len, ncolumns, skip;
-  printf("// Reprint of input file \"%s\".\n// Symbols:\n",lemp->filename);
+  lemon_bprintf(out,"// Reprint of input file \"%s\".\n// Symbols:\n",lemp->filename);
   maxlen = 10;
   for(i=0; i<lemp->nsymbol; i++){
     sp = lemp->symbols[i];
@@ -3192,47 +4386,47 @@ void Reprint(struct lemon *lemp)
   if( ncolumns<1 ) ncolumns = 1;
   skip = (lemp->nsymbol + ncolumns - 1)/ncolumns;
   for(i=0; i<skip; i++){
-    printf("//");
+    lemon_bprintf(out,"//");
     for(j=i; j<lemp->nsymbol; j+=skip){
       sp = lemp->symbols[j];
       assert( sp->index==j );
-      printf(" %3d %-*.*s",j,maxlen,maxlen,sp->name);
+      lemon_bprintf(out," %3d %-*.*s",j,maxlen,maxlen,sp->name);
     }
-    printf("\n");
+    lemon_bprintf(out,"\n");
   }
   for(rp=lemp->rule; rp; rp=rp->next){
-    rule_print(stdout, rp);
-    printf(".");
-    if( rp->precsym ) printf(" [%s]",rp->precsym->name);
-    /* if( rp->code ) printf("\n    %s",rp->code); */
-    printf("\n");
+    rule_print(out, rp);
+    lemon_bprintf(out,".");
+    if( rp->precsym ) lemon_bprintf(out," [%s]",rp->precsym->name);
+    /* if( rp->code ) lemon_bprintf(out,"\n    %s",rp->code); */
+    lemon_bprintf(out,"\n");
   }
 }
 
 /* Print a single rule.
 */
-void RulePrint(FILE *fp, struct rule *rp, int iCursor){
+void RulePrint(struct lemon_buf *fp, struct rule *rp, int iCursor){
   struct symbol *sp;
   int i, j;
-  fprintf(fp,"%s ::=",rp->lhs->name);
+  lemon_bprintf(fp,"%s ::=",rp->lhs->name);
   for(i=0; i<=rp->nrhs; i++){
-    if( i==iCursor ) fprintf(fp," *");
+    if( i==iCursor ) lemon_bprintf(fp," *");
     if( i==rp->nrhs ) break;
     sp = rp->rhs[i];
     if( sp->type==MULTITERMINAL ){
-      fprintf(fp," %s", sp->subsym[0]->name);
+      lemon_bprintf(fp," %s", sp->subsym[0]->name);
       for(j=1; j<sp->nsubsym; j++){
-        fprintf(fp,"|%s",sp->subsym[j]->name);
+        lemon_bprintf(fp,"|%s",sp->subsym[j]->name);
       }
     }else{
-      fprintf(fp," %s", sp->name);
+      lemon_bprintf(fp," %s", sp->name);
     }
   }
 }
 
 /* Print the rule for a configuration.
 */
-void ConfigPrint(FILE *fp, struct config *cfp){
+void ConfigPrint(struct lemon_buf *fp, struct config *cfp){
   RulePrint(fp, cfp->rp, cfp->dot);
 }
 
@@ -3240,33 +4434,33 @@ void ConfigPrint(FILE *fp, struct config *cfp){
 #if 0
 /* Print a set */
 PRIVATE void SetPrint(out,set,lemp)
-FILE *out;
+struct lemon_buf *out;
 char *set;
 struct lemon *lemp;
 {
   int i;
   char *spacer;
   spacer = "";
-  fprintf(out,"%12s[","");
+  lemon_bprintf(out,"%12s[","");
   for(i=0; i<lemp->nterminal; i++){
     if( SetFind(set,i) ){
-      fprintf(out,"%s%s",spacer,lemp->symbols[i]->name);
+      lemon_bprintf(out,"%s%s",spacer,lemp->symbols[i]->name);
       spacer = " ";
     }
   }
-  fprintf(out,"]\n");
+  lemon_bprintf(out,"]\n");
 }
 
 /* Print a plink chain */
 PRIVATE void PlinkPrint(out,plp,tag)
-FILE *out;
+struct lemon_buf *out;
 struct plink *plp;
 char *tag;
 {
   while( plp ){
-    fprintf(out,"%12s%s (state %2d) ","",tag,plp->cfp->stp->statenum);
+    lemon_bprintf(out,"%12s%s (state %2d) ","",tag,plp->cfp->stp->statenum);
     ConfigPrint(out,plp->cfp);
-    fprintf(out,"\n");
+    lemon_bprintf(out,"\n");
     plp = plp->next;
   }
 }
@@ -3277,54 +4471,54 @@ char *tag;
 */
 int PrintAction(
   struct action *ap,          /* The action to print */
-  FILE *fp,                   /* Print the action here */
+  struct lemon_buf *fp,                   /* Print the action here */
   int indent                  /* Indent by this amount */
 ){
   int result = 1;
   switch( ap->type ){
     case SHIFT: {
       struct state *stp = ap->x.stp;
-      fprintf(fp,"%*s shift        %-7d",indent,ap->sp->name,stp->statenum);
+      lemon_bprintf(fp,"%*s shift        %-7d",indent,ap->sp->name,stp->statenum);
       break;
     }
     case REDUCE: {
       struct rule *rp = ap->x.rp;
-      fprintf(fp,"%*s reduce       %-7d",indent,ap->sp->name,rp->iRule);
+      lemon_bprintf(fp,"%*s reduce       %-7d",indent,ap->sp->name,rp->iRule);
       RulePrint(fp, rp, -1);
       break;
     }
     case SHIFTREDUCE: {
       struct rule *rp = ap->x.rp;
-      fprintf(fp,"%*s shift-reduce %-7d",indent,ap->sp->name,rp->iRule);
+      lemon_bprintf(fp,"%*s shift-reduce %-7d",indent,ap->sp->name,rp->iRule);
       RulePrint(fp, rp, -1);
       break;
     }
     case ACCEPT:
-      fprintf(fp,"%*s accept",indent,ap->sp->name);
+      lemon_bprintf(fp,"%*s accept",indent,ap->sp->name);
       break;
     case ERROR:
-      fprintf(fp,"%*s error",indent,ap->sp->name);
+      lemon_bprintf(fp,"%*s error",indent,ap->sp->name);
       break;
     case SRCONFLICT:
     case RRCONFLICT:
-      fprintf(fp,"%*s reduce       %-7d ** Parsing conflict **",
+      lemon_bprintf(fp,"%*s reduce       %-7d ** Parsing conflict **",
         indent,ap->sp->name,ap->x.rp->iRule);
       break;
     case SSCONFLICT:
-      fprintf(fp,"%*s shift        %-7d ** Parsing conflict **",
+      lemon_bprintf(fp,"%*s shift        %-7d ** Parsing conflict **",
         indent,ap->sp->name,ap->x.stp->statenum);
       break;
     case SH_RESOLVED:
-      if( showPrecedenceConflict ){
-        fprintf(fp,"%*s shift        %-7d -- dropped by precedence",
+      if( lemon_ctx->showPrecedenceConflict ){
+        lemon_bprintf(fp,"%*s shift        %-7d -- dropped by precedence",
                 indent,ap->sp->name,ap->x.stp->statenum);
       }else{
         result = 0;
       }
       break;
     case RD_RESOLVED:
-      if( showPrecedenceConflict ){
-        fprintf(fp,"%*s reduce %-7d -- dropped by precedence",
+      if( lemon_ctx->showPrecedenceConflict ){
+        lemon_bprintf(fp,"%*s reduce %-7d -- dropped by precedence",
                 indent,ap->sp->name,ap->x.rp->iRule);
       }else{
         result = 0;
@@ -3335,38 +4529,35 @@ int PrintAction(
       break;
   }
   if( result && ap->spOpt ){
-    fprintf(fp,"  /* because %s==%s */", ap->sp->name, ap->spOpt->name);
+    lemon_bprintf(fp,"  /* because %s==%s */", ap->sp->name, ap->spOpt->name);
   }
   return result;
 }
 
-/* Generate the "*.out" log file */
-void ReportOutput(struct lemon *lemp)
+/* Generate the "*.out" log file into fp */
+void ReportOutput(struct lemon *lemp, struct lemon_buf *fp)
 {
   int i, n;
   struct state *stp;
   struct config *cfp;
   struct action *ap;
   struct rule *rp;
-  FILE *fp;
 
-  fp = file_open(lemp,".out","wb");
-  if( fp==0 ) return;
   for(i=0; i<lemp->nxstate; i++){
     stp = lemp->sorted[i];
-    fprintf(fp,"State %d:\n",stp->statenum);
+    lemon_bprintf(fp,"State %d:\n",stp->statenum);
     if( lemp->basisflag ) cfp=stp->bp;
     else                  cfp=stp->cfp;
     while( cfp ){
       char buf[20];
       if( cfp->dot==cfp->rp->nrhs ){
         lemon_sprintf(buf,"(%d)",cfp->rp->iRule);
-        fprintf(fp,"    %5s ",buf);
+        lemon_bprintf(fp,"    %5s ",buf);
       }else{
-        fprintf(fp,"          ");
+        lemon_bprintf(fp,"          ");
       }
       ConfigPrint(fp,cfp);
-      fprintf(fp,"\n");
+      lemon_bprintf(fp,"\n");
 #if 0
       SetPrint(fp,cfp->fws,lemp);
       PlinkPrint(fp,cfp->fplp,"To  ");
@@ -3375,68 +4566,67 @@ void ReportOutput(struct lemon *lemp)
       if( lemp->basisflag ) cfp=cfp->bp;
       else                  cfp=cfp->next;
     }
-    fprintf(fp,"\n");
+    lemon_bprintf(fp,"\n");
     for(ap=stp->ap; ap; ap=ap->next){
-      if( PrintAction(ap,fp,30) ) fprintf(fp,"\n");
+      if( PrintAction(ap,fp,30) ) lemon_bprintf(fp,"\n");
     }
-    fprintf(fp,"\n");
+    lemon_bprintf(fp,"\n");
   }
-  fprintf(fp, "----------------------------------------------------\n");
-  fprintf(fp, "Symbols:\n");
-  fprintf(fp, "The first-set of non-terminals is shown after the name.\n\n");
+  lemon_bprintf(fp, "----------------------------------------------------\n");
+  lemon_bprintf(fp, "Symbols:\n");
+  lemon_bprintf(fp, "The first-set of non-terminals is shown after the name.\n\n");
   for(i=0; i<lemp->nsymbol; i++){
     int j;
     struct symbol *sp;
 
     sp = lemp->symbols[i];
-    fprintf(fp, "  %3d: %s", i, sp->name);
+    lemon_bprintf(fp, "  %3d: %s", i, sp->name);
     if( sp->type==NONTERMINAL ){
-      fprintf(fp, ":");
+      lemon_bprintf(fp, ":");
       if( sp->lambda ){
-        fprintf(fp, " <lambda>");
+        lemon_bprintf(fp, " <lambda>");
       }
       for(j=0; j<lemp->nterminal; j++){
         if( sp->firstset && SetFind(sp->firstset, j) ){
-          fprintf(fp, " %s", lemp->symbols[j]->name);
+          lemon_bprintf(fp, " %s", lemp->symbols[j]->name);
         }
       }
     }
-    if( sp->prec>=0 ) fprintf(fp," (precedence=%d)", sp->prec);
-    fprintf(fp, "\n");
+    if( sp->prec>=0 ) lemon_bprintf(fp," (precedence=%d)", sp->prec);
+    lemon_bprintf(fp, "\n");
   }
-  fprintf(fp, "----------------------------------------------------\n");
-  fprintf(fp, "Syntax-only Symbols:\n");
-  fprintf(fp, "The following symbols never carry semantic content.\n\n");
+  lemon_bprintf(fp, "----------------------------------------------------\n");
+  lemon_bprintf(fp, "Syntax-only Symbols:\n");
+  lemon_bprintf(fp, "The following symbols never carry semantic content.\n\n");
   for(i=n=0; i<lemp->nsymbol; i++){
     int w;
     struct symbol *sp = lemp->symbols[i];
     if( sp->bContent ) continue;
     w = (int)strlen(sp->name);
     if( n>0 && n+w>75 ){
-      fprintf(fp,"\n");
+      lemon_bprintf(fp,"\n");
       n = 0;
     }
     if( n>0 ){
-      fprintf(fp, " ");
+      lemon_bprintf(fp, " ");
       n++;
     }
-    fprintf(fp, "%s", sp->name);
+    lemon_bprintf(fp, "%s", sp->name);
     n += w;
   }
-  if( n>0 ) fprintf(fp, "\n");
-  fprintf(fp, "----------------------------------------------------\n");
-  fprintf(fp, "Rules:\n");
+  if( n>0 ) lemon_bprintf(fp, "\n");
+  lemon_bprintf(fp, "----------------------------------------------------\n");
+  lemon_bprintf(fp, "Rules:\n");
   for(rp=lemp->rule; rp; rp=rp->next){
-    fprintf(fp, "%4d: ", rp->iRule);
+    lemon_bprintf(fp, "%4d: ", rp->iRule);
     rule_print(fp, rp);
-    fprintf(fp,".");
+    lemon_bprintf(fp,".");
     if( rp->precsym ){
-      fprintf(fp," [%s precedence=%d]",
+      lemon_bprintf(fp," [%s precedence=%d]",
               rp->precsym->name, rp->precsym->prec);
     }
-    fprintf(fp,"\n");
+    lemon_bprintf(fp,"\n");
   }
-  fclose(fp);
   return;
 }
 
@@ -3458,14 +4648,14 @@ PRIVATE char *pathsearch(char *argv0, char *name, int modemask)
   if( cp ){
     c = *cp;
     *cp = 0;
-    path = (char *)malloc( lemonStrlen(argv0) + lemonStrlen(name) + 2 );
+    path = (char *)lemon_malloc( lemonStrlen(argv0) + lemonStrlen(name) + 2 );
     if( path ) lemon_sprintf(path,"%s/%s",argv0,name);
     *cp = c;
   }else{
     pathlist = getenv("PATH");
     if( pathlist==0 ) pathlist = ".:/bin:/usr/bin";
-    pathbuf = (char *) malloc( lemonStrlen(pathlist) + 1 );
-    path = (char *)malloc( lemonStrlen(pathlist)+lemonStrlen(name)+2 );
+    pathbuf = (char *) lemon_malloc( lemonStrlen(pathlist) + 1 );
+    path = (char *)lemon_malloc( lemonStrlen(pathlist)+lemonStrlen(name)+2 );
     if( (pathbuf != 0) && (path!=0) ){
       pathbufptr = pathbuf;
       lemon_strcpy(pathbuf, pathlist);
@@ -3480,7 +4670,7 @@ PRIVATE char *pathsearch(char *argv0, char *name, int modemask)
         else pathbuf = &cp[1];
         if( access(path,modemask)==0 ) break;
       }
-      free(pathbufptr);
+      lemon_free(pathbufptr);
     }
   }
   return path;
@@ -3514,65 +4704,155 @@ PRIVATE int compute_action(struct lemon *lemp, struct action *ap)
   return act;
 }
 
-#define LINESIZE 1000
 /* The next cluster of routines are for reading the template file
-** and writing the results to the generated parser */
-/* The first function transfers data from "in" to "out" until
-** a line is seen which begins with "%%".  The line number is
-** tracked.
+** and writing the results to the generated parser.
 **
-** if name!=0, then any word that begin with "Parse" is changed to
-** begin with *name instead.
+** The template is read into memory once and split at each line that
+** begins with "%%" into sections.  While splitting, the offset of every
+** word that begins with "Parse" is recorded, so that emitting a section
+** is just a handful of block copies into the output buffer.
 */
-PRIVATE void tplt_xfer(char *name, FILE *in, FILE *out, int *lineno)
+struct tplt_section {
+  int iStart;              /* Offset of the first byte of the section */
+  int iEnd;                /* Offset one past the last byte */
+  int nLine;               /* Number of lines in the section */
+  int iSubst;              /* Index of the first entry in aSubst[] */
+  int nSubst;              /* Number of "Parse" words in the section */
+};
+struct tplt {
+  const char *z;                  /* Text of the template */
+  int nSection;                   /* Number of sections */
+  struct tplt_section *aSection;  /* The sections, in order */
+  int *aSubst;                    /* Offsets of every "Parse" word */
+  int iNext;                      /* The next section to emit */
+};
+
+/* Split the template text z[] into sections. */
+PRIVATE void tplt_split(struct tplt *p, const char *z)
 {
-  int i, iStart;
-  char line[LINESIZE];
-  while( fgets(line,LINESIZE,in) && (line[0]!='%' || line[1]!='%') ){
-    (*lineno)++;
-    iStart = 0;
-    if( name ){
-      for(i=0; line[i]; i++){
-        if( line[i]=='P' && strncmp(&line[i],"Parse",5)==0
-          && (i==0 || !ISALPHA(line[i-1]))
+  int i, nSection, nSubst;
+  struct tplt_section *pSec;
+
+  /* First pass:  count sections and "Parse" words so the arrays can be
+  ** sized exactly. */
+  nSection = 1;
+  nSubst = 0;
+  for(i=0; z[i]; i++){
+    if( (i==0 || z[i-1]=='\n') && z[i]=='%' && z[i+1]=='%' ) nSection++;
+    if( z[i]=='P' && strncmp(&z[i],"Parse",5)==0
+      && (i==0 || !ISALPHA(z[i-1]))
+    ){
+      nSubst++;
+    }
+  }
+  memset(p, 0, sizeof(*p));
+  p->z = z;
+  p->aSection = (struct tplt_section*)lemon_calloc(nSection, sizeof(p->aSection[0]));
+  p->aSubst = (int*)lemon_calloc(nSubst+1, sizeof(p->aSubst[0]));
+  if( p->aSection==0 || p->aSubst==0 ) memory_error();
+
+  /* Second pass:  record where each section starts and ends, its line
+  ** count and its substitutions. */
+  pSec = p->aSection;
+  nSubst = 0;
+  i = 0;
+  for(;;){
+    pSec->iStart = i;
+    pSec->iSubst = nSubst;
+    while( z[i] && (z[i]!='%' || z[i+1]!='%') ){
+      int iLine = i;
+      while( z[i] && z[i]!='\n' ){
+        if( z[i]=='P' && strncmp(&z[i],"Parse",5)==0
+          && (i==0 || !ISALPHA(z[i-1]))
         ){
-          if( i>iStart ) fprintf(out,"%.*s",i-iStart,&line[iStart]);
-          fprintf(out,"%s",name);
-          i += 4;
-          iStart = i+1;
+          p->aSubst[nSubst++] = i;
+          i += 5;
+        }else{
+          i++;
         }
       }
+      if( z[i] ) i++;
+      if( i>iLine ) pSec->nLine++;
+    }
+    pSec->iEnd = i;
+    pSec->nSubst = nSubst - pSec->iSubst;
+    p->nSection++;
+    if( z[i]==0 ) break;
+    /* Step over the "%%" line */
+    while( z[i] && z[i]!='\n' ) i++;
+    if( z[i] ) i++;
+    pSec++;
+  }
+}
+
+/* Transfer the next section of the template to "out".  The line number
+** is tracked.
+**
+** if name!=0, then any word that begin with "Parse" is changed to
+** begin with *name instead.
+*/
+PRIVATE void tplt_xfer(char *name, struct tplt *p, struct lemon_buf *out, int *lineno)
+{
+  struct tplt_section *pSec;
+  int i, iStart;
+  if( p->iNext>=p->nSection ) return;
+  pSec = &p->aSection[p->iNext++];
+  iStart = pSec->iStart;
+  if( name ){
+    int nName = lemonStrlen(name);
+    for(i=pSec->iSubst; i<pSec->iSubst+pSec->nSubst; i++){
+      int iSubst = p->aSubst[i];
+      lemon_bappend(out, &p->z[iStart], iSubst-iStart);
+      lemon_bappend(out, name, nName);
+      iStart = iSubst+5;
     }
-    fprintf(out,"%s",&line[iStart]);
   }
+  lemon_bappend(out, &p->z[iStart], pSec->iEnd-iStart);
+  *lineno += pSec->nLine;
 }
 
-/* The next function finds the template file and opens it, returning
-** a pointer to the opened file. */
-PRIVATE FILE *tplt_open(struct lemon *lemp)
+/* Read the whole of file zName into memory obtained from lemon_malloc().
+** Return NULL if the file cannot be opened or read. */
+PRIVATE char *file_read(const char *zName, int *pnByte)
 {
-  static char templatename[] = "lempar" TEMPLATE_EXTENSION;
-  char buf[1000];
   FILE *in;
-  char *tpltname;
+  long n;
+  char *z;
+  in = fopen(zName,"rb");
+  if( in==0 ) return 0;
+  fseek(in,0,SEEK_END);
+  n = ftell(in);
+  rewind(in);
+  z = (n<0 || n>100000000) ? 0 : (char*)lemon_malloc( n+1 );
+  if( z && (long)fread(z,1,n,in)!=n ){
+    lemon_free(z);
+    z = 0;
+  }
+  fclose(in);
+  if( z==0 ) return 0;
+  z[n] = 0;
+  if( pnByte ) *pnByte = (int)n;
+  return z;
+}
+
+/* The next function finds the template file.  Its name is written
+** into buf[] (which must hold at least 1000 bytes) or into memory from
+** lemon_malloc().  Return NULL if it cannot be found. */
+PRIVATE const char *tplt_name(struct lemon *lemp, char *buf)
+{
+  static char templatename[] = "lempar" TEMPLATE_EXTENSION;
+  const char *tpltname;
   char *cp;
 
   /* first, see if user specified a template filename on the command line. */
-  if (user_templatename != 0) {
-    if( access(user_templatename,004)==-1 ){
-      fprintf(stderr,"Can't find the parser driver template file \"%s\".\n",
-        user_templatename);
-      lemp->errorcnt++;
-      return 0;
-    }
-    in = fopen(user_templatename,"rb");
-    if( in==0 ){
-      fprintf(stderr,"Can't open the template file \"%s\".\n",
-              user_templatename);
+  if (lemon_ctx->user_templatename != 0) {
+    if( access(lemon_ctx->user_templatename,004)==-1 ){
+      lemon_error("Can't find the parser driver template file \"%s\".\n",
+        lemon_ctx->user_templatename);
       lemp->errorcnt++;
       return 0;
     }
-    return in;
+    return lemon_ctx->user_templatename;
   }
 
   cp = strrchr(lemp->filename,'.');
@@ -3589,18 +4869,32 @@ PRIVATE FILE *tplt_open(struct lemon *lemp)
     #ifdef HOMEBREW_TEMPLATE_PATH
     tpltname = HOMEBREW_TEMPLATE_PATH "lempar" TEMPLATE_EXTENSION ;
     #else
-    tpltname = pathsearch(lemp->argv0,templatename,0);
+    tpltname = lemp->argv0 ? pathsearch(lemp->argv0,templatename,0) : 0;
     #endif
   }
   if( tpltname==0 ){
-    fprintf(stderr,"Can't find the parser driver template file \"%s\".\n",
+    lemon_error("Can't find the parser driver template file \"%s\".\n",
     templatename);
     lemp->errorcnt++;
     return 0;
   }
-  in = fopen(tpltname,"rb");
+  return tpltname;
+}
+
+/* Find the template file and read it, returning its text in memory
+** obtained from lemon_malloc(). */
+PRIVATE char *tplt_open(struct lemon *lemp)
+{
+  char buf[1000];
+  const char *tpltname;
+  char *in;
+
+  tpltname = tplt_name(lemp, buf);
+  if( tpltname==0 ) return 0;
+  in = file_read(tpltname, 0);
   if( in==0 ){
-    fprintf(stderr,"Can't open the template file \"%s\".\n",templatename);
+    if( lemon_ctx->user_templatename==0 ) tpltname = "lempar" TEMPLATE_EXTENSION;
+    lemon_error("Can't open the template file \"%s\".\n",tpltname);
     lemp->errorcnt++;
     return 0;
   }
@@ -3608,28 +4902,28 @@ PRIVATE FILE *tplt_open(struct lemon *lemp)
 }
 
 /* Print a #line directive line to the output file. */
-PRIVATE void tplt_linedir(FILE *out, int lineno, char *filename)
+PRIVATE void tplt_linedir(struct lemon_buf *out, int lineno, char *filename)
 {
-  fprintf(out,"#line %d \"",lineno);
+  lemon_bprintf(out,"#line %d \"",lineno);
   while( *filename ){
-    if( *filename == '\\' ) putc('\\',out);
-    putc(*filename,out);
+    if( *filename == '\\' ) lemon_bputc(out,'\\');
+    lemon_bputc(out,*filename);
     filename++;
   }
-  fprintf(out,"\"\n");
+  lemon_bprintf(out,"\"\n");
 }
 
 /* Print a string to the file and keep the linenumber up to date */
-PRIVATE void tplt_print(FILE *out, struct lemon *lemp, char *str, int *lineno)
+PRIVATE void tplt_print(struct lemon_buf *out, struct lemon *lemp, char *str, int *lineno)
 {
+  int n;
   if( str==0 ) return;
-  while( *str ){
-    putc(*str,out);
-    if( *str=='\n' ) (*lineno)++;
-    str++;
+  for(n=0; str[n]; n++){
+    if( str[n]=='\n' ) (*lineno)++;
   }
-  if( str[-1]!='\n' ){
-    putc('\n',out);
+  lemon_bappend(out,str,n);
+  if( n==0 || str[n-1]!='\n' ){
+    lemon_bputc(out,'\n');
     (*lineno)++;
   }
   if (!lemp->nolinenosflag) {
@@ -3643,7 +4937,7 @@ PRIVATE void tplt_print(FILE *out, struct lemon *lemp, char *str, int *lineno)
 ** symbol sp
 */
 void emit_destructor_code(
-  FILE *out,
+  struct lemon_buf *out,
   struct symbol *sp,
   struct lemon *lemp,
   int *lineno
@@ -3653,10 +4947,10 @@ void emit_destructor_code(
  if( sp->type==TERMINAL ){
    cp = lemp->tokendest;
    if( cp==0 ) return;
-   fprintf(out,"{\n"); (*lineno)++;
+   lemon_bprintf(out,"{\n"); (*lineno)++;
  }else if( sp->destructor ){
    cp = sp->destructor;
-   fprintf(out,"{\n"); (*lineno)++;
+   lemon_bprintf(out,"{\n"); (*lineno)++;
    if( !lemp->nolinenosflag ){
      (*lineno)++;
      tplt_linedir(out,sp->destLineno,lemp->filename);
@@ -3664,24 +4958,24 @@ void emit_destructor_code(
  }else if( lemp->vardest ){
    cp = lemp->vardest;
    if( cp==0 ) return;
-   fprintf(out,"{\n"); (*lineno)++;
+   lemon_bprintf(out,"{\n"); (*lineno)++;
  }else{
    assert( 0 );  /* Cannot happen */
  }
  for(; *cp; cp++){
    if( *cp=='$' && cp[1]=='$' ){
-     fprintf(out,"(yypminor->yy%d)",sp->dtnum);
+     lemon_bprintf(out,"(yypminor->yy%d)",sp->dtnum);
      cp++;
      continue;
    }
    if( *cp=='\n' ) (*lineno)++;
-   fputc(*cp,out);
+   lemon_bputc(out,*cp);
  }
- fprintf(out,"\n"); (*lineno)++;
+ lemon_bprintf(out,"\n"); (*lineno)++;
  if (!lemp->nolinenosflag) {
    (*lineno)++; tplt_linedir(out,*lineno,lemp->outname);
  }
- fprintf(out,"}\n"); (*lineno)++;
+ lemon_bprintf(out,"}\n"); (*lineno)++;
  return;
 }
 
@@ -3713,14 +5007,14 @@ int has_destructor(struct symbol *sp, struct lemon *lemp)
 */
 PRIVATE char *append_str(const char *zText, int n, int p1, int p2){
   static char empty[1] = { 0 };
-  static char *z = 0;
-  static int alloced = 0;
-  static int used = 0;
+  struct lemon_context *ctx = lemon_ctx;
+  char *z = ctx->zAppend;
+  int used = ctx->nAppendUsed;
   int c;
   char zInt[40];
   if( zText==0 ){
     if( used==0 && z!=0 ) z[0] = 0;
-    used = 0;
+    ctx->nAppendUsed = 0;
     return z;
   }
   if( n<=0 ){
@@ -3730,9 +5024,9 @@ PRIVATE char *append_str(const char *zText, int n, int p1, int p2){
     }
     n = lemonStrlen(zText);
   }
-  if( (int) (n+sizeof(zInt)*2+used) >= alloced ){
-    alloced = n + sizeof(zInt)*2 + used + 200;
-    z = (char *) realloc(z,  alloced);
+  if( (int) (n+sizeof(zInt)*2+used) >= ctx->nAppendAlloc ){
+    ctx->nAppendAlloc = n + sizeof(zInt)*2 + used + 200;
+    z = ctx->zAppend = (char *) lemon_realloc(z, ctx->nAppendAlloc);
   }
   if( z==0 ) return empty;
   while( n-- > 0 ){
@@ -3749,6 +5043,7 @@ PRIVATE char *append_str(const char *zText, int n, int p1, int p2){
     }
   }
   z[used] = 0;
+  ctx->nAppendUsed = used;
   return z;
 }
 
@@ -4146,7 +5441,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
 ** the code to "out".  Make sure lineno stays up-to-date.
 */
 PRIVATE void emit_code(
-  FILE *out,
+  struct lemon_buf *out,
   struct rule *rp,
   struct lemon *lemp,
   int *lineno
@@ -4155,7 +5450,7 @@ PRIVATE void emit_code(
 
  /* Setup code prior to the #line directive */
  if( rp->codePrefix && rp->codePrefix[0] ){
-   fprintf(out, "{\n%s", rp->codePrefix);
+   lemon_bprintf(out, "{\n%s", rp->codePrefix);
    (*lineno)++;
    for(cp=rp->codePrefix; *cp; cp++){ if( *cp=='\n' ) (*lineno)++; }
  }
@@ -4167,9 +5462,9 @@ PRIVATE void emit_code(
      (*lineno)++;
      tplt_linedir(out,rp->line,lemp->filename);
    }
-   fprintf(out,"{%s",rp->code);
+   lemon_bprintf(out,"{%s",rp->code);
    for(cp=rp->code; *cp; cp++){ if( *cp=='\n' ) (*lineno)++; }
-   fprintf(out,"}\n"); (*lineno)++;
+   lemon_bprintf(out,"}\n"); (*lineno)++;
    if( !lemp->nolinenosflag ){
      (*lineno)++;
      tplt_linedir(out,*lineno,lemp->outname);
@@ -4178,12 +5473,12 @@ PRIVATE void emit_code(
 
  /* Generate breakdown code that occurs after the #line directive */
  if( rp->codeSuffix && rp->codeSuffix[0] ){
-   fprintf(out, "%s", rp->codeSuffix);
+   lemon_bprintf(out, "%s", rp->codeSuffix);
    for(cp=rp->codeSuffix; *cp; cp++){ if( *cp=='\n' ) (*lineno)++; }
  }
 
  if( rp->codePrefix && rp->codePrefix[0] ){
-   fprintf(out, "}\n"); (*lineno)++;
+   lemon_bprintf(out, "}\n"); (*lineno)++;
  }
 
  return;
@@ -4197,7 +5492,7 @@ PRIVATE void emit_code(
 ** symbol.
 */
 void print_stack_union(
-  FILE *out,                  /* The output stream */
+  struct lemon_buf *out,                  /* The output stream */
   struct lemon *lemp,         /* The main info structure for this parser */
   int *plineno,               /* Pointer to the line number */
   int mhflag                  /* True if generating makeheaders output */
@@ -4213,10 +5508,10 @@ void print_stack_union(
 
   /* Allocate and initialize types[] and allocate stddt[] */
   arraysize = lemp->nsymbol * 2;
-  types = (char**)calloc( arraysize, sizeof(char*) );
+  types = (char**)lemon_calloc( arraysize, sizeof(char*) );
   if( types==0 ){
-    fprintf(stderr,"Out of memory.\n");
-    exit(1);
+    lemon_error("Out of memory.\n");
+    lemon_exit(1);
   }
   for(i=0; i<arraysize; i++) types[i] = 0;
   maxdtlength = 0;
@@ -4230,10 +5525,10 @@ void print_stack_union(
     len = lemonStrlen(sp->datatype);
     if( len>maxdtlength ) maxdtlength = len;
   }
-  stddt = (char*)malloc( maxdtlength*2 + 1 );
+  stddt = (char*)lemon_malloc( maxdtlength*2 + 1 );
   if( stddt==0 ){
-    fprintf(stderr,"Out of memory.\n");
-    exit(1);
+    lemon_error("Out of memory.\n");
+    lemon_exit(1);
   }
 
   /* Build a hash table of datatypes. The ".dtnum" field of each symbol
@@ -4279,10 +5574,10 @@ void print_stack_union(
     }
     if( types[hash]==0 ){
       sp->dtnum = hash + 1;
-      types[hash] = (char*)malloc( lemonStrlen(stddt)+1 );
+      types[hash] = (char*)lemon_malloc( lemonStrlen(stddt)+1 );
       if( types[hash]==0 ){
-        fprintf(stderr,"Out of memory.\n");
-        exit(1);
+        lemon_error("Out of memory.\n");
+        lemon_exit(1);
       }
       lemon_strcpy(types[hash],stddt);
     }
@@ -4291,32 +5586,65 @@ void print_stack_union(
   /* Print out the definition of YYTOKENTYPE and YYMINORTYPE */
   name = lemp->name ? lemp->name : "Parse";
   lineno = *plineno;
-  if( mhflag ){ fprintf(out,"#if INTERFACE\n"); lineno++; }
-  fprintf(out,"#define %sTOKENTYPE %s\n",name,
+  if( mhflag ){ lemon_bprintf(out,"#if INTERFACE\n"); lineno++; }
+  lemon_bprintf(out,"#define %sTOKENTYPE %s\n",name,
     lemp->tokentype?lemp->tokentype:"void*");  lineno++;
-  if( mhflag ){ fprintf(out,"#endif\n"); lineno++; }
-  fprintf(out,"typedef union {\n"); lineno++;
-  fprintf(out,"  int yyinit;\n"); lineno++;
+  if( mhflag ){ lemon_bprintf(out,"#endif\n"); lineno++; }
+  lemon_bprintf(out,"typedef union {\n"); lineno++;
+  lemon_bprintf(out,"  int yyinit;\n"); lineno++;
   #ifdef LEMONPLUSPLUS
-  fprintf(out,"  yy_storage<%sTOKENTYPE>::type yy0;\n",name); lineno++;
+  lemon_bprintf(out,"  yy_storage<%sTOKENTYPE>::type yy0;\n",name); lineno++;
   #else
-  fprintf(out,"  %sTOKENTYPE yy0;\n",name); lineno++;
+  lemon_bprintf(out,"  %sTOKENTYPE yy0;\n",name); lineno++;
   #endif
   for(i=0; i<arraysize; i++){
     if( types[i]==0 ) continue;
     #ifdef LEMONPLUSPLUS
-    fprintf(out,"  yy_storage<%s>::type yy%d;\n",types[i],i+1); lineno++;
+    lemon_bprintf(out,"  yy_storage<%s>::type yy%d;\n",types[i],i+1); lineno++;
     #else
-    fprintf(out,"  %s yy%d;\n",types[i],i+1); lineno++;
+    lemon_bprintf(out,"  %s yy%d;\n",types[i],i+1); lineno++;
     #endif
-    free(types[i]);
   }
   if( lemp->errsym && lemp->errsym->useCnt ){
-    fprintf(out,"  int yy%d;\n",lemp->errsym->dtnum); lineno++;
+    lemon_bprintf(out,"  int yy%d;\n",lemp->errsym->dtnum); lineno++;
+  }
+  lemon_bprintf(out,"} YYMINORTYPE;\n"); lineno++;
+  #ifdef LEMONPLUSPLUS
+  /* When every type on the stack is trivially destructible, popping
+  ** an entry needs no code at all. */
+  lemon_bprintf(out,"static constexpr bool yyTrivialDestructors =\n"); lineno++;
+  lemon_bprintf(out,"  std::is_trivially_destructible<"
+    "yy_fix_type<%sTOKENTYPE>::type>::value", name);
+  for(i=0; i<arraysize; i++){
+    if( types[i]==0 ) continue;
+    lemon_bprintf(out,"\n  && std::is_trivially_destructible<"
+      "yy_fix_type<%s>::type>::value", types[i]); lineno++;
+  }
+  lemon_bprintf(out,";\n"); lineno++;
+  /* Otherwise clearing the stack runs yy_destructor() only on the
+  ** entries whose symbol has a destructor that does something. */
+  lemon_bprintf(out,"static constexpr bool yyNontrivialMinor[] = {\n"); lineno++;
+  for(i=0; i<lemp->nsymbol; i++){
+    struct symbol *sp = lemp->symbols[i];
+    if( sp==lemp->errsym ){
+      lemon_bprintf(out,"  /* %4d %s */ false,\n", i, sp->name); lineno++;
+    }else if( sp->dtnum==0 ){
+      lemon_bprintf(out,"  /* %4d %s */ !std::is_trivially_destructible<"
+        "yy_fix_type<%sTOKENTYPE>::type>::value,\n", i, sp->name, name);
+      lineno++;
+    }else{
+      lemon_bprintf(out,"  /* %4d %s */ !std::is_trivially_destructible<"
+        "yy_fix_type<%s>::type>::value,\n", i, sp->name, types[sp->dtnum-1]);
+      lineno++;
+    }
+  }
+  lemon_bprintf(out,"};\n"); lineno++;
+  #endif
+  for(i=0; i<arraysize; i++){
+    if( types[i] ) lemon_free(types[i]);
   }
-  free(stddt);
-  free(types);
-  fprintf(out,"} YYMINORTYPE;\n"); lineno++;
+  lemon_free(stddt);
+  lemon_free(types);
   *plineno = lineno;
 }
 
@@ -4361,6 +5689,7 @@ struct axset {
   int isTkn;           /* True to use tokens.  False for non-terminals */
   int nAction;         /* Number of actions */
   int iOrder;          /* Original order of action sets */
+  unsigned long nHit;  /* Lookups of this set counted by a profile */
 };
 
 /*
@@ -4370,6 +5699,9 @@ static int axset_compare(const void *a, const void *b){
   struct axset *p1 = (struct axset*)a;
   struct axset *p2 = (struct axset*)b;
   int c;
+  c = (p1->nAction==0) - (p2->nAction==0);
+  if( c ) return c;
+  if( p1->nHit!=p2->nHit ) return p1->nHit>p2->nHit ? -1 : 1;
   c = p2->nAction - p1->nAction;
   if( c==0 ){
     c = p1->iOrder - p2->iOrder;
@@ -4378,38 +5710,458 @@ static int axset_compare(const void *a, const void *b){
   return c;
 }
 
+/*
+** One terminal action of a state, tagged with the terminal's current
+** class.  Used to split the classes in TokenClasses().
+*/
+struct tknact {
+  int iClass;          /* Class of the terminal so far */
+  int action;          /* The action, as computed by compute_action() */
+  int iTkn;            /* The terminal */
+};
+
+static int tknact_compare(const void *a, const void *b){
+  const struct tknact *p1 = (const struct tknact*)a;
+  const struct tknact *p2 = (const struct tknact*)b;
+  if( p1->iClass!=p2->iClass ) return p1->iClass - p2->iClass;
+  if( p1->action!=p2->action ) return p1->action - p2->action;
+  return p1->iTkn - p2->iTkn;
+}
+
+/*
+** Partition the terminals into classes of terminals that have the same
+** action in every state, and write the class of each terminal into
+** aClass[].  Return the number of classes.  The token rows of the
+** action table are then built over classes instead of terminals.
+**
+** All terminals start out in one class.  Each state splits every class
+** by the action the state takes on its members; terminals with no
+** action in the state stay where they are.  Classes are numbered in
+** the order of their lowest terminal, so $ is always class 0.
+*/
+PRIVATE int TokenClasses(struct lemon *lemp, int *aClass){
+  int nt = lemp->nterminal;
+  int *aSize;           /* Number of terminals in each class */
+  int *aMap;            /* Renumbering of the classes */
+  struct tknact *aTa;   /* Terminal actions of one state */
+  int nClass = 1;
+  int i, j, k, n;
+
+  aSize = (int *) lemon_calloc(nt*2, sizeof(int));
+  aTa = (struct tknact *) lemon_calloc(nt, sizeof(aTa[0]));
+  if( aSize==0 || aTa==0 ){
+    lemon_error("malloc failed\n");
+    lemon_exit(1);
+  }
+  aMap = &aSize[nt];
+  for(i=0; i<nt; i++) aClass[i] = 0;
+  aSize[0] = nt;
+  for(i=0; i<lemp->nxstate; i++){
+    struct action *ap;
+    n = 0;
+    for(ap=lemp->sorted[i]->ap; ap; ap=ap->next){
+      int action;
+      if( ap->sp->index>=nt ) continue;
+      action = compute_action(lemp, ap);
+      if( action<0 ) continue;
+      aTa[n].iClass = aClass[ap->sp->index];
+      aTa[n].action = action;
+      aTa[n].iTkn = ap->sp->index;
+      n++;
+    }
+    qsort(aTa, n, sizeof(aTa[0]), tknact_compare);
+    for(j=0; j<n; j=k){
+      int c = aTa[j].iClass;
+      for(k=j+1; k<n && aTa[k].iClass==c && aTa[k].action==aTa[j].action; k++){}
+      /* A group that is all that is left of its class keeps the class */
+      if( k-j==aSize[c] ) continue;
+      aSize[c] -= k-j;
+      aSize[nClass] = k-j;
+      for(; j<k; j++) aClass[aTa[j].iTkn] = nClass;
+      nClass++;
+    }
+  }
+  for(i=0; i<nClass; i++) aMap[i] = -1;
+  for(i=n=0; i<nt; i++){
+    if( aMap[aClass[i]]<0 ) aMap[aClass[i]] = n++;
+    aClass[i] = aMap[aClass[i]];
+  }
+  lemon_free(aSize);
+  lemon_free(aTa);
+  return n;
+}
+
 /*
 ** Write text on "out" that describes the rule "rp".
 */
-static void writeRuleText(FILE *out, struct rule *rp){
+static void writeRuleText(struct lemon_buf *out, struct rule *rp){
   int j;
-  fprintf(out,"%s ::=", rp->lhs->name);
+  lemon_bprintf(out,"%s ::=", rp->lhs->name);
   for(j=0; j<rp->nrhs; j++){
     struct symbol *sp = rp->rhs[j];
     if( sp->type!=MULTITERMINAL ){
-      fprintf(out," %s", sp->name);
+      lemon_bprintf(out," %s", sp->name);
     }else{
       int k;
-      fprintf(out," %s", sp->subsym[0]->name);
+      lemon_bprintf(out," %s", sp->subsym[0]->name);
       for(k=1; k<sp->nsubsym; k++){
-        fprintf(out,"|%s",sp->subsym[k]->name);
+        lemon_bprintf(out,"|%s",sp->subsym[k]->name);
+      }
+    }
+  }
+}
+
+
+/*
+** The keyword lookup emitted for %keywords is a minimal perfect hash
+** built by "hash and displace".  Each spelling is hashed with FNV-1a,
+** with ASCII letters folded to lower case.  The hash picks a bucket,
+** and the bucket's displacement, chosen here, moves every keyword in
+** the bucket to its own slot.  There are exactly as many slots as
+** keywords, so a lookup is one hash, one table probe and one compare.
+**
+** keyword_hash() and keyword_slot() must agree with the code written
+** by ReportKeywords().
+*/
+PRIVATE unsigned long keyword_hash(const char *z, unsigned long basis){
+  unsigned long h = basis;
+  for(; *z; z++){
+    h = ((h ^ (unsigned char)KEYWORD_FOLD(*z)) * 16777619UL) & 0xffffffffUL;
+  }
+  return h;
+}
+PRIVATE int keyword_slot(unsigned long h, unsigned long d, int nSlot){
+  unsigned long x = ((h ^ d) * 0x9e3779b1UL) & 0xffffffffUL;
+  x ^= x>>15;
+  return (int)(x % (unsigned long)nSlot);
+}
+
+/*
+** Search for a basis and a displacement for each of nBucket buckets
+** such that the nkeyword keywords land in distinct slots.  Return true
+** and fill in *pBasis, aDisp[] and aSlot[] (the slot of each keyword)
+** on success.
+*/
+PRIVATE int keyword_search(
+  struct lemon *lemp,
+  unsigned long basis,
+  int nBucket,
+  unsigned long *aHash,     /* Scratch space for nkeyword hashes */
+  int *aOrder,              /* Scratch space for nBucket bucket numbers */
+  int *aSize,               /* Scratch space for nBucket bucket sizes */
+  char *aUsed,              /* Scratch space for nkeyword flags */
+  unsigned int *aDisp,      /* OUT: Displacement for each bucket */
+  int *aSlot                /* OUT: Slot for each keyword */
+){
+  int nKw = lemp->nkeyword;
+  int i, j, k, b;
+  unsigned long d;
+
+  memset(aSize, 0, sizeof(int)*nBucket);
+  memset(aUsed, 0, nKw);
+  for(i=0; i<nKw; i++){
+    aHash[i] = keyword_hash(lemp->keywords[i]->keyword, basis);
+    aSize[aHash[i] % nBucket]++;
+  }
+  /* Place the largest buckets first, while the most slots are free */
+  for(i=0; i<nBucket; i++){
+    for(j=i; j>0 && aSize[aOrder[j-1]]<aSize[i]; j--) aOrder[j] = aOrder[j-1];
+    aOrder[j] = i;
+  }
+  for(i=0; i<nBucket && aSize[aOrder[i]]>0; i++){
+    b = aOrder[i];
+    for(d=0; d<=0xffff; d++){
+      for(j=0; j<nKw; j++){
+        if( (int)(aHash[j] % nBucket)!=b ) continue;
+        k = keyword_slot(aHash[j], d, nKw);
+        if( aUsed[k] ) break;
+        aUsed[k] = 1;
+        aSlot[j] = k;
+      }
+      if( j==nKw ) break;
+      /* Undo the partial placement and try the next displacement */
+      while( j-- > 0 ){
+        if( (int)(aHash[j] % nBucket)==b ) aUsed[aSlot[j]] = 0;
       }
     }
+    if( d>0xffff ) return 0;
+    aDisp[b] = (unsigned int)d;
   }
+  return 1;
+}
+
+/*
+** Write a C string literal holding z, escaping as needed.
+*/
+PRIVATE void keyword_cstring(struct lemon_buf *out, const char *z){
+  for(; *z; z++){
+    unsigned char c = (unsigned char)*z;
+    if( c=='"' || c=='\\' ){
+      lemon_bprintf(out, "\\%c", c);
+    }else if( c<0x20 || c>=0x7f ){
+      lemon_bprintf(out, "\\%03o", c);
+    }else{
+      lemon_bputc(out, c);
+    }
+  }
+}
+
+/*
+** Generate the keyword lookup function ParseKeywordCode() for the
+** tokens named by %keywords.
+*/
+PRIVATE void ReportKeywords(
+  struct lemon *lemp,
+  struct lemon_buf *out,
+  int *plineno
+){
+  int nKw = lemp->nkeyword;
+  int nBucket, nTry;
+  int i, n, mn, mx, nText;
+  unsigned long basis = 2166136261UL;
+  char zBasis[9];
+  unsigned long *aHash;
+  int *aOrder, *aSize, *aSlot, *aKw, *aOffset;
+  unsigned int *aDisp;
+  char *aUsed;
+  const char *name = lemp->name ? lemp->name : "Parse";
+  int lineno = *plineno;
+
+  aHash = (unsigned long*)lemon_calloc(nKw, sizeof(aHash[0]));
+  aOrder = (int*)lemon_calloc(nKw, sizeof(int));
+  aSize = (int*)lemon_calloc(nKw, sizeof(int));
+  aSlot = (int*)lemon_calloc(nKw, sizeof(int));
+  aKw = (int*)lemon_calloc(nKw, sizeof(int));
+  aOffset = (int*)lemon_calloc(nKw, sizeof(int));
+  aDisp = (unsigned int*)lemon_calloc(nKw, sizeof(aDisp[0]));
+  aUsed = (char*)lemon_calloc(nKw, 1);
+  MemoryCheck(aUsed);
+
+  /* About two keywords per bucket.  If no displacements are found, try
+  ** another basis, and every few tries add a bucket. */
+  nBucket = (nKw+1)/2;
+  for(nTry=0; !keyword_search(lemp, basis, nBucket, aHash, aOrder, aSize,
+                              aUsed, aDisp, aSlot); nTry++){
+    basis = (basis + 0x9e3779b9UL) & 0xffffffffUL;
+    if( nTry%8==7 && nBucket<nKw ) nBucket++;
+  }
+
+  for(i=0; i<8; i++) zBasis[i] = "0123456789abcdef"[(basis>>(28-4*i))&0xf];
+  zBasis[8] = 0;
+  mn = 255;
+  mx = nText = 0;
+  for(i=0; i<nKw; i++){
+    n = lemonStrlen(lemp->keywords[i]->keyword);
+    if( n<mn ) mn = n;
+    if( n>mx ) mx = n;
+    aKw[aSlot[i]] = i;
+    aOffset[i] = nText;
+    nText += n;
+  }
+
+  lemon_bprintf(out,
+    "\n/* Keyword lookup generated from %%keywords.  %sKeywordCode(z,n)\n"
+    "** returns the token code of the n-byte keyword at z[], or 0 if z[]\n"
+    "** is not a keyword.  Letters must match in case unless\n"
+    "** YYKEYWORDNOCASE is defined. */\n", name); lineno += 5;
+  lemon_bprintf(out, "#define YYNKEYWORD %d\n", nKw); lineno++;
+  lemon_bprintf(out, "static const char yyKwText[] =\n  \""); lineno++;
+  for(i=n=0; i<nKw; i++){
+    const char *z = lemp->keywords[i]->keyword;
+    n += lemonStrlen(z);
+    if( n>70 && i>0 ){
+      lemon_bprintf(out, "\"\n  \""); lineno++;
+      n = lemonStrlen(z);
+    }
+    keyword_cstring(out, z);
+  }
+  lemon_bprintf(out, "\";\n"); lineno++;
+  for(i=n=0; i<nBucket; i++){
+    if( (int)aDisp[i]>n ) n = (int)aDisp[i];
+  }
+  lemon_bprintf(out, "static const %s yyKwDisp[%d] = {",
+    minimum_size_type(0, n, 0), nBucket);
+  for(i=0; i<nBucket; i++){
+    if( i%10==0 ){ lemon_bprintf(out, "\n "); lineno++; }
+    lemon_bprintf(out, " %5d,", (int)aDisp[i]);
+  }
+  lemon_bprintf(out, "\n};\n"); lineno += 2;
+  lemon_bprintf(out, "static const %s yyKwOffset[%d] = {",
+    minimum_size_type(0, nText, 0), nKw);
+  for(i=0; i<nKw; i++){
+    if( i%10==0 ){ lemon_bprintf(out, "\n "); lineno++; }
+    lemon_bprintf(out, " %5d,", aOffset[aKw[i]]);
+  }
+  lemon_bprintf(out, "\n};\n"); lineno += 2;
+  lemon_bprintf(out, "static const unsigned char yyKwLen[%d] = {", nKw);
+  for(i=0; i<nKw; i++){
+    if( i%10==0 ){ lemon_bprintf(out, "\n "); lineno++; }
+    lemon_bprintf(out, " %3d,",
+      lemonStrlen(lemp->keywords[aKw[i]]->keyword));
+  }
+  lemon_bprintf(out, "\n};\n"); lineno += 2;
+  lemon_bprintf(out, "static const %s yyKwCode[%d] = {\n",
+    minimum_size_type(0, lemp->nterminal, 0), nKw); lineno++;
+  for(i=0; i<nKw; i++){
+    struct symbol *sp = lemp->keywords[aKw[i]];
+    lemon_bprintf(out, "  %4d,  /* %3d: %s */\n", sp->index, i, sp->name);
+    lineno++;
+  }
+  lemon_bprintf(out, "};\n"); lineno++;
+  lemon_bprintf(out,
+    "int %sKeywordCode(const char *z, int n){\n"
+    "  unsigned int h = 0x%su, x;\n"
+    "  const char *zKw;\n"
+    "  int i;\n"
+    "  if( n<%d || n>%d ) return 0;\n"
+    "  for(i=0; i<n; i++){\n"
+    "    unsigned char c = (unsigned char)z[i];\n"
+    "    if( c>='A' && c<='Z' ) c += 0x20;\n"
+    "    h = (h ^ c)*16777619u;\n"
+    "  }\n"
+    "  x = (h ^ yyKwDisp[h %% %du])*0x9e3779b1u;\n"
+    "  x ^= x>>15;\n"
+    "  h = x %% %du;\n"
+    "  if( yyKwLen[h]!=n ) return 0;\n"
+    "  zKw = &yyKwText[yyKwOffset[h]];\n"
+    "  for(i=0; i<n; i++){\n"
+    "    unsigned char a = (unsigned char)z[i];\n"
+    "    unsigned char b = (unsigned char)zKw[i];\n"
+    "#ifdef YYKEYWORDNOCASE\n"
+    "    if( a>='A' && a<='Z' ) a += 0x20;\n"
+    "    if( b>='A' && b<='Z' ) b += 0x20;\n"
+    "#endif\n"
+    "    if( a!=b ) return 0;\n"
+    "  }\n"
+    "  return yyKwCode[h];\n"
+    "}\n",
+    name, zBasis, mn, mx, nBucket, nKw); lineno += 26;
+  *plineno = lineno;
+
+  lemon_free(aHash);
+  lemon_free(aOrder);
+  lemon_free(aSize);
+  lemon_free(aSlot);
+  lemon_free(aKw);
+  lemon_free(aOffset);
+  lemon_free(aDisp);
+  lemon_free(aUsed);
 }
 
+/*
+** Compare two rules by the number of reductions a profile counted, most
+** first, and then by rule number.
+*/
+static int ruleHitCompare(const void *a, const void *b){
+  const struct rule *pA = *(const struct rule**)a;
+  const struct rule *pB = *(const struct rule**)b;
+  if( pA->nHit!=pB->nHit ) return pA->nHit>pB->nHit ? -1 : 1;
+  return pA->iRule - pB->iRule;
+}
+
+/*
+** Return the rules in the order that their reduce code is generated: the
+** order of lemp->rule, or with a profile, the rules reduced most often
+** first.  The array ends with a NULL and is from lemon_malloc().
+*/
+PRIVATE struct rule **rule_emit_order(struct lemon *lemp)
+{
+  struct rule **aRule;
+  struct rule *rp;
+  int n = 0;
+
+  aRule = (struct rule**)lemon_malloc( sizeof(aRule[0])*(lemp->nrule+1) );
+  MemoryCheck(aRule);
+  for(rp=lemp->rule; rp; rp=rp->next) aRule[n++] = rp;
+  assert( n==lemp->nrule );
+  if( lemp->profiled ) qsort(aRule, n, sizeof(aRule[0]), ruleHitCompare);
+  aRule[n] = 0;
+  return aRule;
+}
+
+/*
+** Generate each REDUCE action as a function of its own, for the -R
+** option, followed by yyReduceTable[], which maps rule numbers to those
+** functions.  Rules with the same code share a function.  Rules with no
+** code get a NULL entry, so yy_reduce() calls nothing for them.  The
+** template defines YYREDUCEACTION(N), which starts the function for rule
+** N, YYREDUCEREF(N), which names it, YYREDUCETABLEDEF, which starts
+** the definition of the table, and YYREDUCEBEGIN and YYREDUCEEND, which
+** go around all of it.
+*/
+PRIVATE void ReportReduceTable(
+  struct lemon *lemp,
+  struct lemon_buf *out,
+  int *plineno
+){
+  struct rule *rp, *rp2;
+  struct rule **aRule;          /* Rules in the order their code goes out */
+  int *aFunc;                   /* Rule whose function each rule calls */
+  const char *name = lemp->name ? lemp->name : "Parse";
+  int i, k;
+
+  aFunc = (int*)lemon_malloc( sizeof(int)*(lemp->nrule+1) );
+  MemoryCheck(aFunc);
+  for(i=0; i<lemp->nrule; i++) aFunc[i] = -1;
+  aRule = rule_emit_order(lemp);
+  lemon_bprintf(out,"YYREDUCEBEGIN\n"); (*plineno)++;
+  for(i=0; (rp = aRule[i])!=0; i++){
+    if( rp->codeEmitted || rp->noCode ) continue;
+    lemon_bprintf(out,"/* (%d) ", rp->iRule);
+    writeRuleText(out, rp);
+    lemon_bprintf(out," */\n"); (*plineno)++;
+    aFunc[rp->iRule] = rp->iRule;
+    for(k=i+1; (rp2 = aRule[k])!=0; k++){
+      if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
+             && rp2->codeSuffix==rp->codeSuffix ){
+        lemon_bprintf(out,"/* (%d) ", rp2->iRule);
+        writeRuleText(out, rp2);
+        lemon_bprintf(out," */\n"); (*plineno)++;
+        aFunc[rp2->iRule] = rp->iRule;
+        rp2->codeEmitted = 1;
+      }
+    }
+    lemon_bprintf(out,"YYREDUCEACTION(%d){\n", rp->iRule); (*plineno)++;
+    lemon_bprintf(out,"  %sARG_FETCH\n", name); (*plineno)++;
+    if( rp->lhsMinor ){
+      lemon_bprintf(out,"  YYMINORTYPE yylhsminor;\n"); (*plineno)++;
+    }
+    emit_code(out,rp,lemp,plineno);
+    lemon_bprintf(out,"  %sARG_STORE\n", name); (*plineno)++;
+    lemon_bprintf(out,"}\n"); (*plineno)++;
+    rp->codeEmitted = 1;
+  }
+  lemon_bprintf(out,"YYREDUCETABLEDEF = {\n");
+  (*plineno)++;
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( aFunc[rp->iRule]>=0 ){
+      lemon_bprintf(out,"  YYREDUCEREF(%d),", aFunc[rp->iRule]);
+    }else{
+      lemon_bprintf(out,"  0,");
+    }
+    lemon_bprintf(out," /* (%d) ", rp->iRule);
+    writeRuleText(out, rp);
+    lemon_bprintf(out," */\n"); (*plineno)++;
+  }
+  lemon_bprintf(out,"};\n"); (*plineno)++;
+  lemon_bprintf(out,"YYREDUCEEND\n"); (*plineno)++;
+  lemon_free(aRule);
+  lemon_free(aFunc);
+}
 
 /* Generate C source code for the parser */
 void ReportTable(
   struct lemon *lemp,
-  int mhflag     /* Output in makeheaders format if true */
+  int mhflag,            /* Output in makeheaders format if true */
+  const char *zTemplate, /* Text of the driver template */
+  struct lemon_buf *out  /* Write the parser here */
 ){
-  FILE *out, *in;
-  char line[LINESIZE];
+  struct tplt in;
   int  lineno;
   struct state *stp;
   struct action *ap;
   struct rule *rp;
+  struct rule **aRule;  /* Rules in the order their code goes out */
   struct acttab *pActtab;
   int i, j, n, sz;
   int nLookAhead;
@@ -4419,6 +6171,9 @@ void ReportTable(
   int mnTknOfst, mxTknOfst;
   int mnNtOfst, mxNtOfst;
   struct axset *ax;
+  int *aClass = 0;      /* Class of each terminal, if classes are used */
+  int *aSeen = 0;       /* Row in which each class was last added */
+  int nTknCol;          /* Columns of the token rows: classes or terminals */
 
   lemp->minShiftReduce = lemp->nstate;
   lemp->errAction = lemp->minShiftReduce + lemp->nrule;
@@ -4427,133 +6182,167 @@ void ReportTable(
   lemp->minReduce = lemp->noAction + 1;
   lemp->maxAction = lemp->minReduce + lemp->nrule;
 
-  in = tplt_open(lemp);
-  if( in==0 ) return;
-  out = file_open(lemp,FILE_EXTENSION,"wb");
-  if( out==0 ){
-    fclose(in);
-    return;
+  /* Merge terminals that always take the same action */
+  nTknCol = lemp->nterminal;
+  if( lemp->tokenClasses ){
+    aClass = (int *) lemon_calloc(lemp->nterminal*2, sizeof(int));
+    if( aClass==0 ){
+      lemon_error("malloc failed\n");
+      lemon_exit(1);
+    }
+    aSeen = &aClass[lemp->nterminal];
+    lemp->nclass = nTknCol = TokenClasses(lemp, aClass);
+    if( nTknCol==lemp->nterminal ){
+      /* Nothing merged.  Leave out yy_token_class[] */
+      lemon_free(aClass);
+      aClass = aSeen = 0;
+    }
   }
+
+  if( lemp->outname ) lemon_free(lemp->outname);
+  lemp->outname = file_makename(lemp, FILE_EXTENSION);
+  tplt_split(&in, zTemplate);
   lineno = 1;
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate the include code, if any */
   tplt_print(out,lemp,lemp->include,&lineno);
   if( mhflag ){
     char *incName = file_makename(lemp, ".h");
-    fprintf(out,"#include \"%s\"\n", incName); lineno++;
-    free(incName);
+    lemon_bprintf(out,"#include \"%s\"\n", incName); lineno++;
+    lemon_free(incName);
   }
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate #defines for all tokens */
   if( mhflag ){
     const char *prefix;
-    fprintf(out,"#if INTERFACE\n"); lineno++;
+    lemon_bprintf(out,"#if INTERFACE\n"); lineno++;
     if( lemp->tokenprefix ) prefix = lemp->tokenprefix;
     else                    prefix = "";
     for(i=1; i<lemp->nterminal; i++){
-      fprintf(out,"#define %s%-30s %2d\n",prefix,lemp->symbols[i]->name,i);
+      lemon_bprintf(out,"#define %s%-30s %2d\n",prefix,lemp->symbols[i]->name,i);
       lineno++;
     }
-    fprintf(out,"#endif\n"); lineno++;
+    lemon_bprintf(out,"#endif\n"); lineno++;
   }
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate the defines */
-  fprintf(out,"#define YYCODETYPE %s\n",
+  lemon_bprintf(out,"#define YYCODETYPE %s\n",
     minimum_size_type(0, lemp->nsymbol, &szCodeType)); lineno++;
-  fprintf(out,"#define YYNOCODE %d\n",lemp->nsymbol);  lineno++;
-  fprintf(out,"#define YYACTIONTYPE %s\n",
+  lemon_bprintf(out,"#define YYNOCODE %d\n",lemp->nsymbol);  lineno++;
+  lemon_bprintf(out,"#define YYACTIONTYPE %s\n",
     minimum_size_type(0,lemp->maxAction,&szActionType)); lineno++;
   if( lemp->wildcard ){
-    fprintf(out,"#define YYWILDCARD %d\n",
+    lemon_bprintf(out,"#define YYWILDCARD %d\n",
        lemp->wildcard->index); lineno++;
   }
   print_stack_union(out,lemp,&lineno,mhflag);
-  fprintf(out, "#ifndef YYSTACKDEPTH\n"); lineno++;
+  lemon_bprintf(out, "#ifndef YYSTACKDEPTH\n"); lineno++;
   if( lemp->stacksize ){
-    fprintf(out,"#define YYSTACKDEPTH %s\n",lemp->stacksize);  lineno++;
+    lemon_bprintf(out,"#define YYSTACKDEPTH %s\n",lemp->stacksize);  lineno++;
   }else{
-    fprintf(out,"#define YYSTACKDEPTH 100\n");  lineno++;
+    lemon_bprintf(out,"#define YYSTACKDEPTH 100\n");  lineno++;
   }
-  fprintf(out, "#endif\n"); lineno++;
+  lemon_bprintf(out, "#endif\n"); lineno++;
   if( mhflag ){
-    fprintf(out,"#if INTERFACE\n"); lineno++;
+    lemon_bprintf(out,"#if INTERFACE\n"); lineno++;
   }
   name = lemp->name ? lemp->name : "Parse";
   if( lemp->arg && lemp->arg[0] ){
     i = lemonStrlen(lemp->arg);
     while( i>=1 && ISSPACE(lemp->arg[i-1]) ) i--;
     while( i>=1 && (ISALNUM(lemp->arg[i-1]) || lemp->arg[i-1]=='_') ) i--;
-    fprintf(out,"#define %sARG_SDECL %s;\n",name,lemp->arg);  lineno++;
-    fprintf(out,"#define %sARG_PDECL ,%s\n",name,lemp->arg);  lineno++;
-    fprintf(out,"#define %sARG_PARAM ,%s\n",name,&lemp->arg[i]);  lineno++;
-    fprintf(out,"#define %sARG_FETCH %s=yypParser->%s;\n",
+    lemon_bprintf(out,"#define %sARG_SDECL %s;\n",name,lemp->arg);  lineno++;
+    lemon_bprintf(out,"#define %sARG_PDECL ,%s\n",name,lemp->arg);  lineno++;
+    lemon_bprintf(out,"#define %sARG_PARAM ,%s\n",name,&lemp->arg[i]);  lineno++;
+    lemon_bprintf(out,"#define %sARG_FETCH %s=yypParser->%s;\n",
                  name,lemp->arg,&lemp->arg[i]);  lineno++;
-    fprintf(out,"#define %sARG_STORE yypParser->%s=%s;\n",
+    lemon_bprintf(out,"#define %sARG_STORE yypParser->%s=%s;\n",
                  name,&lemp->arg[i],&lemp->arg[i]);  lineno++;
   }else{
-    fprintf(out,"#define %sARG_SDECL\n",name); lineno++;
-    fprintf(out,"#define %sARG_PDECL\n",name); lineno++;
-    fprintf(out,"#define %sARG_PARAM\n",name); lineno++;
-    fprintf(out,"#define %sARG_FETCH\n",name); lineno++;
-    fprintf(out,"#define %sARG_STORE\n",name); lineno++;
+    lemon_bprintf(out,"#define %sARG_SDECL\n",name); lineno++;
+    lemon_bprintf(out,"#define %sARG_PDECL\n",name); lineno++;
+    lemon_bprintf(out,"#define %sARG_PARAM\n",name); lineno++;
+    lemon_bprintf(out,"#define %sARG_FETCH\n",name); lineno++;
+    lemon_bprintf(out,"#define %sARG_STORE\n",name); lineno++;
   }
   if( lemp->ctx && lemp->ctx[0] ){
     i = lemonStrlen(lemp->ctx);
     while( i>=1 && ISSPACE(lemp->ctx[i-1]) ) i--;
     while( i>=1 && (ISALNUM(lemp->ctx[i-1]) || lemp->ctx[i-1]=='_') ) i--;
-    fprintf(out,"#define %sCTX_SDECL %s;\n",name,lemp->ctx);  lineno++;
-    fprintf(out,"#define %sCTX_PDECL ,%s\n",name,lemp->ctx);  lineno++;
-    fprintf(out,"#define %sCTX_PARAM ,%s\n",name,&lemp->ctx[i]);  lineno++;
-    fprintf(out,"#define %sCTX_FETCH %s=yypParser->%s;\n",
+    lemon_bprintf(out,"#define %sCTX_SDECL %s;\n",name,lemp->ctx);  lineno++;
+    lemon_bprintf(out,"#define %sCTX_PDECL ,%s\n",name,lemp->ctx);  lineno++;
+    lemon_bprintf(out,"#define %sCTX_PARAM ,%s\n",name,&lemp->ctx[i]);  lineno++;
+    lemon_bprintf(out,"#define %sCTX_FETCH %s=yypParser->%s;\n",
                  name,lemp->ctx,&lemp->ctx[i]);  lineno++;
-    fprintf(out,"#define %sCTX_STORE yypParser->%s=%s;\n",
+    lemon_bprintf(out,"#define %sCTX_STORE yypParser->%s=%s;\n",
                  name,&lemp->ctx[i],&lemp->ctx[i]);  lineno++;
   }else{
-    fprintf(out,"#define %sCTX_SDECL\n",name); lineno++;
-    fprintf(out,"#define %sCTX_PDECL\n",name); lineno++;
-    fprintf(out,"#define %sCTX_PARAM\n",name); lineno++;
-    fprintf(out,"#define %sCTX_FETCH\n",name); lineno++;
-    fprintf(out,"#define %sCTX_STORE\n",name); lineno++;
+    lemon_bprintf(out,"#define %sCTX_SDECL\n",name); lineno++;
+    lemon_bprintf(out,"#define %sCTX_PDECL\n",name); lineno++;
+    lemon_bprintf(out,"#define %sCTX_PARAM\n",name); lineno++;
+    lemon_bprintf(out,"#define %sCTX_FETCH\n",name); lineno++;
+    lemon_bprintf(out,"#define %sCTX_STORE\n",name); lineno++;
   }
   if( mhflag ){
-    fprintf(out,"#endif\n"); lineno++;
+    lemon_bprintf(out,"#endif\n"); lineno++;
   }
   if( lemp->errsym && lemp->errsym->useCnt ){
-    fprintf(out,"#define YYERRORSYMBOL %d\n",lemp->errsym->index); lineno++;
-    fprintf(out,"#define YYERRSYMDT yy%d\n",lemp->errsym->dtnum); lineno++;
+    lemon_bprintf(out,"#define YYERRORSYMBOL %d\n",lemp->errsym->index); lineno++;
+    lemon_bprintf(out,"#define YYERRSYMDT yy%d\n",lemp->errsym->dtnum); lineno++;
   }
   if( lemp->has_fallback ){
-    fprintf(out,"#define YYFALLBACK 1\n");  lineno++;
+    lemon_bprintf(out,"#define YYFALLBACK 1\n");  lineno++;
+  }
+  if( lemp->nfolded>=0 ){
+    lemon_bprintf(out,"#define YYFALLBACKFOLDED 1\n");  lineno++;
+  }
+  if( lemp->recognizer ){
+    lemon_bprintf(out,"#define YYRECOGNIZER 1\n");  lineno++;
+  }
+  if( lemp->reduceTable ){
+    lemon_bprintf(out,"#define YYREDUCETABLE 1\n");  lineno++;
+  }
+  if( lemp->stackBound>0 ){
+    lemon_bprintf(out,"#define YYSTACKDEPTH_BOUND %d\n",lemp->stackBound);
+    lineno++;
+  }
+  if( lemp->stackHeadroom>0 ){
+    lemon_bprintf(out,"#define YYSTACKHEADROOM %d\n",lemp->stackHeadroom);
+    lineno++;
   }
 
   /* Compute the action table, but do not output it yet.  The action
   ** table must be computed before generating the YYNSTATE macro because
   ** we need to know how many states can be eliminated.
   */
-  ax = (struct axset *) calloc(lemp->nxstate*2, sizeof(ax[0]));
+  ax = (struct axset *) lemon_calloc(lemp->nxstate*2, sizeof(ax[0]));
   if( ax==0 ){
-    fprintf(stderr,"malloc failed\n");
-    exit(1);
+    lemon_error("malloc failed\n");
+    lemon_exit(1);
   }
   for(i=0; i<lemp->nxstate; i++){
     stp = lemp->sorted[i];
     ax[i*2].stp = stp;
     ax[i*2].isTkn = 1;
     ax[i*2].nAction = stp->nTknAct;
+    ax[i*2].nHit = stp->nTknHit;
     ax[i*2+1].stp = stp;
     ax[i*2+1].isTkn = 0;
     ax[i*2+1].nAction = stp->nNtAct;
+    ax[i*2+1].nHit = stp->nNtHit;
   }
   mxTknOfst = mnTknOfst = 0;
   mxNtOfst = mnNtOfst = 0;
   /* In an effort to minimize the action table size, use the heuristic
-  ** of placing the largest action sets first */
+  ** of placing the largest action sets first.  With a profile, the sets
+  ** looked up most often are placed first so that they share cache lines
+  ** at the start of yy_action[]. */
   for(i=0; i<lemp->nxstate*2; i++) ax[i].iOrder = i;
   qsort(ax, lemp->nxstate*2, sizeof(ax[0]), axset_compare);
-  pActtab = acttab_alloc(lemp->nsymbol, lemp->nterminal);
+  pActtab = acttab_alloc(lemp->nsymbol, nTknCol);
   for(i=0; i<lemp->nxstate*2 && ax[i].nAction>0; i++){
     stp = ax[i].stp;
     if( ax[i].isTkn ){
@@ -4562,7 +6351,16 @@ void ReportTable(
         if( ap->sp->index>=lemp->nterminal ) continue;
         action = compute_action(lemp, ap);
         if( action<0 ) continue;
-        acttab_action(pActtab, ap->sp->index, action);
+        if( aClass ){
+          /* Every member of a class has the same action, so the first
+          ** one seen stands for the class */
+          int c = aClass[ap->sp->index];
+          if( aSeen[c]==i+1 ) continue;
+          aSeen[c] = i+1;
+          acttab_action(pActtab, c, action);
+        }else{
+          acttab_action(pActtab, ap->sp->index, action);
+        }
       }
       stp->iTknOfst = acttab_insert(pActtab, 1);
       if( stp->iTknOfst<mnTknOfst ) mnTknOfst = stp->iTknOfst;
@@ -4591,7 +6389,7 @@ void ReportTable(
     }
 #endif
   }
-  free(ax);
+  lemon_free(ax);
 
   /* Mark rules that are actually used for reduce actions after all
   ** optimizations have been applied
@@ -4607,21 +6405,25 @@ void ReportTable(
 
   /* Finish rendering the constants now that the action table has
   ** been computed */
-  fprintf(out,"#define YYNSTATE             %d\n",lemp->nxstate);  lineno++;
-  fprintf(out,"#define YYNRULE              %d\n",lemp->nrule);  lineno++;
-  fprintf(out,"#define YYNTOKEN             %d\n",lemp->nterminal); lineno++;
-  fprintf(out,"#define YY_MAX_SHIFT         %d\n",lemp->nxstate-1); lineno++;
+  lemon_bprintf(out,"#define YYNSTATE             %d\n",lemp->nxstate);  lineno++;
+  lemon_bprintf(out,"#define YYNRULE              %d\n",lemp->nrule);  lineno++;
+  lemon_bprintf(out,"#define YYNTOKEN             %d\n",lemp->nterminal); lineno++;
+  if( aClass ){
+    lemon_bprintf(out,"#define YYTOKENCLASS         %d\n",nTknCol); lineno++;
+  }
+  lemon_bprintf(out,"#define YY_MAX_SHIFT         %d\n",lemp->nxstate-1); lineno++;
   i = lemp->minShiftReduce;
-  fprintf(out,"#define YY_MIN_SHIFTREDUCE   %d\n",i); lineno++;
+  lemon_bprintf(out,"#define YY_MIN_SHIFTREDUCE   %d\n",i); lineno++;
   i += lemp->nrule;
-  fprintf(out,"#define YY_MAX_SHIFTREDUCE   %d\n", i-1); lineno++;
-  fprintf(out,"#define YY_ERROR_ACTION      %d\n", lemp->errAction); lineno++;
-  fprintf(out,"#define YY_ACCEPT_ACTION     %d\n", lemp->accAction); lineno++;
-  fprintf(out,"#define YY_NO_ACTION         %d\n", lemp->noAction); lineno++;
-  fprintf(out,"#define YY_MIN_REDUCE        %d\n", lemp->minReduce); lineno++;
+  lemon_bprintf(out,"#define YY_MAX_SHIFTREDUCE   %d\n", i-1); lineno++;
+  lemon_bprintf(out,"#define YY_ERROR_ACTION      %d\n", lemp->errAction); lineno++;
+  lemon_bprintf(out,"#define YY_ACCEPT_ACTION     %d\n", lemp->accAction); lineno++;
+  lemon_bprintf(out,"#define YY_NO_ACTION         %d\n", lemp->noAction); lineno++;
+  lemon_bprintf(out,"#define YY_MIN_REDUCE        %d\n", lemp->minReduce); lineno++;
   i = lemp->minReduce + lemp->nrule;
-  fprintf(out,"#define YY_MAX_REDUCE        %d\n", i-1); lineno++;
-  tplt_xfer(lemp->name,in,out,&lineno);
+  lemon_bprintf(out,"#define YY_MAX_REDUCE        %d\n", i-1); lineno++;
+  if( lemp->scanner ) ReportScanner(lemp, out, &lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Now output the action table and its associates:
   **
@@ -4633,38 +6435,40 @@ void ReportTable(
   **  yy_reduce_ofst[]   For each state, the offset into yy_action for
   **                     shifting non-terminals after a reduce.
   **  yy_default[]       Default action for each state.
+  **  yy_token_class[]   With -e, the class of each terminal.  The token
+  **                     rows are indexed by class instead of terminal.
   */
 
   /* Output the yy_action table */
   lemp->nactiontab = n = acttab_action_size(pActtab);
   lemp->tablesize += n*szActionType;
-  fprintf(out,"#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
-  fprintf(out,"static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
+  lemon_bprintf(out,"#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
+  lemon_bprintf(out,"static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
   for(i=j=0; i<n; i++){
     int action = acttab_yyaction(pActtab, i);
     if( action<0 ) action = lemp->noAction;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", action);
+    if( j==0 ) lemon_bprintf(out," /* %5d */ ", i);
+    lemon_bprintf(out, " %4d,", action);
     if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
+      lemon_bprintf(out, "\n"); lineno++;
       j = 0;
     }else{
       j++;
     }
   }
-  fprintf(out, "};\n"); lineno++;
+  lemon_bprintf(out, "};\n"); lineno++;
 
   /* Output the yy_lookahead table */
   lemp->nlookaheadtab = n = acttab_lookahead_size(pActtab);
   lemp->tablesize += n*szCodeType;
-  fprintf(out,"static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
+  lemon_bprintf(out,"static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
   for(i=j=0; i<n; i++){
     int la = acttab_yylookahead(pActtab, i);
     if( la<0 ) la = lemp->nsymbol;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", la);
+    if( j==0 ) lemon_bprintf(out," /* %5d */ ", i);
+    lemon_bprintf(out, " %4d,", la);
     if( j==9 ){
-      fprintf(out, "\n"); lineno++;
+      lemon_bprintf(out, "\n"); lineno++;
       j = 0;
     }else{
       j++;
@@ -4672,29 +6476,42 @@ void ReportTable(
   }
   /* Add extra entries to the end of the yy_lookahead[] table so that
   ** yy_shift_ofst[]+iToken will always be a valid index into the array,
-  ** even for the largest possible value of yy_shift_ofst[] and iToken. */
-  nLookAhead = lemp->nterminal + lemp->nactiontab;
+  ** even for the largest possible value of yy_shift_ofst[] and iToken.
+  ** With classes, iToken is a class and the padding is that much less. */
+  nLookAhead = nTknCol + lemp->nactiontab;
   while( i<nLookAhead ){
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", lemp->nterminal);
+    if( j==0 ) lemon_bprintf(out," /* %5d */ ", i);
+    lemon_bprintf(out, " %4d,", lemp->nterminal);
     if( j==9 ){
-      fprintf(out, "\n"); lineno++;
+      lemon_bprintf(out, "\n"); lineno++;
       j = 0;
     }else{
       j++;
     }
     i++;
   }
-  if( j>0 ){ fprintf(out, "\n"); lineno++; }
-  fprintf(out, "};\n"); lineno++;
+  if( j>0 ){ lemon_bprintf(out, "\n"); lineno++; }
+  lemon_bprintf(out, "};\n"); lineno++;
+
+  /* Output the yy_token_class[] table */
+  if( aClass ){
+    lemp->tablesize += lemp->nterminal*szCodeType;
+    lemon_bprintf(out,"static const YYCODETYPE yy_token_class[] = {\n"); lineno++;
+    for(i=0; i<lemp->nterminal; i++){
+      lemon_bprintf(out, "  %4d,  /* %10s */\n", aClass[i],
+                    lemp->symbols[i]->name); lineno++;
+    }
+    lemon_bprintf(out, "};\n"); lineno++;
+    lemon_free(aClass);
+  }
 
   /* Output the yy_shift_ofst[] table */
   n = lemp->nxstate;
   while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET ) n--;
-  fprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n-1); lineno++;
-  fprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); lineno++;
-  fprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); lineno++;
-  fprintf(out, "static const %s yy_shift_ofst[] = {\n",
+  lemon_bprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n-1); lineno++;
+  lemon_bprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); lineno++;
+  lemon_bprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); lineno++;
+  lemon_bprintf(out, "static const %s yy_shift_ofst[] = {\n",
        minimum_size_type(mnTknOfst, lemp->nterminal+lemp->nactiontab, &sz));
        lineno++;
   lemp->tablesize += n*sz;
@@ -4703,24 +6520,24 @@ void ReportTable(
     stp = lemp->sorted[i];
     ofst = stp->iTknOfst;
     if( ofst==NO_OFFSET ) ofst = lemp->nactiontab;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", ofst);
+    if( j==0 ) lemon_bprintf(out," /* %5d */ ", i);
+    lemon_bprintf(out, " %4d,", ofst);
     if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
+      lemon_bprintf(out, "\n"); lineno++;
       j = 0;
     }else{
       j++;
     }
   }
-  fprintf(out, "};\n"); lineno++;
+  lemon_bprintf(out, "};\n"); lineno++;
 
   /* Output the yy_reduce_ofst[] table */
   n = lemp->nxstate;
   while( n>0 && lemp->sorted[n-1]->iNtOfst==NO_OFFSET ) n--;
-  fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); lineno++;
-  fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
-  fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
-  fprintf(out, "static const %s yy_reduce_ofst[] = {\n",
+  lemon_bprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n-1); lineno++;
+  lemon_bprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
+  lemon_bprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
+  lemon_bprintf(out, "static const %s yy_reduce_ofst[] = {\n",
           minimum_size_type(mnNtOfst-1, mxNtOfst, &sz)); lineno++;
   lemp->tablesize += n*sz;
   for(i=j=0; i<n; i++){
@@ -4728,38 +6545,57 @@ void ReportTable(
     stp = lemp->sorted[i];
     ofst = stp->iNtOfst;
     if( ofst==NO_OFFSET ) ofst = mnNtOfst - 1;
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
-    fprintf(out, " %4d,", ofst);
+    if( j==0 ) lemon_bprintf(out," /* %5d */ ", i);
+    lemon_bprintf(out, " %4d,", ofst);
     if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
+      lemon_bprintf(out, "\n"); lineno++;
       j = 0;
     }else{
       j++;
     }
   }
-  fprintf(out, "};\n"); lineno++;
+  lemon_bprintf(out, "};\n"); lineno++;
 
   /* Output the default action table */
-  fprintf(out, "static const YYACTIONTYPE yy_default[] = {\n"); lineno++;
+  lemon_bprintf(out, "static const YYACTIONTYPE yy_default[] = {\n"); lineno++;
   n = lemp->nxstate;
   lemp->tablesize += n*szActionType;
   for(i=j=0; i<n; i++){
     stp = lemp->sorted[i];
-    if( j==0 ) fprintf(out," /* %5d */ ", i);
+    if( j==0 ) lemon_bprintf(out," /* %5d */ ", i);
     if( stp->iDfltReduce<0 ){
-      fprintf(out, " %4d,", lemp->errAction);
+      lemon_bprintf(out, " %4d,", lemp->errAction);
+    }else{
+      lemon_bprintf(out, " %4d,", stp->iDfltReduce + lemp->minReduce);
+    }
+    if( j==9 || i==n-1 ){
+      lemon_bprintf(out, "\n"); lineno++;
+      j = 0;
     }else{
-      fprintf(out, " %4d,", stp->iDfltReduce + lemp->minReduce);
+      j++;
     }
+  }
+  lemon_bprintf(out, "};\n"); lineno++;
+
+  /* Output the number each state had before ResortStates(), which is
+  ** the number ParseProfile() writes and --profile= reads. */
+  lemon_bprintf(out, "#ifdef YYPROFILE\n"); lineno++;
+  lemon_bprintf(out, "#define YYNSTATEID %d\n", lemp->nstate); lineno++;
+  lemon_bprintf(out, "static const %s yyStateId[] = {\n",
+                minimum_size_type(0, lemp->nstate, 0)); lineno++;
+  for(i=j=0; i<n; i++){
+    if( j==0 ) lemon_bprintf(out," /* %5d */ ", i);
+    lemon_bprintf(out, " %4d,", lemp->sorted[i]->iId);
     if( j==9 || i==n-1 ){
-      fprintf(out, "\n"); lineno++;
+      lemon_bprintf(out, "\n"); lineno++;
       j = 0;
     }else{
       j++;
     }
   }
-  fprintf(out, "};\n"); lineno++;
-  tplt_xfer(lemp->name,in,out,&lineno);
+  lemon_bprintf(out, "};\n"); lineno++;
+  lemon_bprintf(out, "#endif\n"); lineno++;
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate the table of fallback tokens.
   */
@@ -4772,23 +6608,22 @@ void ReportTable(
     for(i=0; i<=mx; i++){
       struct symbol *p = lemp->symbols[i];
       if( p->fallback==0 ){
-        fprintf(out, "    0,  /* %10s => nothing */\n", p->name);
+        lemon_bprintf(out, "    0,  /* %10s => nothing */\n", p->name);
       }else{
-        fprintf(out, "  %3d,  /* %10s => %s */\n", p->fallback->index,
+        lemon_bprintf(out, "  %3d,  /* %10s => %s */\n", p->fallback->index,
           p->name, p->fallback->name);
       }
       lineno++;
     }
   }
-  tplt_xfer(lemp->name, in, out, &lineno);
+  tplt_xfer(lemp->name, &in, out, &lineno);
 
   /* Generate a table containing the symbolic name of every symbol
   */
   for(i=0; i<lemp->nsymbol; i++){
-    lemon_sprintf(line,"\"%s\",",lemp->symbols[i]->name);
-    fprintf(out,"  /* %4d */ \"%s\",\n",i, lemp->symbols[i]->name); lineno++;
+    lemon_bprintf(out,"  /* %4d */ \"%s\",\n",i, lemp->symbols[i]->name); lineno++;
   }
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate a table containing a text string that describes every
   ** rule in the rule set of the grammar.  This information is used
@@ -4796,11 +6631,11 @@ void ReportTable(
   */
   for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
     assert( rp->iRule==i );
-    fprintf(out," /* %3d */ \"", i);
+    lemon_bprintf(out," /* %3d */ \"", i);
     writeRuleText(out, rp);
-    fprintf(out,"\",\n"); lineno++;
+    lemon_bprintf(out,"\",\n"); lineno++;
   }
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate code which executes every time a symbol is popped from
   ** the stack while processing errors or while destroying the parser.
@@ -4834,10 +6669,10 @@ void ReportTable(
   if (lemp->errsym) {
     struct symbol *sp = lemp->errsym;
     if (sp->useCnt) {
-      fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
-      fprintf(out,"      yy_destructor<%s>(std::addressof(yypminor->yy%d));\n",
+      lemon_bprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+      lemon_bprintf(out,"      yy_destructor<%s>(std::addressof(yypminor->yy%d));\n",
         sp_datatype(lemp, sp), sp->dtnum); lineno++;
-      fprintf(out,"      break;\n"); lineno++;
+      lemon_bprintf(out,"      break;\n"); lineno++;
     }
     sp->destructor = 0;
   }
@@ -4847,13 +6682,13 @@ void ReportTable(
     struct symbol *sp = lemp->symbols[i];
     if (!sp->destructor) continue;
     if (sp->type==TERMINAL || !sp->dtnum) {
-      fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+      lemon_bprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
       sp->destructor = 0;
     }
   }
-  fprintf(out,"      yy_destructor<%s>(std::addressof(yypminor->yy0));\n",
+  lemon_bprintf(out,"      yy_destructor<%s>(std::addressof(yypminor->yy0));\n",
     lemp->tokentype); lineno++;
-  fprintf(out,"      break;\n"); lineno++;
+  lemon_bprintf(out,"      break;\n"); lineno++;
 
 
 
@@ -4863,19 +6698,19 @@ void ReportTable(
 
     if (!sp->destructor) continue; /* already output */
 
-    fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+    lemon_bprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
 
     for (j = i + 1; j < lemp->nsymbol; ++j) {
       struct symbol *sp2 = lemp->symbols[j];
 
       if (sp2->destructor && sp2->dtnum == sp->dtnum) {
-        fprintf(out,"    case %d: /* %s */\n", sp2->index, sp2->name); lineno++;
+        lemon_bprintf(out,"    case %d: /* %s */\n", sp2->index, sp2->name); lineno++;
         sp2->destructor = 0;
       }
     }
 
-    fprintf(out,"      yy_destructor<%s>(std::addressof(yypminor->yy%d));\n", sp_datatype(lemp, sp), sp->dtnum); lineno++;
-    fprintf(out,"      break;\n"); lineno++;
+    lemon_bprintf(out,"      yy_destructor<%s>(std::addressof(yypminor->yy%d));\n", sp_datatype(lemp, sp), sp->dtnum); lineno++;
+    lemon_bprintf(out,"      break;\n"); lineno++;
   }
 
 #else
@@ -4886,15 +6721,15 @@ void ReportTable(
       struct symbol *sp = lemp->symbols[i];
       if( sp==0 || sp->type!=TERMINAL ) continue;
       if( once ){
-        fprintf(out, "      /* TERMINAL Destructor */\n"); lineno++;
+        lemon_bprintf(out, "      /* TERMINAL Destructor */\n"); lineno++;
         once = 0;
       }
-      fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+      lemon_bprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
     }
     for(i=0; i<lemp->nsymbol && lemp->symbols[i]->type!=TERMINAL; i++);
     if( i<lemp->nsymbol ){
       emit_destructor_code(out,lemp->symbols[i],lemp,&lineno);
-      fprintf(out,"      break;\n"); lineno++;
+      lemon_bprintf(out,"      break;\n"); lineno++;
     }
   }
   if( lemp->vardest ){
@@ -4905,22 +6740,22 @@ void ReportTable(
       if( sp==0 || sp->type==TERMINAL ||
           sp->index<=0 || sp->destructor!=0 ) continue;
       if( once ){
-        fprintf(out, "      /* Default NON-TERMINAL Destructor */\n");lineno++;
+        lemon_bprintf(out, "      /* Default NON-TERMINAL Destructor */\n");lineno++;
         once = 0;
       }
-      fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+      lemon_bprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
       dflt_sp = sp;
     }
     if( dflt_sp!=0 ){
       emit_destructor_code(out,dflt_sp,lemp,&lineno);
     }
-    fprintf(out,"      break;\n"); lineno++;
+    lemon_bprintf(out,"      break;\n"); lineno++;
   }
   for(i=0; i<lemp->nsymbol; i++){
     struct symbol *sp = lemp->symbols[i];
     if( sp==0 || sp->type==TERMINAL || sp->destructor==0 ) continue;
     if( sp->destLineno<0 ) continue;  /* Already emitted */
-    fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+    lemon_bprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
 
     /* Combine duplicate destructors into a single case */
     for(j=i+1; j<lemp->nsymbol; j++){
@@ -4928,18 +6763,18 @@ void ReportTable(
       if( sp2 && sp2->type!=TERMINAL && sp2->destructor
           && sp2->dtnum==sp->dtnum
           && strcmp(sp->destructor,sp2->destructor)==0 ){
-         fprintf(out,"    case %d: /* %s */\n",
+         lemon_bprintf(out,"    case %d: /* %s */\n",
                  sp2->index, sp2->name); lineno++;
          sp2->destLineno = -1;  /* Avoid emitting this destructor again */
       }
     }
 
     emit_destructor_code(out,lemp->symbols[i],lemp,&lineno);
-    fprintf(out,"      break;\n"); lineno++;
+    lemon_bprintf(out,"      break;\n"); lineno++;
   }
 #endif
 
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
 #ifdef LEMONPLUSPLUS
   /* generate move commands.
@@ -4959,10 +6794,10 @@ void ReportTable(
   if (lemp->errsym) {
     struct symbol *sp = lemp->errsym;
     if (sp->useCnt) {
-      fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
-      fprintf(out,"      yy_move<%s>(std::addressof(yyDest->yy%d), std::addressof(yySource->yy%d));\n",
+      lemon_bprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+      lemon_bprintf(out,"      yy_move<%s>(std::addressof(yyDest->yy%d), std::addressof(yySource->yy%d));\n",
         sp_datatype(lemp, sp), sp->dtnum, sp->dtnum); lineno++;
-      fprintf(out,"      break;\n"); lineno++;
+      lemon_bprintf(out,"      break;\n"); lineno++;
     }
     sp->destructor = 0;
 }
@@ -4971,39 +6806,39 @@ void ReportTable(
     struct symbol *sp = lemp->symbols[i];
     if (!sp->destructor) continue;
     if (sp->type==TERMINAL || !sp->dtnum) {
-      fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+      lemon_bprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
       sp->destructor = 0;
     }
   }
-  fprintf(out,"      yy_move<%s>(std::addressof(yyDest->yy0), std::addressof(yySource->yy0));\n", lemp->tokentype); lineno++;
-  fprintf(out,"      break;\n"); lineno++;
+  lemon_bprintf(out,"      yy_move<%s>(std::addressof(yyDest->yy0), std::addressof(yySource->yy0));\n", lemp->tokentype); lineno++;
+  lemon_bprintf(out,"      break;\n"); lineno++;
 
   for(i=0; i<lemp->nsymbol; i++){
     int j;
     struct symbol *sp = lemp->symbols[i];
 
     if (!sp->destructor) continue;
-    fprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+    lemon_bprintf(out,"    case %d: /* %s */\n", sp->index, sp->name); lineno++;
 
     for (j = i + 1; j < lemp->nsymbol; ++j) {
       struct symbol *sp2 = lemp->symbols[j];
       if (sp2->destructor && sp2->dtnum == sp->dtnum) {
-        fprintf(out,"    case %d: /* %s */\n", sp2->index, sp2->name); lineno++;
+        lemon_bprintf(out,"    case %d: /* %s */\n", sp2->index, sp2->name); lineno++;
         sp2->destructor = 0;
       }
     }
 
-    fprintf(out,"      yy_move<%s>(std::addressof(yyDest->yy%d), std::addressof(yySource->yy%d));\n",
+    lemon_bprintf(out,"      yy_move<%s>(std::addressof(yyDest->yy%d), std::addressof(yySource->yy%d));\n",
       sp_datatype(lemp, sp), sp->dtnum, sp->dtnum); lineno++;
-    fprintf(out,"      break;\n"); lineno++;
+    lemon_bprintf(out,"      break;\n"); lineno++;
   }
 
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 #endif
 
   /* Generate code which executes whenever the parser stack overflows */
   tplt_print(out,lemp,lemp->overflow,&lineno);
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate the tables of rule information.  yyRuleInfoLhs[] and
   ** yyRuleInfoNRhs[].
@@ -5012,145 +6847,138 @@ void ReportTable(
   ** sequentually beginning with 0.
   */
   for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
-    fprintf(out,"  %4d,  /* (%d) ", rp->lhs->index, i);
+    lemon_bprintf(out,"  %4d,  /* (%d) ", rp->lhs->index, i);
      rule_print(out, rp);
-    fprintf(out," */\n"); lineno++;
+    lemon_bprintf(out," */\n"); lineno++;
   }
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
   for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
-    fprintf(out,"  %3d,  /* (%d) ", -rp->nrhs, i);
+    lemon_bprintf(out,"  %3d,  /* (%d) ", -rp->nrhs, i);
     rule_print(out, rp);
-    fprintf(out," */\n"); lineno++;
+    lemon_bprintf(out," */\n"); lineno++;
   }
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
-  /* Generate code which execution during each REDUCE action */
+  /* Expand the code of each REDUCE action */
   i = 0;
   for(rp=lemp->rule; rp; rp=rp->next){
-    i += translate_code(lemp, rp);
+    rp->lhsMinor = translate_code(lemp, rp);
+    i += rp->lhsMinor;
   }
+
+  /* Generate code which execution during each REDUCE action */
+  if( lemp->reduceTable ) i = 0;
   if( i ){
-    fprintf(out,"        YYMINORTYPE yylhsminor;\n"); lineno++;
+    lemon_bprintf(out,"        YYMINORTYPE yylhsminor;\n"); lineno++;
   }
-  /* First output rules other than the default: rule */
-  for(rp=lemp->rule; rp; rp=rp->next){
+  /* First output rules other than the default: rule.  With a profile,
+  ** the rules reduced most often come first.  With -R the switch is left
+  ** empty, and ReportReduceTable() writes the code after the template. */
+  aRule = rule_emit_order(lemp);
+  for(i=0; !lemp->reduceTable && (rp = aRule[i])!=0; i++){
     struct rule *rp2;               /* Other rules with the same action */
     if( rp->codeEmitted ) continue;
     if( rp->noCode ){
       /* No C code actions, so this will be part of the "default:" rule */
       continue;
     }
-    fprintf(out,"      case %d: /* ", rp->iRule);
+    lemon_bprintf(out,"      case %d: /* ", rp->iRule);
     writeRuleText(out, rp);
-    fprintf(out, " */\n"); lineno++;
-    for(rp2=rp->next; rp2; rp2=rp2->next){
+    lemon_bprintf(out, " */\n"); lineno++;
+    for(j=i+1; (rp2 = aRule[j])!=0; j++){
       if( rp2->code==rp->code && rp2->codePrefix==rp->codePrefix
              && rp2->codeSuffix==rp->codeSuffix ){
-        fprintf(out,"      case %d: /* ", rp2->iRule);
+        lemon_bprintf(out,"      case %d: /* ", rp2->iRule);
         writeRuleText(out, rp2);
-        fprintf(out," */ yytestcase(yyruleno==%d);\n", rp2->iRule); lineno++;
+        lemon_bprintf(out," */ yytestcase(yyruleno==%d);\n", rp2->iRule); lineno++;
         rp2->codeEmitted = 1;
       }
     }
     emit_code(out,rp,lemp,&lineno);
-    fprintf(out,"        break;\n"); lineno++;
+    lemon_bprintf(out,"        break;\n"); lineno++;
     rp->codeEmitted = 1;
   }
+  lemon_free(aRule);
   /* Finally, output the default: rule.  We choose as the default: all
   ** empty actions. */
-  fprintf(out,"      default:\n"); lineno++;
-  for(rp=lemp->rule; rp; rp=rp->next){
-    if( rp->codeEmitted ) continue;
-    assert( rp->noCode );
-    fprintf(out,"      /* (%d) ", rp->iRule);
-    writeRuleText(out, rp);
-    if( rp->doesReduce ){
-      fprintf(out, " */ yytestcase(yyruleno==%d);\n", rp->iRule); lineno++;
-    }else{
-      fprintf(out, " (OPTIMIZED OUT) */ assert(yyruleno!=%d);\n",
-              rp->iRule); lineno++;
+  if( !lemp->reduceTable ){
+    lemon_bprintf(out,"      default:\n"); lineno++;
+    for(rp=lemp->rule; rp; rp=rp->next){
+      if( rp->codeEmitted ) continue;
+      assert( rp->noCode );
+      lemon_bprintf(out,"      /* (%d) ", rp->iRule);
+      writeRuleText(out, rp);
+      if( rp->doesReduce ){
+        lemon_bprintf(out, " */ yytestcase(yyruleno==%d);\n", rp->iRule);
+        lineno++;
+      }else{
+        lemon_bprintf(out, " (OPTIMIZED OUT) */ assert(yyruleno!=%d);\n",
+                rp->iRule); lineno++;
+      }
     }
+    lemon_bprintf(out,"        break;\n"); lineno++;
   }
-  fprintf(out,"        break;\n"); lineno++;
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate code which executes if a parse fails */
   tplt_print(out,lemp,lemp->failure,&lineno);
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate code which executes when a syntax error occurs */
   tplt_print(out,lemp,lemp->error,&lineno);
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
 
   /* Generate code which executes when the parser accepts its input */
   tplt_print(out,lemp,lemp->accept,&lineno);
-  tplt_xfer(lemp->name,in,out,&lineno);
+  tplt_xfer(lemp->name,&in,out,&lineno);
+
+  /* With -R, generate each REDUCE action as a function of its own.  They
+  ** go after the template, which declares yyReduceTable[] for yy_reduce(),
+  ** so that the template keeps the sections it has always had. */
+  if( lemp->reduceTable ) ReportReduceTable(lemp, out, &lineno);
+
+  /* Generate the keyword lookup, if there is one */
+  if( lemp->nkeyword ) ReportKeywords(lemp, out, &lineno);
 
   /* Append any addition code the user desires */
   tplt_print(out,lemp,lemp->extracode,&lineno);
 
   acttab_free(pActtab);
-  fclose(in);
-  fclose(out);
+  lemon_free(in.aSection);
+  lemon_free(in.aSubst);
   return;
 }
 
-/* Check if the existing header needs to be re-generated */
-int CompareHeader(FILE *in, struct lemon *lemp, const char *prefix) {
-  char line[LINESIZE];
-  char pattern[LINESIZE];
-  int i;
-  int nextChar;
-
-  for(i=1; i<lemp->nterminal && fgets(line,LINESIZE,in); i++){
-    lemon_sprintf(pattern,"#define %s%-30s %3d\n",
-                  prefix,lemp->symbols[i]->name,i);
-    if( strcmp(line,pattern) ) return 0;
-  }
-  if ( i != lemp->nterminal ) return 0; 
-
-  /* compare user-supplied header */
-  if (lemp->header && lemp->header[0]) {
-    int len = lemonStrlen(lemp->header);
-    char *tmp = (char *)malloc(len);
-    if (!tmp) return 0;
-    if (fread(tmp, 1, len, in) != len) { free(tmp); return 0; }
-    if (memcmp(lemp->header, tmp, len)) { free(tmp); return 0; }
-    free(tmp);
-  }
-
-  if ( fgetc(in) != EOF) return 0;
-  /* No change in the file.  Don't rewrite it. */
-  return 1; 
-}
-
 /* Generate a header file for the parser */
-void ReportHeader(struct lemon *lemp)
+void ReportHeader(struct lemon *lemp, struct lemon_buf *out)
 {
-  FILE *out, *in;
   const char *prefix;
-
   int i;
-  int ok;
 
   if( lemp->tokenprefix ) prefix = lemp->tokenprefix;
   else                    prefix = "";
-
-  in = file_open(lemp,".h","rb");
-  if ( in ) {
-    ok = CompareHeader(in, lemp, prefix);
-    fclose(in);
-    if (ok) return;
+  for(i=1; i<lemp->nterminal; i++){
+    lemon_bprintf(out,"#define %s%-30s %3d\n",prefix,lemp->symbols[i]->name,i);
   }
-
-  out = file_open(lemp,".h","wb");
-  if( out ){
-    for(i=1; i<lemp->nterminal; i++){
-      fprintf(out,"#define %s%-30s %3d\n",prefix,lemp->symbols[i]->name,i);
-    }
-    if (lemp->header) fputs(lemp->header, out);
-    fclose(out);
+  if( lemp->nkeyword ){
+    lemon_bprintf(out,"int %sKeywordCode(const char*, int);\n",
+      lemp->name ? lemp->name : "Parse");
+  }
+  if( lemp->scanner ){
+    lemon_bprintf(out,"int %sScan(const char*, int, int*);\n",
+      lemp->name ? lemp->name : "Parse");
+    lemon_bprintf(out,"int %sScanPartial(const char*, int, int, int*);\n",
+      lemp->name ? lemp->name : "Parse");
+  }
+  if( lemp->scanner && lemp->nsync ){
+    lemon_bprintf(out,"int %sScanSync(const char*, int, int);\n",
+      lemp->name ? lemp->name : "Parse");
   }
+  if( lemp->recognizer ){
+    lemon_bprintf(out,"int %sAccepts(void*, const int*, int);\n",
+      lemp->name ? lemp->name : "Parse");
+  }
+  if (lemp->header) lemon_bputs(out, lemp->header);
   return;
 }
 
@@ -5246,8 +7074,10 @@ void CompressTables(struct lemon *lemp)
   ** (meaning that the SHIFTREDUCE will land back in the state where it
   ** started) and if there is no C-code associated with the reduce action,
   ** then we can go ahead and convert the action to be the same as the
-  ** action for the RHS of the rule.
+  ** action for the RHS of the rule.  The same action is then looked at
+  ** again, so a whole chain of such rules is skipped at once.
   */
+  if( lemp->unitRules ) lemp->nunit = 0;
   for(i=0; i<lemp->nstate; i++){
     stp = lemp->sorted[i];
     for(ap=stp->ap; ap; ap=nextap){
@@ -5256,16 +7086,21 @@ void CompressTables(struct lemon *lemp)
       rp = ap->x.rp;
       if( rp->noCode==0 ) continue;
       if( rp->nrhs!=1 ) continue;
-#if 1
-      /* Only apply this optimization to non-terminals.  It would be OK to
-      ** apply it to terminal symbols too, but that makes the parser tables
-      ** larger. */
-      if( ap->sp->index<lemp->nterminal ) continue;
-#endif
-      /* If we reach this point, it means the optimization can be applied */
-      nextap = ap;
+      /* Only apply this optimization to non-terminals, unless -u is used.
+      ** It is OK for terminal symbols too, but it makes the parser tables
+      ** larger: the shift-reduce of a rule like "x ::= T" is the same in
+      ** every state, while the action on x that replaces it is not. */
+      if( ap->sp->index<lemp->nterminal && !lemp->unitRules ) continue;
       for(ap2=stp->ap; ap2 && (ap2==ap || ap2->sp!=rp->lhs); ap2=ap2->next){}
       assert( ap2!=0 );
+      if( ap->sp->index<lemp->nterminal ){
+        /* The terminal still has to be shifted, so only a shift can
+        ** take the place of the shift-reduce */
+        if( ap2->type!=SHIFT && ap2->type!=SHIFTREDUCE ) continue;
+        if( ap->spOpt==0 ) lemp->nunit++;
+      }
+      /* If we reach this point, it means the optimization can be applied */
+      nextap = ap;
       ap->spOpt = ap2->sp;
       ap->type = ap2->type;
       ap->x = ap2->x;
@@ -5274,6 +7109,267 @@ void CompressTables(struct lemon *lemp)
 }
 
 
+/*
+** Resolve %fallback and the %wildcard token when the tables are built
+** rather than in the generated parser.  For every state and every
+** terminal that has no action of its own, copy the action that the
+** parser would otherwise find at run time: that of the token's
+** fallback, or failing that, that of the wildcard.  The parser then
+** finds every action with a single lookup, at the cost of a larger
+** action table.  Return the number of actions added.
+*/
+int FoldFallback(struct lemon *lemp)
+{
+  struct state *stp;
+  struct action *ap, *apFrom;
+  struct action **apAct;        /* Action of each terminal in one state */
+  struct symbol *sp;
+  int i, j;
+  int nFold = 0;
+
+  apAct = (struct action **) lemon_calloc(lemp->nterminal, sizeof(apAct[0]));
+  if( apAct==0 ) memory_error();
+  for(i=0; i<lemp->nstate; i++){
+    stp = lemp->sorted[i];
+    memset(apAct, 0, lemp->nterminal*sizeof(apAct[0]));
+    for(ap=stp->ap; ap; ap=ap->next){
+      if( ap->sp->index>=lemp->nterminal ) continue;
+      switch( ap->type ){
+        case SHIFT: case SHIFTREDUCE: case REDUCE: case ERROR: case ACCEPT:
+          apAct[ap->sp->index] = ap;
+          break;
+        default:
+          break;
+      }
+    }
+    for(j=1; j<lemp->nterminal; j++){
+      if( apAct[j] ) continue;
+      sp = lemp->symbols[j];
+      apFrom = 0;
+      if( sp->fallback ) apFrom = apAct[sp->fallback->index];
+      if( apFrom==0 && lemp->wildcard ) apFrom = apAct[lemp->wildcard->index];
+      if( apFrom==0 ) continue;
+      Action_add(&stp->ap, apFrom->type, sp, 0);
+      stp->ap->x = apFrom->x;
+      nFold++;
+    }
+    stp->ap = Action_sort(stp->ap);
+  }
+  lemon_free(apAct);
+  return nFold;
+}
+
+/*
+** True if action ap ends up in the generated tables.
+*/
+PRIVATE int stateActionUsed(struct action *ap){
+  switch( ap->type ){
+    case SHIFT: case SHIFTREDUCE: case REDUCE: case ERROR: case ACCEPT:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/*
+** Hash the row of state stp, with the targets of shifts replaced by
+** their class in aClass[].
+*/
+PRIVATE unsigned stateRowHash(struct state *stp, const int *aClass){
+  struct action *ap;
+  unsigned h = aClass[stp->statenum]*2 + stp->autoReduce;
+  for(ap=stp->ap; ap; ap=ap->next){
+    if( !stateActionUsed(ap) ) continue;
+    h = h*1000003 + ap->sp->index;
+    h = h*31 + ap->type;
+    if( ap->type==SHIFT ){
+      h = h*1000003 + aClass[ap->x.stp->statenum];
+    }else if( ap->type==REDUCE || ap->type==SHIFTREDUCE ){
+      h = h*1000003 + ap->x.rp->iRule;
+    }
+  }
+  return h;
+}
+
+/*
+** True if states A and B are in the same class and take the same
+** action on every symbol, counting shifts to states of the same class
+** as the same action.
+*/
+PRIVATE int stateRowsEqual(struct state *pA, struct state *pB, const int *aClass){
+  struct action *a = pA->ap, *b = pB->ap;
+  if( aClass[pA->statenum]!=aClass[pB->statenum] ) return 0;
+  if( pA->autoReduce!=pB->autoReduce ) return 0;
+  if( pA->autoReduce && pA->pDfltReduce!=pB->pDfltReduce ) return 0;
+  for(;;){
+    while( a && !stateActionUsed(a) ) a = a->next;
+    while( b && !stateActionUsed(b) ) b = b->next;
+    if( a==0 || b==0 ) return a==b;
+    if( a->sp->index!=b->sp->index || a->type!=b->type ) return 0;
+    if( a->type==SHIFT ){
+      if( aClass[a->x.stp->statenum]!=aClass[b->x.stp->statenum] ) return 0;
+    }else if( a->type==REDUCE || a->type==SHIFTREDUCE ){
+      if( a->x.rp!=b->x.rp ) return 0;
+    }
+    a = a->next;
+    b = b->next;
+  }
+}
+
+/*
+** Merge states that the parser cannot tell apart: states that take
+** the same action on every terminal and nonterminal, where shifts into
+** states that are themselves merged count as the same.  The states
+** start out in one class, and every pass splits each class by the rows
+** of its members until a pass splits nothing.  The first state of each
+** class is kept, shifts are pointed at it, and the others are removed.
+** Return the number of states removed.
+*/
+int MinimizeStates(struct lemon *lemp)
+{
+  int n = lemp->nstate;
+  int *aSpace;          /* Space for the four arrays below */
+  int *aClass;          /* Class of each state */
+  int *aNew;            /* Class of each state after this pass */
+  int *aNext;           /* Next state in the same hash bucket */
+  int *aHash;           /* First state in each hash bucket */
+  int nHash, nClass, nOld;
+  int i, j;
+  struct action *ap;
+
+  for(nHash=64; nHash<n*2; nHash*=2){}
+  aSpace = (int *) lemon_calloc(n*3 + nHash, sizeof(int));
+  if( aSpace==0 ) memory_error();
+  aClass = aSpace;
+  aNew = &aClass[n];
+  aNext = &aNew[n];
+  aHash = &aNext[n];
+  for(i=0; i<n; i++) assert( lemp->sorted[i]->statenum==i );
+  nClass = 1;
+  do{
+    int *aSwap;
+    nOld = nClass;
+    nClass = 0;
+    for(i=0; i<nHash; i++) aHash[i] = -1;
+    for(i=0; i<n; i++){
+      struct state *stp = lemp->sorted[i];
+      unsigned h = stateRowHash(stp, aClass) & (nHash-1);
+      for(j=aHash[h]; j>=0; j=aNext[j]){
+        if( stateRowsEqual(lemp->sorted[j], stp, aClass) ) break;
+      }
+      if( j>=0 ){
+        aNew[i] = aNew[j];
+      }else{
+        aNew[i] = nClass++;
+        aNext[i] = aHash[h];
+        aHash[h] = i;
+      }
+    }
+    aSwap = aClass;  aClass = aNew;  aNew = aSwap;
+  }while( nClass>nOld );
+
+  if( nClass<n ){
+    /* aNew[c] is the state kept for class c.  Classes are numbered in
+    ** order of their first state, so state 0 keeps its number. */
+    for(i=0; i<n; i++) aNew[i] = -1;
+    for(i=0; i<n; i++){
+      if( aNew[aClass[i]]<0 ) aNew[aClass[i]] = i;
+    }
+    for(i=0; i<n; i++){
+      for(ap=lemp->sorted[i]->ap; ap; ap=ap->next){
+        if( ap->type==SHIFT || ap->type==SSCONFLICT || ap->type==SH_RESOLVED ){
+          ap->x.stp = lemp->sorted[aNew[aClass[ap->x.stp->statenum]]];
+        }
+      }
+    }
+    for(i=j=0; i<n; i++){
+      if( aNew[aClass[i]]!=i ) continue;
+      lemp->sorted[j] = lemp->sorted[i];
+      lemp->sorted[j]->statenum = j;
+      j++;
+    }
+    lemp->nstate = j;
+  }
+  lemon_free(aSpace);
+  return n - lemp->nstate;
+}
+
+/*
+** Read a profile written by ParseProfile() in a parser built with
+** -DYYPROFILE.  It starts with a line giving the number of states and
+** rules of that parser, followed by lines of the form
+**
+**      state ID TOKEN-LOOKUPS GOTO-LOOKUPS
+**      rule N REDUCTIONS
+**
+** where ID is the number the state had before ResortStates().  Lines
+** that repeat a state or rule are added up, so the profiles of several
+** runs can be concatenated.  The counts are stored in the states and
+** rules, and lemp->profiled is set, unless the profile is for another
+** grammar.
+*/
+void ReadProfile(struct lemon *lemp, const char *zName)
+{
+  char *z, *zLine, *zEnd;
+  int lineno = 0;
+  int nState = -1, nRule = -1;
+  int i, nErr = lemp->errorcnt;
+  unsigned long a, b;
+  char zKey[20];
+  struct rule *rp;
+
+  z = file_read(zName, 0);
+  if( z==0 ){
+    lemon_error("Can't open the profile \"%s\".\n", zName);
+    lemp->errorcnt++;
+    return;
+  }
+  for(zLine=z; *zLine; zLine=zEnd){
+    zEnd = strchr(zLine, '\n');
+    if( zEnd ) *(zEnd++) = 0;
+    else zEnd = zLine + lemonStrlen(zLine);
+    lineno++;
+    if( sscanf(zLine, "%19s", zKey)!=1 ) continue;
+    if( nState<0 || strcmp(zKey,"lemon-profile")==0 ){
+      if( strcmp(zKey,"lemon-profile")!=0
+       || sscanf(zLine, "%*s %d %d", &nState, &nRule)!=2 ){
+        ErrorMsg(zName, lineno, "Not a profile written by ParseProfile().");
+        lemp->errorcnt++;
+        break;
+      }
+      if( nState!=lemp->nstate || nRule!=lemp->nrule ){
+        ErrorMsg(zName, lineno, "The profile is for a parser with %d states "
+          "and %d rules, not %d and %d.  It is ignored.",
+          nState, nRule, lemp->nstate, lemp->nrule);
+        lemp->errorcnt++;
+        break;
+      }
+    }else if( strcmp(zKey,"state")==0
+           && sscanf(zLine, "%*s %d %lu %lu", &i, &a, &b)==3
+           && i>=0 && i<lemp->nstate ){
+      lemp->sorted[i]->nTknHit += a;
+      lemp->sorted[i]->nNtHit += b;
+    }else if( strcmp(zKey,"rule")==0
+           && sscanf(zLine, "%*s %d %lu", &i, &a)==2
+           && i>=0 && i<lemp->nrule ){
+      for(rp=lemp->rule; rp && rp->iRule!=i; rp=rp->next){}
+      rp->nHit += a;
+    }else{
+      ErrorMsg(zName, lineno, "Unknown or out of range profile entry.");
+      lemp->errorcnt++;
+    }
+  }
+  lemon_free(z);
+  if( lemp->errorcnt==nErr ){
+    lemp->profiled = 1;
+  }else{
+    for(i=0; i<lemp->nstate; i++){
+      lemp->sorted[i]->nTknHit = lemp->sorted[i]->nNtHit = 0;
+    }
+    for(rp=lemp->rule; rp; rp=rp->next) rp->nHit = 0;
+  }
+}
+
 /*
 ** Compare two states for sorting purposes.  The smaller state is the
 ** one with the most non-terminal actions.  If they have the same number
@@ -5296,6 +7392,26 @@ static int stateResortCompare(const void *a, const void *b){
   return n;
 }
 
+/*
+** Compare two states for sorting by a profile.  States with goto
+** actions still come first, so that yy_reduce_ofst[] stays short, and
+** auto-reduce states still come last.  In between, the states that the
+** profile looked up most often come first.
+*/
+static int stateProfileCompare(const void *a, const void *b){
+  const struct state *pA = *(const struct state**)a;
+  const struct state *pB = *(const struct state**)b;
+  unsigned long hA = pA->nTknHit + pA->nNtHit;
+  unsigned long hB = pB->nTknHit + pB->nNtHit;
+  int n;
+
+  n = pA->autoReduce - pB->autoReduce;
+  if( n==0 ) n = (pB->nNtAct>0) - (pA->nNtAct>0);
+  if( n==0 && hA!=hB ) n = hA>hB ? -1 : 1;
+  if( n==0 ) n = stateResortCompare(a, b);
+  return n;
+}
+
 
 /*
 ** Renumber and resort states so that states with fewer choices
@@ -5309,6 +7425,7 @@ void ResortStates(struct lemon *lemp, int noResort)
 
   for(i=0; i<lemp->nstate; i++){
     stp = lemp->sorted[i];
+    stp->iId = stp->statenum;
     stp->nTknAct = stp->nNtAct = 0;
     stp->iDfltReduce = -1; /* Init dflt action to "syntax error" */
     stp->iTknOfst = NO_OFFSET;
@@ -5331,7 +7448,7 @@ void ResortStates(struct lemon *lemp, int noResort)
   if (noResort) return;
 
   qsort(&lemp->sorted[1], lemp->nstate-1, sizeof(lemp->sorted[0]),
-        stateResortCompare);
+        lemp->profiled ? stateProfileCompare : stateResortCompare);
   for(i=0; i<lemp->nstate; i++){
     lemp->sorted[i]->statenum = i;
   }
@@ -5340,24 +7457,768 @@ void ResortStates(struct lemon *lemp, int noResort)
   }
 }
 
+/*
+** Return the most entries that the parser stack can hold from state stp
+** up, counting stp itself, or -1 if it has no limit.  Each entry is the
+** target of a shift or a goto out of the entry below it, so this is the
+** longest path of such actions out of stp.  A shift-reduce is a path of
+** one: its entry is reduced before anything else is pushed.  If
+** bNullable is set, only the gotos on nullable nonterminals are
+** followed.  aDepth[] remembers the answer for each state: 0 if it is
+** not known yet and -1 while the state is on the path being explored,
+** so that meeting it again means a cycle.
+*/
+PRIVATE int stack_depth(
+  struct lemon *lemp,
+  struct state *stp,
+  int *aDepth,
+  int bNullable
+){
+  struct action *ap;
+  int n = 1, d;
+
+  if( aDepth[stp->statenum] ) return aDepth[stp->statenum];
+  aDepth[stp->statenum] = -1;
+  for(ap=stp->ap; ap; ap=ap->next){
+    if( ap->type!=SHIFT && ap->type!=SHIFTREDUCE ) continue;
+    if( bNullable
+     && (ap->sp->index<lemp->nterminal || !ap->sp->lambda) ) continue;
+    d = ap->type==SHIFT ? stack_depth(lemp, ap->x.stp, aDepth, bNullable) : 1;
+    if( d<0 ) return -1;
+    if( d+1>n ) n = d+1;
+  }
+  aDepth[stp->statenum] = n;
+  return n;
+}
+
+/*
+** Find how deep the parser stack can get.  If no path of shifts and
+** gotos out of state 0 has a cycle, no input can take the stack deeper
+** than the longest one, and lemp->stackBound is set to that.  Otherwise
+** nested or right-recursive input can make the stack as deep as it likes
+** and lemp->stackBound is left 0.
+**
+** Also find how many entries one token can push.  A reduce pops at least
+** as many entries as it pushes, except for an empty rule, and entries
+** that come from empty rules can only pile up at the top of the stack,
+** as a path of gotos on nullable nonterminals.  So a token pushes at
+** most the longest such path and then its own shift.  Error recovery can
+** shift the error symbol and then go on with the same token, which
+** doubles that.  lemp->stackHeadroom is set to the result, or left 0 if
+** the nullable gotos have a cycle.
+*/
+void StackBound(struct lemon *lemp)
+{
+  int *aDepth;
+  int i, d, n = 0;
+
+  lemp->stackBound = 0;
+  lemp->stackHeadroom = 0;
+  aDepth = (int*)lemon_calloc(lemp->nstate, sizeof(aDepth[0]));
+  MemoryCheck(aDepth);
+  d = stack_depth(lemp, lemp->sorted[0], aDepth, 0);
+  if( d>0 ) lemp->stackBound = d;
+  memset(aDepth, 0, lemp->nstate*sizeof(aDepth[0]));
+  for(i=0; i<lemp->nstate; i++){
+    d = stack_depth(lemp, lemp->sorted[i], aDepth, 1);
+    if( d<0 ) break;
+    if( d>n ) n = d;
+  }
+  if( i==lemp->nstate ){
+    /* n-1 gotos above the starting entry, then the shift */
+    lemp->stackHeadroom = n;
+    if( lemp->errsym && lemp->errsym->useCnt ) lemp->stackHeadroom *= 2;
+  }
+  lemon_free(aDepth);
+}
+
+
+/*************************** From the file "scan.c" **********************/
+/*
+** Routines that build the scanner described by %token_pattern and
+** %token_skip.  Each pattern is compiled into a Thompson NFA as it is
+** parsed.  The NFAs of all patterns share one start state.  ScanBuild()
+** turns the combined NFA into a DFA by subset construction and then
+** minimizes the DFA.
+**
+** Patterns are byte-oriented regular expressions.  They support
+** alternation (|), grouping, the * + and ? operators, ".", bracket
+** classes such as [a-z_] and [^"], and the escapes \n \t \r \f \v \xHH,
+** \d \w \s (and \D \W \S).  Any other escaped character stands for
+** itself.
+*/
+
+/* A state of the NFA.  A state either consumes one byte from the set
+** numbered iSet and moves to out1, or (if iSet<0) moves to out1 and to
+** out2 without consuming anything. */
+struct nfa_state {
+  int iSet;                /* Character set consumed, or -1 */
+  int out1, out2;          /* Next states, or -1 */
+  int iAccept;             /* 1 + pattern number if accepting, else 0 */
+};
+
+/* A table of integer vectors.  Equal vectors get the same number */
+struct intvec_table {
+  int n, nAlloc;           /* Number of vectors, space in aOff[] */
+  int *aOff;               /* Vector i is aData[aOff[i]..aOff[i+1]-1] */
+  int nData, nDataAlloc;   /* Integers used and allocated in aData[] */
+  int *aData;              /* Content of all vectors */
+  int nHash;               /* Slots in aHash[], a power of two */
+  int *aHash;              /* 1 + vector number, or 0 for an empty slot */
+};
+
+struct scanner {
+  int nNfa, nNfaAlloc;     /* NFA states used and allocated */
+  struct nfa_state *aNfa;  /* The NFA */
+  int nSet, nSetAlloc;     /* Character sets used and allocated */
+  unsigned char *aSet;     /* 32 bytes (one bit per byte value) per set */
+  int iStart;              /* Start state of the combined NFA */
+  int nPattern;            /* Number of patterns */
+  struct symbol **apToken; /* Token of each pattern, NULL for %token_skip */
+
+  /* The DFA, filled in by ScanBuild() */
+  int nDfa;                /* Number of states.  State 0 is a dead state */
+  int iDfaStart;           /* The start state */
+  int nClass;              /* Number of byte classes */
+  int aClass[256];         /* Class of each byte value */
+  int *aNext;              /* aNext[s*nClass+c] is the next state */
+  int *aAccept;            /* 1 + pattern accepted in each state, or 0 */
+};
+
+#define SCAN_SET(P,I)     (&(P)->aSet[(I)*32])
+#define SCAN_HAS(S,C)     (((S)[(C)>>3] & (1<<((C)&7)))!=0)
+#define SCAN_ADD(S,C)     ((S)[(C)>>3] |= (unsigned char)(1<<((C)&7)))
+#define SCAN_MAX_STATE    100000
+
+/* Add a new NFA state and return its number */
+static int nfa_new(struct scanner *pScan, int iSet, int out1, int out2){
+  struct nfa_state *p;
+  if( pScan->nNfa>=pScan->nNfaAlloc ){
+    pScan->nNfaAlloc = pScan->nNfaAlloc*2 + 64;
+    pScan->aNfa = (struct nfa_state *) lemon_realloc(pScan->aNfa,
+                    sizeof(pScan->aNfa[0])*pScan->nNfaAlloc);
+    MemoryCheck(pScan->aNfa);
+  }
+  p = &pScan->aNfa[pScan->nNfa];
+  p->iSet = iSet;
+  p->out1 = out1;
+  p->out2 = out2;
+  p->iAccept = 0;
+  return pScan->nNfa++;
+}
+
+/* Add a new, empty, character set and return its number */
+static int nfa_set_new(struct scanner *pScan){
+  if( pScan->nSet>=pScan->nSetAlloc ){
+    pScan->nSetAlloc = pScan->nSetAlloc*2 + 16;
+    pScan->aSet = (unsigned char *) lemon_realloc(pScan->aSet,
+                    32*pScan->nSetAlloc);
+    MemoryCheck(pScan->aSet);
+  }
+  memset(SCAN_SET(pScan, pScan->nSet), 0, 32);
+  return pScan->nSet++;
+}
+
+/* Return the number of vector a[0..n-1] in table p, adding it if it is
+** not already there. */
+static int intvec_intern(struct intvec_table *p, const int *a, int n){
+  unsigned int h = 0;
+  int i, k;
+  for(i=0; i<n; i++) h = h*1000003 + (unsigned int)a[i];
+  if( p->n*2>=p->nHash ){
+    int j;
+    lemon_free(p->aHash);
+    p->nHash = p->nHash ? p->nHash*2 : 256;
+    p->aHash = (int *) lemon_calloc(p->nHash, sizeof(int));
+    MemoryCheck(p->aHash);
+    for(j=0; j<p->n; j++){
+      unsigned int h2 = 0;
+      for(i=p->aOff[j]; i<p->aOff[j+1]; i++){
+        h2 = h2*1000003 + (unsigned int)p->aData[i];
+      }
+      for(k=h2&(p->nHash-1); p->aHash[k]; k=(k+1)&(p->nHash-1)){}
+      p->aHash[k] = j+1;
+    }
+  }
+  for(k=h&(p->nHash-1); p->aHash[k]; k=(k+1)&(p->nHash-1)){
+    int j = p->aHash[k]-1;
+    if( p->aOff[j+1]-p->aOff[j]==n
+     && memcmp(&p->aData[p->aOff[j]], a, sizeof(int)*n)==0 ){
+      return j;
+    }
+  }
+  if( p->n+2>p->nAlloc ){
+    p->nAlloc = p->nAlloc*2 + 64;
+    p->aOff = (int *) lemon_realloc(p->aOff, sizeof(int)*p->nAlloc);
+    MemoryCheck(p->aOff);
+  }
+  if( p->nData+n>p->nDataAlloc ){
+    p->nDataAlloc = p->nDataAlloc*2 + n + 256;
+    p->aData = (int *) lemon_realloc(p->aData, sizeof(int)*p->nDataAlloc);
+    MemoryCheck(p->aData);
+  }
+  if( p->n==0 ) p->aOff[0] = 0;
+  memcpy(&p->aData[p->nData], a, sizeof(int)*n);
+  p->nData += n;
+  p->aOff[p->n+1] = p->nData;
+  p->aHash[k] = p->n+1;
+  return p->n++;
+}
+
+static void intvec_clear(struct intvec_table *p){
+  lemon_free(p->aOff);
+  lemon_free(p->aData);
+  lemon_free(p->aHash);
+  memset(p, 0, sizeof(*p));
+}
+
+/* The state of the pattern parser */
+struct rx_parse {
+  struct scanner *pScan;
+  const char *z;           /* Next character of the pattern */
+  const char *zErr;        /* Error message, or NULL */
+};
+
+/* A fragment of the NFA.  iLast is a state with no exits yet */
+struct rx_frag {
+  int iFirst, iLast;
+};
+
+static struct rx_frag rx_alt(struct rx_parse *);
 
+/* Return the value of hexadecimal digit c, or -1 */
+static int rx_hex(int c){
+  if( c>='0' && c<='9' ) return c - '0';
+  if( c>='a' && c<='f' ) return c - 'a' + 10;
+  if( c>='A' && c<='F' ) return c - 'A' + 10;
+  return -1;
+}
+
+/* True if byte c is in the class named by escape letter e (d, w or s) */
+static int rx_in_class(int e, int c){
+  switch( e ){
+    case 'd':  return c>='0' && c<='9';
+    case 'w':  return (c>='0' && c<='9') || (c>='a' && c<='z')
+                        || (c>='A' && c<='Z') || c=='_';
+    default:   return c==' ' || (c>='\t' && c<='\r');
+  }
+}
+
+/* Decode the escape that follows a backslash.  Return the byte it
+** stands for, or -1 for a class escape such as \d, whose members are
+** added to aSet. */
+static int rx_escape(struct rx_parse *p, unsigned char *aSet){
+  int c = (unsigned char)*p->z;
+  int i;
+  if( c==0 ){
+    p->zErr = "pattern ends with a backslash";
+    return -1;
+  }
+  p->z++;
+  switch( c ){
+    case 'n':  return '\n';
+    case 't':  return '\t';
+    case 'r':  return '\r';
+    case 'f':  return '\f';
+    case 'v':  return '\v';
+    case 'x':
+      if( rx_hex(p->z[0])<0 || rx_hex(p->z[1])<0 ){
+        p->zErr = "\\x must be followed by two hexadecimal digits";
+        return -1;
+      }
+      c = rx_hex(p->z[0])*16 + rx_hex(p->z[1]);
+      p->z += 2;
+      return c;
+    case 'd': case 'w': case 's':
+    case 'D': case 'W': case 'S':
+      for(i=0; i<256; i++){
+        if( rx_in_class(c|0x20, i)!=(c<'a') ) SCAN_ADD(aSet, i);
+      }
+      return -1;
+  }
+  return c;
+}
+
+/* Parse a bracket class such as [a-z_], after the "[", into aSet */
+static void rx_class(struct rx_parse *p, unsigned char *aSet){
+  int bInvert = 0;
+  int i, lo, hi;
+  if( *p->z=='^' ){
+    bInvert = 1;
+    p->z++;
+  }
+  do{
+    if( *p->z==0 ){
+      p->zErr = "missing ]";
+      return;
+    }
+    lo = (unsigned char)*(p->z++);
+    if( lo=='\\' ){
+      lo = rx_escape(p, aSet);
+      if( lo<0 ) continue;
+    }
+    hi = lo;
+    if( p->z[0]=='-' && p->z[1]!=']' && p->z[1]!=0 ){
+      p->z++;
+      hi = (unsigned char)*(p->z++);
+      if( hi=='\\' ) hi = rx_escape(p, aSet);
+      if( hi<lo ){
+        if( p->zErr==0 ) p->zErr = "bad range in []";
+        return;
+      }
+    }
+    for(i=lo; i<=hi; i++) SCAN_ADD(aSet, i);
+  }while( p->zErr==0 && *p->z!=']' );
+  if( p->zErr ) return;
+  p->z++;
+  if( bInvert ){
+    for(i=0; i<32; i++) aSet[i] = (unsigned char)~aSet[i];
+  }
+}
+
+/* Parse a single character, class, or parenthesized group */
+static struct rx_frag rx_atom(struct rx_parse *p){
+  struct scanner *pScan = p->pScan;
+  struct rx_frag f;
+  unsigned char *aSet;
+  int iSet, c, i;
+
+  c = (unsigned char)*p->z;
+  if( c=='(' ){
+    p->z++;
+    f = rx_alt(p);
+    if( p->zErr==0 && *p->z!=')' ) p->zErr = "missing )";
+    if( p->zErr==0 ) p->z++;
+    return f;
+  }
+  if( c=='*' || c=='+' || c=='?' ){
+    p->zErr = "nothing to repeat";
+  }else if( c=='^' || c=='$' ){
+    p->zErr = "anchors are not supported";
+  }
+  iSet = nfa_set_new(pScan);
+  aSet = SCAN_SET(pScan, iSet);
+  p->z++;
+  if( c=='[' ){
+    rx_class(p, aSet);
+  }else if( c=='.' ){
+    for(i=0; i<256; i++){
+      if( i!='\n' ) SCAN_ADD(aSet, i);
+    }
+  }else{
+    if( c=='\\' ) c = rx_escape(p, aSet);
+    if( c>=0 ) SCAN_ADD(aSet, c);
+  }
+  f.iLast = nfa_new(pScan, -1, -1, -1);
+  f.iFirst = nfa_new(pScan, iSet, f.iLast, -1);
+  return f;
+}
+
+/* Parse an atom followed by any number of "*", "+" and "?" */
+static struct rx_frag rx_repeat(struct rx_parse *p){
+  struct scanner *pScan = p->pScan;
+  struct rx_frag f = rx_atom(p);
+  while( p->zErr==0 && (*p->z=='*' || *p->z=='+' || *p->z=='?') ){
+    int iLast = nfa_new(pScan, -1, -1, -1);
+    struct nfa_state *pLast = &pScan->aNfa[f.iLast];
+    if( *p->z=='?' ){
+      pLast->out1 = iLast;
+    }else{
+      pLast->out1 = f.iFirst;
+      pLast->out2 = iLast;
+    }
+    if( *p->z!='+' ){
+      f.iFirst = nfa_new(pScan, -1, f.iFirst, iLast);
+    }
+    f.iLast = iLast;
+    p->z++;
+  }
+  return f;
+}
+
+/* Parse a sequence of repeated atoms.  The sequence may be empty */
+static struct rx_frag rx_concat(struct rx_parse *p){
+  struct rx_frag f;
+  f.iFirst = f.iLast = nfa_new(p->pScan, -1, -1, -1);
+  while( p->zErr==0 && *p->z && *p->z!='|' && *p->z!=')' ){
+    struct rx_frag g = rx_repeat(p);
+    p->pScan->aNfa[f.iLast].out1 = g.iFirst;
+    f.iLast = g.iLast;
+  }
+  return f;
+}
+
+/* Parse alternatives separated by "|" */
+static struct rx_frag rx_alt(struct rx_parse *p){
+  struct scanner *pScan = p->pScan;
+  struct rx_frag f = rx_concat(p);
+  while( p->zErr==0 && *p->z=='|' ){
+    struct rx_frag g;
+    int iLast;
+    p->z++;
+    g = rx_concat(p);
+    iLast = nfa_new(pScan, -1, -1, -1);
+    pScan->aNfa[f.iLast].out1 = iLast;
+    pScan->aNfa[g.iLast].out1 = iLast;
+    f.iFirst = nfa_new(pScan, -1, f.iFirst, g.iFirst);
+    f.iLast = iLast;
+  }
+  return f;
+}
+
+/* Write into aOut[] the NFA states reachable from the n states in aIn[]
+** without consuming input, in increasing order.  Return how many there
+** are.  aMark[] is scratch space with one entry per NFA state, and
+** aStack[] is scratch space with two entries per state. */
+static int nfa_closure(
+  struct scanner *pScan,
+  const int *aIn, int n,
+  int *aOut,
+  char *aMark,
+  int *aStack
+){
+  int nStack = 0, nOut = 0, i, j;
+  for(i=0; i<n; i++) aStack[nStack++] = aIn[i];
+  while( nStack>0 ){
+    struct nfa_state *p;
+    i = aStack[--nStack];
+    if( i<0 || aMark[i] ) continue;
+    aMark[i] = 1;
+    aOut[nOut++] = i;
+    p = &pScan->aNfa[i];
+    if( p->iSet<0 ){
+      aStack[nStack++] = p->out1;
+      aStack[nStack++] = p->out2;
+    }
+  }
+  for(i=0; i<nOut; i++) aMark[aOut[i]] = 0;
+  /* Insertion sort.  The sets are small */
+  for(i=1; i<nOut; i++){
+    int x = aOut[i];
+    for(j=i; j>0 && aOut[j-1]>x; j--) aOut[j] = aOut[j-1];
+    aOut[j] = x;
+  }
+  return nOut;
+}
+
+/* Compile zPattern and add it to the scanner of lemp.  Input that
+** matches it is returned as token sp, or skipped if sp is NULL.  Return
+** an error message, or NULL on success. */
+const char *ScanAddPattern(
+  struct lemon *lemp,
+  struct symbol *sp,
+  const char *zPattern
+){
+  struct scanner *pScan = lemp->scanner;
+  struct rx_parse p;
+  struct rx_frag f;
+  int iAccept, n, i;
+  int *aOut, *aStack;
+  char *aMark;
+
+  if( pScan==0 ){
+    pScan = (struct scanner *) lemon_calloc(1, sizeof(*pScan));
+    MemoryCheck(pScan);
+    pScan->iStart = -1;
+    lemp->scanner = pScan;
+  }
+  p.pScan = pScan;
+  p.z = zPattern;
+  p.zErr = 0;
+  f = rx_alt(&p);
+  if( p.zErr==0 && *p.z ) p.zErr = "unmatched )";
+  if( p.zErr ) return p.zErr;
+
+  /* Reject patterns that match the empty string */
+  aOut = (int *) lemon_malloc(sizeof(int)*(pScan->nNfa*3+1));
+  aMark = (char *) lemon_calloc(pScan->nNfa, 1);
+  MemoryCheck(aOut);
+  MemoryCheck(aMark);
+  aStack = aOut + pScan->nNfa;
+  n = nfa_closure(pScan, &f.iFirst, 1, aOut, aMark, aStack);
+  for(i=0; i<n && aOut[i]!=f.iLast; i++){}
+  lemon_free(aOut);
+  lemon_free(aMark);
+  if( i<n ) return "pattern matches the empty string";
+
+  pScan->apToken = (struct symbol **) lemon_realloc(pScan->apToken,
+                     sizeof(struct symbol*)*(pScan->nPattern+1));
+  MemoryCheck(pScan->apToken);
+  pScan->apToken[pScan->nPattern++] = sp;
+  iAccept = nfa_new(pScan, -1, -1, -1);
+  pScan->aNfa[iAccept].iAccept = pScan->nPattern;
+  pScan->aNfa[f.iLast].out1 = iAccept;
+  if( pScan->iStart<0 ){
+    pScan->iStart = f.iFirst;
+  }else{
+    pScan->iStart = nfa_new(pScan, -1, pScan->iStart, f.iFirst);
+  }
+  return 0;
+}
+
+/* Divide the 256 byte values into classes that no pattern tells apart */
+static void scan_classes(struct scanner *pScan){
+  int aMap[512];
+  int i, j, n;
+  memset(pScan->aClass, 0, sizeof(pScan->aClass));
+  pScan->nClass = 1;
+  for(i=0; i<pScan->nSet; i++){
+    unsigned char *aSet = SCAN_SET(pScan, i);
+    for(j=0; j<pScan->nClass*2; j++) aMap[j] = -1;
+    for(j=n=0; j<256; j++){
+      int k = pScan->aClass[j]*2 + SCAN_HAS(aSet, j);
+      if( aMap[k]<0 ) aMap[k] = n++;
+      pScan->aClass[j] = aMap[k];
+    }
+    pScan->nClass = n;
+  }
+}
+
+/* Build the minimal DFA for the patterns of lemp.  Return the number of
+** errors. */
+int ScanBuild(struct lemon *lemp){
+  struct scanner *pScan = lemp->scanner;
+  struct intvec_table dfa, sig;
+  int *aRep;               /* A byte value in each class */
+  int *aTarget, *aOut, *aStack, *aNext, *aPart, *aSig, *aAcc;
+  char *aMark;
+  int nClass, nNfa = pScan->nNfa;
+  int nDfa, nAlloc, nPart;
+  int i, j, c, n;
+
+  scan_classes(pScan);
+  nClass = pScan->nClass;
+  aRep = (int *) lemon_malloc(sizeof(int)*nClass);
+  aTarget = (int *) lemon_malloc(sizeof(int)*nNfa*5);
+  aMark = (char *) lemon_calloc(nNfa, 1);
+  MemoryCheck(aRep);
+  MemoryCheck(aTarget);
+  MemoryCheck(aMark);
+  aOut = aTarget + nNfa;
+  aStack = aOut + nNfa;
+  for(i=255; i>=0; i--) aRep[pScan->aClass[i]] = i;
+
+  /* Subset construction.  DFA state 0 is the empty set of NFA states,
+  ** which is the dead state, and state 1 is the start state. */
+  memset(&dfa, 0, sizeof(dfa));
+  intvec_intern(&dfa, 0, 0);
+  n = nfa_closure(pScan, &pScan->iStart, 1, aOut, aMark, aStack);
+  intvec_intern(&dfa, aOut, n);
+  nAlloc = 64;
+  aNext = (int *) lemon_malloc(sizeof(int)*nAlloc*nClass);
+  MemoryCheck(aNext);
+  for(i=0; i<dfa.n; i++){
+    if( dfa.n>SCAN_MAX_STATE ){
+      ErrorMsg(lemp->filename, 0,
+        "The %%token_pattern scanner needs more than %d states.",
+        SCAN_MAX_STATE);
+      lemon_free(aRep);
+      lemon_free(aTarget);
+      lemon_free(aMark);
+      lemon_free(aNext);
+      intvec_clear(&dfa);
+      return 1;
+    }
+    if( i>=nAlloc ){
+      nAlloc *= 2;
+      aNext = (int *) lemon_realloc(aNext, sizeof(int)*nAlloc*nClass);
+      MemoryCheck(aNext);
+    }
+    for(c=0; c<nClass; c++){
+      for(j=dfa.aOff[i], n=0; j<dfa.aOff[i+1]; j++){
+        struct nfa_state *p = &pScan->aNfa[dfa.aData[j]];
+        if( p->iSet>=0 && SCAN_HAS(SCAN_SET(pScan, p->iSet), aRep[c]) ){
+          aTarget[n++] = p->out1;
+        }
+      }
+      n = nfa_closure(pScan, aTarget, n, aOut, aMark, aStack);
+      aNext[i*nClass+c] = intvec_intern(&dfa, aOut, n);
+    }
+  }
+  nDfa = dfa.n;
+
+  /* Each DFA state accepts the earliest pattern among its NFA states */
+  aPart = (int *) lemon_malloc(sizeof(int)*nDfa*2);
+  aAcc = (int *) lemon_malloc(sizeof(int)*nDfa);
+  aSig = (int *) lemon_malloc(sizeof(int)*(nClass+1));
+  MemoryCheck(aPart);
+  MemoryCheck(aAcc);
+  MemoryCheck(aSig);
+  for(i=0; i<nDfa; i++){
+    int iAccept = 0;
+    for(j=dfa.aOff[i]; j<dfa.aOff[i+1]; j++){
+      int a = pScan->aNfa[dfa.aData[j]].iAccept;
+      if( a>0 && (iAccept==0 || a<iAccept) ) iAccept = a;
+    }
+    aAcc[i] = iAccept;
+  }
+  intvec_clear(&dfa);
+
+  /* Minimize by refining a partition of the states, starting from one
+  ** group per accepted pattern, until the states in each group agree on
+  ** which group every byte class leads to.  The dead state 0 stays in
+  ** group 0. */
+  memset(&sig, 0, sizeof(sig));
+  for(i=0; i<nDfa; i++){
+    aPart[i] = intvec_intern(&sig, &aAcc[i], 1);
+  }
+  nPart = sig.n;
+  while( 1 ){
+    intvec_clear(&sig);
+    for(i=0; i<nDfa; i++){
+      aSig[0] = aPart[i];
+      for(c=0; c<nClass; c++) aSig[c+1] = aPart[aNext[i*nClass+c]];
+      aPart[nDfa+i] = intvec_intern(&sig, aSig, nClass+1);
+    }
+    memcpy(aPart, &aPart[nDfa], sizeof(int)*nDfa);
+    if( sig.n==nPart ) break;
+    nPart = sig.n;
+  }
+  intvec_clear(&sig);
+
+  /* Write out one state per group */
+  pScan->nDfa = nPart;
+  pScan->iDfaStart = aPart[1];
+  pScan->aNext = (int *) lemon_calloc(nPart*nClass, sizeof(int));
+  pScan->aAccept = (int *) lemon_calloc(nPart, sizeof(int));
+  MemoryCheck(pScan->aNext);
+  MemoryCheck(pScan->aAccept);
+  for(i=0; i<nDfa; i++){
+    int iPart = aPart[i];
+    pScan->aAccept[iPart] = aAcc[i];
+    for(c=0; c<nClass; c++){
+      pScan->aNext[iPart*nClass+c] = aPart[aNext[i*nClass+c]];
+    }
+  }
+  lemon_free(aRep);
+  lemon_free(aTarget);
+  lemon_free(aMark);
+  lemon_free(aNext);
+  lemon_free(aPart);
+  lemon_free(aAcc);
+  lemon_free(aSig);
+  return 0;
+}
+
+/*
+** Generate the tables and the ParseScan() function of the scanner.
+*/
+void ReportScanner(struct lemon *lemp, struct lemon_buf *out, int *plineno){
+  struct scanner *pScan = lemp->scanner;
+  const char *name = lemp->name ? lemp->name : "Parse";
+  int lineno = *plineno;
+  int i, c;
+
+  lemon_bprintf(out,
+    "/* Scanner generated from %%token_pattern and %%token_skip.\n"
+    "** %sScan() finds the longest token at the start of the n bytes\n"
+    "** at z[], writes its length to *pnLen and returns its code.  It\n"
+    "** returns -1 for text matched by %%token_skip, and 0 if no pattern\n"
+    "** matches.  %sScanPartial() does the same for a buffer that more\n"
+    "** input may follow (bLast false).  It returns YYSCANMORE if the token\n"
+    "** might continue past the end of z[]. */\n", name, name); lineno += 7;
+  lemon_bprintf(out,"#define YYSCANNER            1\n"); lineno++;
+  lemon_bprintf(out,"#define YYSCANSKIP           %d\n", lemp->nsymbol); lineno++;
+  lemon_bprintf(out,"#define YYSCANMORE           -2\n"); lineno++;
+  lemon_bprintf(out,"#define YYSCANSTART          %d\n", pScan->iDfaStart);
+  lineno++;
+  lemon_bprintf(out,"#define YYSCANNCLASS         %d\n", pScan->nClass);
+  lineno++;
+  lemon_bprintf(out,"static const unsigned char yyScanClass[256] = {");
+  for(i=0; i<256; i++){
+    if( i%16==0 ){ lemon_bprintf(out, "\n "); lineno++; }
+    lemon_bprintf(out, " %3d,", pScan->aClass[i]);
+  }
+  lemon_bprintf(out, "\n};\n"); lineno += 2;
+  lemon_bprintf(out, "static const %s yyScanNext[] = {\n",
+    minimum_size_type(0, pScan->nDfa, 0)); lineno++;
+  for(i=0; i<pScan->nDfa; i++){
+    lemon_bprintf(out, " /* %4d */", i);
+    for(c=0; c<pScan->nClass; c++){
+      if( c>0 && c%10==0 ){ lemon_bprintf(out, "\n           "); lineno++; }
+      lemon_bprintf(out, " %4d,", pScan->aNext[i*pScan->nClass+c]);
+    }
+    lemon_bprintf(out, "\n"); lineno++;
+  }
+  lemon_bprintf(out, "};\n"); lineno++;
+  lemon_bprintf(out, "static const %s yyScanAccept[] = {",
+    minimum_size_type(0, lemp->nsymbol, 0));
+  for(i=0; i<pScan->nDfa; i++){
+    int a = pScan->aAccept[i];
+    if( i%10==0 ){ lemon_bprintf(out, "\n "); lineno++; }
+    if( a>0 ){
+      struct symbol *sp = pScan->apToken[a-1];
+      a = sp ? sp->index : lemp->nsymbol;
+    }
+    lemon_bprintf(out, " %4d,", a);
+  }
+  lemon_bprintf(out, "\n};\n"); lineno += 2;
+  lemon_bprintf(out,
+    "int %sScanPartial(const char *z, int n, int bLast, int *pnLen){\n"
+    "  int s = YYSCANSTART, i, len = 0, code = 0;\n"
+    "  for(i=0; i<n; i++){\n"
+    "    s = yyScanNext[s*YYSCANNCLASS + yyScanClass[(unsigned char)z[i]]];\n"
+    "    if( s==0 ) break;\n"
+    "    if( yyScanAccept[s] ){\n"
+    "      code = yyScanAccept[s];\n"
+    "      len = i+1;\n"
+    "    }\n"
+    "  }\n"
+    "  if( s!=0 && !bLast ){\n"
+    "    *pnLen = 0;\n"
+    "    return YYSCANMORE;\n"
+    "  }\n"
+    "  *pnLen = len;\n"
+    "  return code==YYSCANSKIP ? -1 : code;\n"
+    "}\n", name); lineno += 17;
+  lemon_bprintf(out,
+    "int %sScan(const char *z, int n, int *pnLen){\n"
+    "  return %sScanPartial(z, n, 1, pnLen);\n"
+    "}\n", name, name); lineno += 3;
+  if( lemp->nsync==0 ){
+    *plineno = lineno;
+    return;
+  }
+
+  /* The %sync tokens, and a function that finds where to split */
+  lemon_bprintf(out,"#define YYSYNC               %d\n", lemp->nsync); lineno++;
+  lemon_bprintf(out,"static const unsigned char yyScanSync[] = {");
+  for(i=0; i<lemp->nterminal; i++){
+    if( i%20==0 ){ lemon_bprintf(out, "\n "); lineno++; }
+    lemon_bprintf(out, " %d,", lemp->symbols[i]->bSync);
+  }
+  lemon_bprintf(out, "\n};\n"); lineno += 2;
+  lemon_bprintf(out,
+    "/* Return the offset just past the first %%sync token in the n bytes\n"
+    "** at z[] that ends at or after offset nMin, or n if there is none. */\n"
+    "int %sScanSync(const char *z, int n, int nMin){\n"
+    "  int i = 0, len, major;\n"
+    "  while( i<n ){\n"
+    "    major = %sScan(&z[i], n-i, &len);\n"
+    "    if( major==0 ) break;\n"
+    "    i += len;\n"
+    "    if( major>0 && i>=nMin && yyScanSync[major] ) return i;\n"
+    "  }\n"
+    "  return n;\n"
+    "}\n", name, name); lineno += 12;
+  *plineno = lineno;
+}
 /***************** From the file "set.c" ************************************/
 /*
 ** Set manipulation routines for the LEMON parser generator.
 */
 
-static int size = 0;
 
 /* Set the set size */
 void SetSize(int n)
 {
-  size = n+1;
+  lemon_ctx->size = n+1;
 }
 
 /* Allocate a new set */
 char *SetNew(void){
   char *s;
-  s = (char*)calloc( size, 1);
+  s = (char*)lemon_calloc( lemon_ctx->size, 1);
   if( s==0 ){
     memory_error();
   }
@@ -5367,7 +8228,7 @@ char *SetNew(void){
 /* Deallocate a set */
 void SetFree(char *s)
 {
-  free(s);
+  lemon_free(s);
 }
 
 /* Add a new element to the set.  Return TRUE if the element was added
@@ -5375,7 +8236,7 @@ void SetFree(char *s)
 int SetAdd(char *s, int e)
 {
   int rv;
-  assert( e>=0 && e<size );
+  assert( e>=0 && e<lemon_ctx->size );
   rv = s[e];
   s[e] = 1;
   return !rv;
@@ -5386,7 +8247,7 @@ int SetUnion(char *s1, char *s2)
 {
   int i, progress;
   progress = 0;
-  for(i=0; i<size; i++){
+  for(i=0; i<lemon_ctx->size; i++){
     if( s2[i]==0 ) continue;
     if( s1[i]==0 ){
       progress = 1;
@@ -5426,7 +8287,7 @@ const char *Strsafe(const char *y)
 
   if( y==0 ) return 0;
   z = Strsafe_find(y);
-  if( z==0 && (cpy=(char *)malloc( lemonStrlen(y)+1 ))!=0 ){
+  if( z==0 && (cpy=(char *)lemon_malloc( lemonStrlen(y)+1 ))!=0 ){
     lemon_strcpy(cpy,y);
     z = cpy;
     Strsafe_insert(z);
@@ -5457,23 +8318,22 @@ typedef struct s_x1node {
 } x1node;
 
 /* There is only one instance of the array, which is the following */
-static struct s_x1 *x1a;
 
 /* Allocate a new associative array */
 void Strsafe_init(void){
-  if( x1a ) return;
-  x1a = (struct s_x1*)malloc( sizeof(struct s_x1) );
-  if( x1a ){
-    x1a->size = 1024;
-    x1a->count = 0;
-    x1a->tbl = (x1node*)calloc(1024, sizeof(x1node) + sizeof(x1node*));
-    if( x1a->tbl==0 ){
-      free(x1a);
-      x1a = 0;
+  if( lemon_ctx->x1a ) return;
+  lemon_ctx->x1a = (struct s_x1*)lemon_malloc( sizeof(struct s_x1) );
+  if( lemon_ctx->x1a ){
+    lemon_ctx->x1a->size = 1024;
+    lemon_ctx->x1a->count = 0;
+    lemon_ctx->x1a->tbl = (x1node*)lemon_calloc(1024, sizeof(x1node) + sizeof(x1node*));
+    if( lemon_ctx->x1a->tbl==0 ){
+      lemon_free(lemon_ctx->x1a);
+      lemon_ctx->x1a = 0;
     }else{
       int i;
-      x1a->ht = (x1node**)&(x1a->tbl[1024]);
-      for(i=0; i<1024; i++) x1a->ht[i] = 0;
+      lemon_ctx->x1a->ht = (x1node**)&(lemon_ctx->x1a->tbl[1024]);
+      for(i=0; i<1024; i++) lemon_ctx->x1a->ht[i] = 0;
     }
   }
 }
@@ -5485,10 +8345,10 @@ int Strsafe_insert(const char *data)
   unsigned h;
   unsigned ph;
 
-  if( x1a==0 ) return 0;
+  if( lemon_ctx->x1a==0 ) return 0;
   ph = strhash(data);
-  h = ph & (x1a->size-1);
-  np = x1a->ht[h];
+  h = ph & (lemon_ctx->x1a->size-1);
+  np = lemon_ctx->x1a->ht[h];
   while( np ){
     if( strcmp(np->data,data)==0 ){
       /* An existing entry with the same key is found. */
@@ -5497,19 +8357,19 @@ int Strsafe_insert(const char *data)
     }
     np = np->next;
   }
-  if( x1a->count>=x1a->size ){
+  if( lemon_ctx->x1a->count>=lemon_ctx->x1a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x1 array;
-    array.size = arrSize = x1a->size*2;
-    array.count = x1a->count;
-    array.tbl = (x1node*)calloc(arrSize, sizeof(x1node) + sizeof(x1node*));
+    array.size = arrSize = lemon_ctx->x1a->size*2;
+    array.count = lemon_ctx->x1a->count;
+    array.tbl = (x1node*)lemon_calloc(arrSize, sizeof(x1node) + sizeof(x1node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x1node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x1a->count; i++){
+    for(i=0; i<lemon_ctx->x1a->count; i++){
       x1node *oldnp, *newnp;
-      oldnp = &(x1a->tbl[i]);
+      oldnp = &(lemon_ctx->x1a->tbl[i]);
       h = strhash(oldnp->data) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -5518,17 +8378,17 @@ int Strsafe_insert(const char *data)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    free(x1a->tbl);
-    *x1a = array;
+    lemon_free(lemon_ctx->x1a->tbl);
+    *lemon_ctx->x1a = array;
   }
   /* Insert the new data */
-  h = ph & (x1a->size-1);
-  np = &(x1a->tbl[x1a->count++]);
+  h = ph & (lemon_ctx->x1a->size-1);
+  np = &(lemon_ctx->x1a->tbl[lemon_ctx->x1a->count++]);
   np->data = data;
-  if( x1a->ht[h] ) x1a->ht[h]->from = &(np->next);
-  np->next = x1a->ht[h];
-  x1a->ht[h] = np;
-  np->from = &(x1a->ht[h]);
+  if( lemon_ctx->x1a->ht[h] ) lemon_ctx->x1a->ht[h]->from = &(np->next);
+  np->next = lemon_ctx->x1a->ht[h];
+  lemon_ctx->x1a->ht[h] = np;
+  np->from = &(lemon_ctx->x1a->ht[h]);
   return 1;
 }
 
@@ -5539,9 +8399,9 @@ const char *Strsafe_find(const char *key)
   unsigned h;
   x1node *np;
 
-  if( x1a==0 ) return 0;
-  h = strhash(key) & (x1a->size-1);
-  np = x1a->ht[h];
+  if( lemon_ctx->x1a==0 ) return 0;
+  h = strhash(key) & (lemon_ctx->x1a->size-1);
+  np = lemon_ctx->x1a->ht[h];
   while( np ){
     if( strcmp(np->data,key)==0 ) break;
     np = np->next;
@@ -5558,7 +8418,7 @@ struct symbol *Symbol_new(const char *x)
 
   sp = Symbol_find(x);
   if( sp==0 ){
-    sp = (struct symbol *)calloc(1, sizeof(struct symbol) );
+    sp = (struct symbol *)lemon_calloc(1, sizeof(struct symbol) );
     MemoryCheck(sp);
     sp->name = Strsafe(x);
     sp->type = ISUPPER(*x) ? TERMINAL : NONTERMINAL;
@@ -5624,23 +8484,22 @@ typedef struct s_x2node {
 } x2node;
 
 /* There is only one instance of the array, which is the following */
-static struct s_x2 *x2a;
 
 /* Allocate a new associative array */
 void Symbol_init(void){
-  if( x2a ) return;
-  x2a = (struct s_x2*)malloc( sizeof(struct s_x2) );
-  if( x2a ){
-    x2a->size = 128;
-    x2a->count = 0;
-    x2a->tbl = (x2node*)calloc(128, sizeof(x2node) + sizeof(x2node*));
-    if( x2a->tbl==0 ){
-      free(x2a);
-      x2a = 0;
+  if( lemon_ctx->x2a ) return;
+  lemon_ctx->x2a = (struct s_x2*)lemon_malloc( sizeof(struct s_x2) );
+  if( lemon_ctx->x2a ){
+    lemon_ctx->x2a->size = 128;
+    lemon_ctx->x2a->count = 0;
+    lemon_ctx->x2a->tbl = (x2node*)lemon_calloc(128, sizeof(x2node) + sizeof(x2node*));
+    if( lemon_ctx->x2a->tbl==0 ){
+      lemon_free(lemon_ctx->x2a);
+      lemon_ctx->x2a = 0;
     }else{
       int i;
-      x2a->ht = (x2node**)&(x2a->tbl[128]);
-      for(i=0; i<128; i++) x2a->ht[i] = 0;
+      lemon_ctx->x2a->ht = (x2node**)&(lemon_ctx->x2a->tbl[128]);
+      for(i=0; i<128; i++) lemon_ctx->x2a->ht[i] = 0;
     }
   }
 }
@@ -5652,10 +8511,10 @@ int Symbol_insert(struct symbol *data, const char *key)
   unsigned h;
   unsigned ph;
 
-  if( x2a==0 ) return 0;
+  if( lemon_ctx->x2a==0 ) return 0;
   ph = strhash(key);
-  h = ph & (x2a->size-1);
-  np = x2a->ht[h];
+  h = ph & (lemon_ctx->x2a->size-1);
+  np = lemon_ctx->x2a->ht[h];
   while( np ){
     if( strcmp(np->key,key)==0 ){
       /* An existing entry with the same key is found. */
@@ -5664,19 +8523,19 @@ int Symbol_insert(struct symbol *data, const char *key)
     }
     np = np->next;
   }
-  if( x2a->count>=x2a->size ){
+  if( lemon_ctx->x2a->count>=lemon_ctx->x2a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x2 array;
-    array.size = arrSize = x2a->size*2;
-    array.count = x2a->count;
-    array.tbl = (x2node*)calloc(arrSize, sizeof(x2node) + sizeof(x2node*));
+    array.size = arrSize = lemon_ctx->x2a->size*2;
+    array.count = lemon_ctx->x2a->count;
+    array.tbl = (x2node*)lemon_calloc(arrSize, sizeof(x2node) + sizeof(x2node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x2node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x2a->count; i++){
+    for(i=0; i<lemon_ctx->x2a->count; i++){
       x2node *oldnp, *newnp;
-      oldnp = &(x2a->tbl[i]);
+      oldnp = &(lemon_ctx->x2a->tbl[i]);
       h = strhash(oldnp->key) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -5686,18 +8545,18 @@ int Symbol_insert(struct symbol *data, const char *key)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    free(x2a->tbl);
-    *x2a = array;
+    lemon_free(lemon_ctx->x2a->tbl);
+    *lemon_ctx->x2a = array;
   }
   /* Insert the new data */
-  h = ph & (x2a->size-1);
-  np = &(x2a->tbl[x2a->count++]);
+  h = ph & (lemon_ctx->x2a->size-1);
+  np = &(lemon_ctx->x2a->tbl[lemon_ctx->x2a->count++]);
   np->key = key;
   np->data = data;
-  if( x2a->ht[h] ) x2a->ht[h]->from = &(np->next);
-  np->next = x2a->ht[h];
-  x2a->ht[h] = np;
-  np->from = &(x2a->ht[h]);
+  if( lemon_ctx->x2a->ht[h] ) lemon_ctx->x2a->ht[h]->from = &(np->next);
+  np->next = lemon_ctx->x2a->ht[h];
+  lemon_ctx->x2a->ht[h] = np;
+  np->from = &(lemon_ctx->x2a->ht[h]);
   return 1;
 }
 
@@ -5708,9 +8567,9 @@ struct symbol *Symbol_find(const char *key)
   unsigned h;
   x2node *np;
 
-  if( x2a==0 ) return 0;
-  h = strhash(key) & (x2a->size-1);
-  np = x2a->ht[h];
+  if( lemon_ctx->x2a==0 ) return 0;
+  h = strhash(key) & (lemon_ctx->x2a->size-1);
+  np = lemon_ctx->x2a->ht[h];
   while( np ){
     if( strcmp(np->key,key)==0 ) break;
     np = np->next;
@@ -5722,8 +8581,8 @@ struct symbol *Symbol_find(const char *key)
 struct symbol *Symbol_Nth(int n)
 {
   struct symbol *data;
-  if( x2a && n>0 && n<=x2a->count ){
-    data = x2a->tbl[n-1].data;
+  if( lemon_ctx->x2a && n>0 && n<=lemon_ctx->x2a->count ){
+    data = lemon_ctx->x2a->tbl[n-1].data;
   }else{
     data = 0;
   }
@@ -5733,7 +8592,7 @@ struct symbol *Symbol_Nth(int n)
 /* Return the size of the array */
 int Symbol_count()
 {
-  return x2a ? x2a->count : 0;
+  return lemon_ctx->x2a ? lemon_ctx->x2a->count : 0;
 }
 
 /* Return an array of pointers to all data in the table.
@@ -5743,11 +8602,11 @@ struct symbol **Symbol_arrayof()
 {
   struct symbol **array;
   int i,arrSize;
-  if( x2a==0 ) return 0;
-  arrSize = x2a->count;
-  array = (struct symbol **)calloc(arrSize, sizeof(struct symbol *));
+  if( lemon_ctx->x2a==0 ) return 0;
+  arrSize = lemon_ctx->x2a->count;
+  array = (struct symbol **)lemon_calloc(arrSize, sizeof(struct symbol *));
   if( array ){
-    for(i=0; i<arrSize; i++) array[i] = x2a->tbl[i].data;
+    for(i=0; i<arrSize; i++) array[i] = lemon_ctx->x2a->tbl[i].data;
   }
   return array;
 }
@@ -5793,7 +8652,7 @@ PRIVATE unsigned statehash(struct config *a)
 struct state *State_new()
 {
   struct state *newstate;
-  newstate = (struct state *)calloc(1, sizeof(struct state) );
+  newstate = (struct state *)lemon_calloc(1, sizeof(struct state) );
   MemoryCheck(newstate);
   return newstate;
 }
@@ -5821,23 +8680,22 @@ typedef struct s_x3node {
 } x3node;
 
 /* There is only one instance of the array, which is the following */
-static struct s_x3 *x3a;
 
 /* Allocate a new associative array */
 void State_init(void){
-  if( x3a ) return;
-  x3a = (struct s_x3*)malloc( sizeof(struct s_x3) );
-  if( x3a ){
-    x3a->size = 128;
-    x3a->count = 0;
-    x3a->tbl = (x3node*)calloc(128, sizeof(x3node) + sizeof(x3node*));
-    if( x3a->tbl==0 ){
-      free(x3a);
-      x3a = 0;
+  if( lemon_ctx->x3a ) return;
+  lemon_ctx->x3a = (struct s_x3*)lemon_malloc( sizeof(struct s_x3) );
+  if( lemon_ctx->x3a ){
+    lemon_ctx->x3a->size = 128;
+    lemon_ctx->x3a->count = 0;
+    lemon_ctx->x3a->tbl = (x3node*)lemon_calloc(128, sizeof(x3node) + sizeof(x3node*));
+    if( lemon_ctx->x3a->tbl==0 ){
+      lemon_free(lemon_ctx->x3a);
+      lemon_ctx->x3a = 0;
     }else{
       int i;
-      x3a->ht = (x3node**)&(x3a->tbl[128]);
-      for(i=0; i<128; i++) x3a->ht[i] = 0;
+      lemon_ctx->x3a->ht = (x3node**)&(lemon_ctx->x3a->tbl[128]);
+      for(i=0; i<128; i++) lemon_ctx->x3a->ht[i] = 0;
     }
   }
 }
@@ -5849,10 +8707,10 @@ int State_insert(struct state *data, struct config *key)
   unsigned h;
   unsigned ph;
 
-  if( x3a==0 ) return 0;
+  if( lemon_ctx->x3a==0 ) return 0;
   ph = statehash(key);
-  h = ph & (x3a->size-1);
-  np = x3a->ht[h];
+  h = ph & (lemon_ctx->x3a->size-1);
+  np = lemon_ctx->x3a->ht[h];
   while( np ){
     if( statecmp(np->key,key)==0 ){
       /* An existing entry with the same key is found. */
@@ -5861,19 +8719,19 @@ int State_insert(struct state *data, struct config *key)
     }
     np = np->next;
   }
-  if( x3a->count>=x3a->size ){
+  if( lemon_ctx->x3a->count>=lemon_ctx->x3a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x3 array;
-    array.size = arrSize = x3a->size*2;
-    array.count = x3a->count;
-    array.tbl = (x3node*)calloc(arrSize, sizeof(x3node) + sizeof(x3node*));
+    array.size = arrSize = lemon_ctx->x3a->size*2;
+    array.count = lemon_ctx->x3a->count;
+    array.tbl = (x3node*)lemon_calloc(arrSize, sizeof(x3node) + sizeof(x3node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x3node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x3a->count; i++){
+    for(i=0; i<lemon_ctx->x3a->count; i++){
       x3node *oldnp, *newnp;
-      oldnp = &(x3a->tbl[i]);
+      oldnp = &(lemon_ctx->x3a->tbl[i]);
       h = statehash(oldnp->key) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -5883,18 +8741,18 @@ int State_insert(struct state *data, struct config *key)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    free(x3a->tbl);
-    *x3a = array;
+    lemon_free(lemon_ctx->x3a->tbl);
+    *lemon_ctx->x3a = array;
   }
   /* Insert the new data */
-  h = ph & (x3a->size-1);
-  np = &(x3a->tbl[x3a->count++]);
+  h = ph & (lemon_ctx->x3a->size-1);
+  np = &(lemon_ctx->x3a->tbl[lemon_ctx->x3a->count++]);
   np->key = key;
   np->data = data;
-  if( x3a->ht[h] ) x3a->ht[h]->from = &(np->next);
-  np->next = x3a->ht[h];
-  x3a->ht[h] = np;
-  np->from = &(x3a->ht[h]);
+  if( lemon_ctx->x3a->ht[h] ) lemon_ctx->x3a->ht[h]->from = &(np->next);
+  np->next = lemon_ctx->x3a->ht[h];
+  lemon_ctx->x3a->ht[h] = np;
+  np->from = &(lemon_ctx->x3a->ht[h]);
   return 1;
 }
 
@@ -5905,9 +8763,9 @@ struct state *State_find(struct config *key)
   unsigned h;
   x3node *np;
 
-  if( x3a==0 ) return 0;
-  h = statehash(key) & (x3a->size-1);
-  np = x3a->ht[h];
+  if( lemon_ctx->x3a==0 ) return 0;
+  h = statehash(key) & (lemon_ctx->x3a->size-1);
+  np = lemon_ctx->x3a->ht[h];
   while( np ){
     if( statecmp(np->key,key)==0 ) break;
     np = np->next;
@@ -5922,11 +8780,11 @@ struct state **State_arrayof(void)
 {
   struct state **array;
   int i,arrSize;
-  if( x3a==0 ) return 0;
-  arrSize = x3a->count;
-  array = (struct state **)calloc(arrSize, sizeof(struct state *));
+  if( lemon_ctx->x3a==0 ) return 0;
+  arrSize = lemon_ctx->x3a->count;
+  array = (struct state **)lemon_calloc(arrSize, sizeof(struct state *));
   if( array ){
-    for(i=0; i<arrSize; i++) array[i] = x3a->tbl[i].data;
+    for(i=0; i<arrSize; i++) array[i] = lemon_ctx->x3a->tbl[i].data;
   }
   return array;
 }
@@ -5961,23 +8819,22 @@ typedef struct s_x4node {
 } x4node;
 
 /* There is only one instance of the array, which is the following */
-static struct s_x4 *x4a;
 
 /* Allocate a new associative array */
 void Configtable_init(void){
-  if( x4a ) return;
-  x4a = (struct s_x4*)malloc( sizeof(struct s_x4) );
-  if( x4a ){
-    x4a->size = 64;
-    x4a->count = 0;
-    x4a->tbl = (x4node*)calloc(64, sizeof(x4node) + sizeof(x4node*));
-    if( x4a->tbl==0 ){
-      free(x4a);
-      x4a = 0;
+  if( lemon_ctx->x4a ) return;
+  lemon_ctx->x4a = (struct s_x4*)lemon_malloc( sizeof(struct s_x4) );
+  if( lemon_ctx->x4a ){
+    lemon_ctx->x4a->size = 64;
+    lemon_ctx->x4a->count = 0;
+    lemon_ctx->x4a->tbl = (x4node*)lemon_calloc(64, sizeof(x4node) + sizeof(x4node*));
+    if( lemon_ctx->x4a->tbl==0 ){
+      lemon_free(lemon_ctx->x4a);
+      lemon_ctx->x4a = 0;
     }else{
       int i;
-      x4a->ht = (x4node**)&(x4a->tbl[64]);
-      for(i=0; i<64; i++) x4a->ht[i] = 0;
+      lemon_ctx->x4a->ht = (x4node**)&(lemon_ctx->x4a->tbl[64]);
+      for(i=0; i<64; i++) lemon_ctx->x4a->ht[i] = 0;
     }
   }
 }
@@ -5989,10 +8846,10 @@ int Configtable_insert(struct config *data)
   unsigned h;
   unsigned ph;
 
-  if( x4a==0 ) return 0;
+  if( lemon_ctx->x4a==0 ) return 0;
   ph = confighash(data);
-  h = ph & (x4a->size-1);
-  np = x4a->ht[h];
+  h = ph & (lemon_ctx->x4a->size-1);
+  np = lemon_ctx->x4a->ht[h];
   while( np ){
     if( Configcmp((const char *) np->data,(const char *) data)==0 ){
       /* An existing entry with the same key is found. */
@@ -6001,19 +8858,19 @@ int Configtable_insert(struct config *data)
     }
     np = np->next;
   }
-  if( x4a->count>=x4a->size ){
+  if( lemon_ctx->x4a->count>=lemon_ctx->x4a->size ){
     /* Need to make the hash table bigger */
     int i,arrSize;
     struct s_x4 array;
-    array.size = arrSize = x4a->size*2;
-    array.count = x4a->count;
-    array.tbl = (x4node*)calloc(arrSize, sizeof(x4node) + sizeof(x4node*));
+    array.size = arrSize = lemon_ctx->x4a->size*2;
+    array.count = lemon_ctx->x4a->count;
+    array.tbl = (x4node*)lemon_calloc(arrSize, sizeof(x4node) + sizeof(x4node*));
     if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
     array.ht = (x4node**)&(array.tbl[arrSize]);
     for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<x4a->count; i++){
+    for(i=0; i<lemon_ctx->x4a->count; i++){
       x4node *oldnp, *newnp;
-      oldnp = &(x4a->tbl[i]);
+      oldnp = &(lemon_ctx->x4a->tbl[i]);
       h = confighash(oldnp->data) & (arrSize-1);
       newnp = &(array.tbl[i]);
       if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
@@ -6022,17 +8879,17 @@ int Configtable_insert(struct config *data)
       newnp->from = &(array.ht[h]);
       array.ht[h] = newnp;
     }
-    free(x4a->tbl);
-    *x4a = array;
+    lemon_free(lemon_ctx->x4a->tbl);
+    *lemon_ctx->x4a = array;
   }
   /* Insert the new data */
-  h = ph & (x4a->size-1);
-  np = &(x4a->tbl[x4a->count++]);
+  h = ph & (lemon_ctx->x4a->size-1);
+  np = &(lemon_ctx->x4a->tbl[lemon_ctx->x4a->count++]);
   np->data = data;
-  if( x4a->ht[h] ) x4a->ht[h]->from = &(np->next);
-  np->next = x4a->ht[h];
-  x4a->ht[h] = np;
-  np->from = &(x4a->ht[h]);
+  if( lemon_ctx->x4a->ht[h] ) lemon_ctx->x4a->ht[h]->from = &(np->next);
+  np->next = lemon_ctx->x4a->ht[h];
+  lemon_ctx->x4a->ht[h] = np;
+  np->from = &(lemon_ctx->x4a->ht[h]);
   return 1;
 }
 
@@ -6043,9 +8900,9 @@ struct config *Configtable_find(struct config *key)
   int h;
   x4node *np;
 
-  if( x4a==0 ) return 0;
-  h = confighash(key) & (x4a->size-1);
-  np = x4a->ht[h];
+  if( lemon_ctx->x4a==0 ) return 0;
+  h = confighash(key) & (lemon_ctx->x4a->size-1);
+  np = lemon_ctx->x4a->ht[h];
   while( np ){
     if( Configcmp((const char *) np->data,(const char *) key)==0 ) break;
     np = np->next;
@@ -6058,9 +8915,9 @@ struct config *Configtable_find(struct config *key)
 void Configtable_clear(int(*f)(struct config *))
 {
   int i;
-  if( x4a==0 || x4a->count==0 ) return;
-  if( f ) for(i=0; i<x4a->count; i++) (*f)(x4a->tbl[i].data);
-  for(i=0; i<x4a->size; i++) x4a->ht[i] = 0;
-  x4a->count = 0;
+  if( lemon_ctx->x4a==0 || lemon_ctx->x4a->count==0 ) return;
+  if( f ) for(i=0; i<lemon_ctx->x4a->count; i++) (*f)(lemon_ctx->x4a->tbl[i].data);
+  for(i=0; i<lemon_ctx->x4a->size; i++) lemon_ctx->x4a->ht[i] = 0;
+  lemon_ctx->x4a->count = 0;
   return;
 }
@@ -17,6 +17,22 @@ public:
 	virtual bool will_accept() const = 0;
     virtual int fallback(int iToken) const = 0;
 
+	// Scan and parse a whole input with the %token_pattern scanner.
+	// Parsers without one consume nothing.
+	virtual int scan(const char *, int) { return 0; }
+
+	// Scan and parse the next chunk of a larger input; see lemon_stream.h.
+	// Parsers without a scanner reject the first byte.
+	virtual int scan_chunk(const char *, int, bool) { return -1; }
+
+	// Where the input can be split for lemon_parallel.h: just past the
+	// first %sync token ending at or after min.  Without %sync, nowhere.
+	virtual int scan_sync(const char *, int n, int) const { return n; }
+
+	// Accept or reject a whole run of token codes, without token values
+	// or reduce code.  Only grammars with %recognizer implement it.
+	virtual bool accepts(const int *, int) const { return false; }
+
 	virtual void reset() {}
 
 protected:
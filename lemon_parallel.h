@@ -0,0 +1,107 @@
+#ifndef __lemon_parallel_h__
+#define __lemon_parallel_h__
+#include "lemon_base.h"
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Parses an input made of independent top-level statements on several
+// threads.  The grammar names the tokens that end a statement with %sync
+// and must accept any run of whole statements as a complete input:
+//
+//	%sync SEMI.
+//	program ::= stmts.
+//	stmts ::= stmts stmt.
+//	stmts ::= .
+//	stmt ::= ... SEMI.
+//
+// The input is cut into chunks of at least chunk_size bytes, each ending
+// just after a %sync token.  Finding the cuts is one serial pass of the
+// scanner DFA; the parsing is spread over the threads.  Every chunk gets
+// a fresh parser from make(), is passed to scan() and then to finish(),
+// whose result is stored at the chunk's position:
+//
+//	auto results = lemon_parse_parallel(z, n,
+//		[]{ return std::unique_ptr<my_parser>(new yypParser()); },
+//		[](my_parser &p, const lemon_chunk &c) { return p.take_result(); });
+//
+// The results come back in input order.  The result type must be default
+// constructible.  If make() or finish() or a parse action throws, the
+// remaining chunks are skipped and the first exception is rethrown.
+struct lemon_chunk {
+	size_t offset;	// Where the chunk starts in the input
+	size_t length;	// Bytes in the chunk
+	int scanned;	// What scan() returned: length, or the offset of a bad byte
+};
+
+template<class Make, class Finish>
+auto lemon_parse_parallel(const char *z, size_t n, Make make, Finish finish,
+	unsigned threads = 0, size_t chunk_size = 1 << 20)
+	-> std::vector<decltype(finish(*make(), std::declval<const lemon_chunk &>()))>
+{
+	typedef decltype(finish(*make(), std::declval<const lemon_chunk &>())) result_type;
+
+	std::vector<lemon_chunk> chunks;
+	{
+		auto splitter = make();
+		size_t pos = 0;
+		do {
+			size_t rest = n - pos;
+			int window = rest > INT_MAX ? INT_MAX : (int)rest;
+			int min = chunk_size < (size_t)window ? (int)chunk_size : window;
+			int len = splitter->scan_sync(z + pos, window, min);
+			if (len <= 0) len = window;
+			chunks.push_back(lemon_chunk{pos, (size_t)len, 0});
+			pos += len;
+		} while (pos < n);
+	}
+
+	// Each chunk's result gets storage of its own, which a
+	// std::vector<bool> would not give the threads writing them.
+	std::unique_ptr<result_type[]> slots(new result_type[chunks.size()]);
+	std::atomic<size_t> next(0);
+	std::exception_ptr error;
+	std::mutex error_lock;
+
+	auto work = [&]() {
+		for (;;) {
+			size_t i = next++;
+			if (i >= chunks.size()) return;
+			try {
+				lemon_chunk &c = chunks[i];
+				auto parser = make();
+				c.scanned = parser->scan(z + c.offset, (int)c.length);
+				slots[i] = finish(*parser, c);
+			} catch (...) {
+				std::lock_guard<std::mutex> guard(error_lock);
+				if (!error) error = std::current_exception();
+				next = chunks.size();
+				return;
+			}
+		}
+	};
+
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	if (threads == 0) threads = 1;
+	if (threads > chunks.size()) threads = (unsigned)chunks.size();
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < threads; ++i) pool.emplace_back(work);
+	work();
+	for (auto &t : pool) t.join();
+	if (error) std::rethrow_exception(error);
+
+	std::vector<result_type> results;
+	results.reserve(chunks.size());
+	for (size_t i = 0; i < chunks.size(); ++i)
+		results.push_back(std::move(slots[i]));
+	return results;
+}
+
+#endif
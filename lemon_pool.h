@@ -0,0 +1,112 @@
+#ifndef __lemon_pool_h__
+#define __lemon_pool_h__
+#include "lemon_base.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Keeps finished parsers for reuse, so that a program that parses many
+// short inputs (one per request, say) does not build and free a parser for
+// each.  A parser is reset() when it comes back to the pool.  That drops
+// its stack at once, running only the destructors that do something, and
+// a parser keeps any stack it has grown on the heap.
+//
+//	lemon_pool<my_parser> pool(
+//		[]{ return std::unique_ptr<my_parser>(new yypParser()); });
+//	{
+//		auto p = pool.acquire();
+//		p->scan(z, n);
+//	}	// p goes back to the pool here
+//
+// A pool has no lock, so each thread needs its own.
+// lemon_thread_pool<my_parser>(make) returns the calling thread's pool for
+// the parser type, and creates it on first use.  A parser must be released
+// on the thread that acquired it, before the thread exits.  At most
+// max_idle parsers wait in a pool; the rest are freed when released.
+template<class Parser>
+class lemon_pool {
+public:
+	typedef std::unique_ptr<Parser> pointer;
+	typedef std::function<pointer()> make_type;
+
+	// Owns a parser taken from the pool and gives it back when destroyed.
+	class handle {
+	public:
+		handle() : pool(nullptr) {}
+		handle(handle &&other) noexcept
+			: pool(other.pool), parser(std::move(other.parser)) {}
+		handle &operator=(handle &&other) noexcept {
+			if (this != &other) {
+				release();
+				pool = other.pool;
+				parser = std::move(other.parser);
+			}
+			return *this;
+		}
+		~handle() { release(); }
+
+		Parser &operator*() const { return *parser; }
+		Parser *operator->() const { return parser.get(); }
+		Parser *get() const { return parser.get(); }
+		explicit operator bool() const { return parser != nullptr; }
+
+		// Give the parser back now.
+		void release() {
+			if (parser) pool->put(std::move(parser));
+		}
+
+	private:
+		friend class lemon_pool;
+		handle(lemon_pool *p, pointer q) : pool(p), parser(std::move(q)) {}
+
+		lemon_pool *pool;
+		pointer parser;
+	};
+
+	explicit lemon_pool(make_type make, size_t max_idle = 16)
+		: make(std::move(make)), max_idle(max_idle) {}
+
+	lemon_pool(const lemon_pool &) = delete;
+	lemon_pool &operator=(const lemon_pool &) = delete;
+
+	// A parser ready for a new input: an idle one, or a new one from make().
+	handle acquire() {
+		if (idle.empty()) return handle(this, make());
+		pointer p = std::move(idle.back());
+		idle.pop_back();
+		return handle(this, std::move(p));
+	}
+
+	// Parsers waiting to be acquired.
+	size_t size() const { return idle.size(); }
+
+	// Free the parsers waiting to be acquired.
+	void clear() { idle.clear(); }
+
+private:
+	// A parser whose reset() throws is freed instead of kept.
+	void put(pointer p) noexcept {
+		try {
+			p->reset();
+			if (idle.size() < max_idle) idle.push_back(std::move(p));
+		} catch (...) {
+		}
+	}
+
+	make_type make;
+	size_t max_idle;
+	std::vector<pointer> idle;
+};
+
+template<class Parser>
+lemon_pool<Parser> &lemon_thread_pool(typename lemon_pool<Parser>::make_type make,
+	size_t max_idle = 16)
+{
+	static thread_local lemon_pool<Parser> pool(std::move(make), max_idle);
+	return pool;
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef __lemon_stream_h__
+#define __lemon_stream_h__
+#include "lemon_base.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Feeds a file to a parser with a %token_pattern scanner a chunk at a time,
+// so the whole input never has to be in memory.  A token that straddles
+// two chunks is held back and scanned again with the next one.
+//
+//	auto p = std::unique_ptr<my_parser>(new yypParser());
+//	lemon_stream<token> s(*p);
+//	if (!s.parse_file("big.txt")) ... s.offset(), s.error() ...
+//
+// parse_fd() reads into a buffer that holds one chunk plus the unscanned
+// tail of the last one.  A token that views its text (std::string_view)
+// would be overwritten by the next read, so for such a token type
+// parse_fd() moves to a new buffer when one fills and keeps the old ones
+// until it returns; its memory then grows with the input.  Token values
+// that own their text (std::string, or a YYSCANMINOR that copies) need
+// only the one buffer.  parse_mmap() maps the file and hands the parser
+// windows of it, releasing the pages behind the scan as it goes.  The
+// mapping stays in place until parse_mmap() returns, so until then tokens
+// may point into it; released pages are read back in on demand.
+
+// True for a token type that the scanner builds from a pointer and a length
+// and that is trivially copyable, so that it can only point at the text.
+template<class T>
+struct lemon_token_views_text : std::integral_constant<bool,
+	std::is_constructible<T, const char *, std::size_t>::value &&
+	std::is_trivially_copyable<T>::value> {};
+
+template<class TokenType>
+class lemon_stream {
+public:
+	explicit lemon_stream(lemon_base<TokenType> &parser, size_t chunk_size = 1 << 16) :
+		_parser(parser), _chunk(chunk_size ? chunk_size : 1)
+	{}
+
+	// Read fd until end of file.  True if the whole input was scanned.
+	bool parse_fd(int fd) {
+		std::vector<std::vector<char>> kept;	// Buffers tokens may point into
+		std::vector<char> buffer(_chunk);
+		size_t start = 0, used = 0;	// The unscanned bytes of buffer
+		_offset = 0;
+		_error = 0;
+		for (;;) {
+			if (used == buffer.size()) {
+				size_t tail = used - start, size = buffer.size();
+				if (tail == size) {
+					// One token fills the buffer; make room for the rest of it.
+					if (size > INT_MAX / 2) { _error = EFBIG; return false; }
+					size *= 2;
+				}
+				if (lemon_token_views_text<TokenType>::value) {
+					std::vector<char> next(size);
+					std::memcpy(next.data(), buffer.data() + start, tail);
+					kept.push_back(std::move(buffer));
+					buffer = std::move(next);
+				} else {
+					std::memmove(buffer.data(), buffer.data() + start, tail);
+					buffer.resize(size);
+				}
+				start = 0;
+				used = tail;
+			}
+			ssize_t got = ::read(fd, buffer.data() + used, buffer.size() - used);
+			if (got < 0) {
+				if (errno == EINTR) continue;
+				_error = errno;
+				return false;
+			}
+			used += got;
+			bool last = got == 0;
+			int rc = _parser.scan_chunk(buffer.data() + start, (int)(used - start), last);
+			if (rc < 0) { _offset += -1 - rc; return false; }
+			_offset += rc;
+			start += rc;
+			if (last) return true;
+		}
+	}
+
+	// Map fd and scan it in windows of the chunk size.  Falls back to
+	// parse_fd() for input that cannot be mapped (pipes, terminals).
+	bool parse_mmap(int fd) {
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+			return parse_fd(fd);
+		size_t size = (size_t)st.st_size;
+		void *map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) return parse_fd(fd);
+#ifdef MADV_SEQUENTIAL
+		::madvise(map, size, MADV_SEQUENTIAL);
+#endif
+		const char *z = (const char *)map;
+		size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+		size_t released = 0, window = _chunk;
+		bool ok = true;
+		_offset = 0;
+		_error = 0;
+		while (ok) {
+			size_t n = size - _offset;
+			bool last = n <= window;
+			if (!last) n = window;
+			int rc = _parser.scan_chunk(z + _offset, (int)n, last);
+			if (rc < 0) { _offset += -1 - rc; ok = false; break; }
+			_offset += rc;
+			if (last) break;
+			if (rc == 0) {
+				// One token fills the window; look further ahead.
+				if (window > INT_MAX / 2) { _error = EFBIG; ok = false; break; }
+				window *= 2;
+			}
+			size_t done = _offset / page * page;
+			if (done > released) {
+#ifdef MADV_DONTNEED
+				::madvise((char *)map + released, done - released, MADV_DONTNEED);
+#endif
+				released = done;
+			}
+		}
+		::munmap(map, size);
+		return ok;
+	}
+
+	// Open path, parse it with parse_mmap() and close it.
+	bool parse_file(const char *path) {
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) {
+			_offset = 0;
+			_error = errno;
+			return false;
+		}
+		bool ok = parse_mmap(fd);
+		::close(fd);
+		return ok;
+	}
+
+	// Bytes scanned so far.  After a scan error, the offset of the byte
+	// that no pattern matches.
+	long long offset() const { return _offset; }
+
+	// The errno of a failed open or read, 0 otherwise.
+	int error() const { return _error; }
+
+private:
+	lemon_stream(const lemon_stream &) = delete;
+	lemon_stream &operator=(const lemon_stream &) = delete;
+
+	lemon_base<TokenType> &_parser;
+	size_t _chunk;
+	size_t _offset = 0;
+	int _error = 0;
+};
+
+#endif
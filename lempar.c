@@ -47,6 +47,9 @@
 **                       values which should be used if the original symbol
 **                       would not parse.  This permits keywords to sometimes
 **                       be used as identifiers, for example.
+**    YYFALLBACKFOLDED   If defined, lemon -F has already copied the fallback
+**                       and wildcard actions into yy_action[], so neither
+**                       is looked up at run time.
 **    YYACTIONTYPE       is the data type used for "action codes" - numbers
 **                       that indicate what to do in response to the next
 **                       token.
@@ -65,6 +68,12 @@
 **                       for terminal symbols is called "yy0".
 **    YYSTACKDEPTH       is the maximum depth of the parser's stack.  If
 **                       zero the stack is dynamically sized using realloc()
+**    YYSTACKDEPTH_BOUND is defined if no input can make the stack deeper
+**                       than this
+**    YYSTACKHEADROOM    is defined if no token pushes more than this many
+**                       entries onto the stack
+**    YYSTACKINLINE      is how many entries a dynamically sized stack holds
+**                       inside the parser before it moves to the heap
 **    ParseARG_SDECL     A static variable declaration for the %extra_argument
 **    ParseARG_PDECL     A parameter declaration for the %extra_argument
 **    ParseARG_PARAM     Code to pass %extra_argument as a subroutine parameter
@@ -76,6 +85,12 @@
 **    YYNSTATE           the combined number of states.
 **    YYNRULE            the number of rules in the grammar
 **    YYNTOKEN           Number of terminal symbols
+**    YYTOKENCLASS       If defined, the number of terminal classes.  lemon -e
+**                       indexes the token rows by yy_token_class[] instead
+**                       of by terminal.
+**    YYRECOGNIZER       If defined, the grammar has %recognizer.  Its rules
+**                       have no code, and ParseAccepts() checks a whole
+**                       array of token codes with a stack of states only.
 **    YY_MAX_SHIFT       Maximum value for shift actions
 **    YY_MIN_SHIFTREDUCE Minimum value for shift-reduce actions
 **    YY_MAX_SHIFTREDUCE Maximum value for shift-reduce actions
@@ -93,6 +108,47 @@
 /************* End control #defines *******************************************/
 #define YY_NLOOKAHEAD ((int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])))
 
+/* The column of a terminal in the token rows of the action table */
+#ifdef YYTOKENCLASS
+# define YYCLASS(X) yy_token_class[X]
+# define YYNCLASS   YYTOKENCLASS
+#else
+# define YYCLASS(X) (X)
+# define YYNCLASS   YYNTOKEN
+#endif
+
+/* lemon defines YYSTACKDEPTH_BOUND when no input can take the stack
+** deeper than that, and YYSTACKHEADROOM when no token pushes more than
+** that many entries.  With the bound, the stack is made that deep, unless
+** YYSTACKDEPTH is set lower, and a push is never checked.  Otherwise,
+** with the headroom (YYTOKENCHECK), the stack is checked once per token
+** and the headroom is kept past YYSTACKDEPTH.  Without either
+** (YYPUSHCHECK), every push is checked.  Define YYNOSTACKBOUND to check
+** every push anyway. */
+#ifdef YYNOSTACKBOUND
+# undef YYSTACKDEPTH_BOUND
+# undef YYSTACKHEADROOM
+#endif
+#if defined(YYSTACKDEPTH_BOUND) \
+ && (YYSTACKDEPTH<=0 || YYSTACKDEPTH>=YYSTACKDEPTH_BOUND)
+# undef YYSTACKDEPTH
+# define YYSTACKDEPTH YYSTACKDEPTH_BOUND
+# undef YYSTACKHEADROOM
+# define YYSTACKHEADROOM 0
+#elif defined(YYSTACKHEADROOM)
+# define YYTOKENCHECK 1
+#else
+# define YYSTACKHEADROOM 0
+# define YYPUSHCHECK 1
+#endif
+
+/* A stack that grows (YYSTACKDEPTH<=0) starts out in YYSTACKINLINE entries
+** inside the parser itself, so a parser costs no allocation until the input
+** nests deeper than that. */
+#ifndef YYSTACKINLINE
+# define YYSTACKINLINE 16
+#endif
+
 /* Define the yytestcase() macro to be a no-op if is not already defined
 ** otherwise.
 **
@@ -105,6 +161,21 @@
 # define yytestcase(X)
 #endif
 
+/* Branch hints, and a marker for the routines that run rarely: error
+** recovery, stack overflow, accept and failure.  Keeping those out of
+** line leaves Parse() with a compact shift/reduce loop.  Define
+** YYNOHOTCOLD to turn the hints off.
+*/
+#if defined(__GNUC__) && !defined(YYNOHOTCOLD)
+# define YYLIKELY(X)   __builtin_expect(!!(X),1)
+# define YYUNLIKELY(X) __builtin_expect(!!(X),0)
+# define YYCOLD        __attribute__((cold,noinline))
+#else
+# define YYLIKELY(X)   (X)
+# define YYUNLIKELY(X) (X)
+# define YYCOLD
+#endif
+
 
 /* Next are the tables used to determine what action to take based on the
 ** current state and lookahead token.  These tables are used to implement
@@ -216,31 +287,38 @@ struct yyParser {
 #endif
   ParseARG_SDECL                /* A place to hold %extra_argument */
   ParseCTX_SDECL                /* A place to hold %extra_context */
+#ifndef NDEBUG
+  FILE *yyTraceFILE;            /* Where to write trace output, or NULL */
+  char *yyTracePrompt;          /* Prefix for every line of trace output */
+#endif
 #if YYSTACKDEPTH<=0
   int yystksz;                  /* Current side of the stack */
   yyStackEntry *yystack;        /* The parser's stack */
-  yyStackEntry yystk0;          /* First stack entry */
+  yyStackEntry yystk0[YYSTACKINLINE];  /* The stack until it grows */
 #else
-  yyStackEntry yystack[YYSTACKDEPTH];  /* The parser's stack */
+  yyStackEntry yystack[YYSTACKDEPTH+YYSTACKHEADROOM];  /* The stack */
   yyStackEntry *yystackEnd;            /* Last entry in the stack */
 #endif
+#ifdef YYPROFILE
+  unsigned long yyProfileTkn[YYNSTATE];  /* Lookups of each token row */
+  unsigned long yyProfileNt[YYNSTATE];   /* Lookups of each goto row */
+  unsigned long yyProfileRule[YYNRULE];  /* Reductions by each rule */
+#endif
 };
 typedef struct yyParser yyParser;
 
-#ifndef NDEBUG
-#include <stdio.h>
-static FILE *yyTraceFILE = 0;
-static char *yyTracePrompt = 0;
-#endif /* NDEBUG */
-
 #ifndef NDEBUG
 /* 
 ** Turn parser tracing on by giving a stream to which to write the trace
 ** and a prompt to preface each trace message.  Tracing is turned off
 ** by making either argument NULL 
 **
+** Tracing is a property of each parser, so parsers running on different
+** threads may trace to different streams, or not at all.
+**
 ** Inputs:
 ** <ul>
+** <li> A pointer to the parser.
 ** <li> A FILE* to which trace output should be written.
 **      If NULL, then tracing is turned off.
 ** <li> A prefix string written at the beginning of every
@@ -251,11 +329,12 @@ static char *yyTracePrompt = 0;
 ** Outputs:
 ** None.
 */
-void ParseTrace(FILE *TraceFILE, char *zTracePrompt){
-  yyTraceFILE = TraceFILE;
-  yyTracePrompt = zTracePrompt;
-  if( yyTraceFILE==0 ) yyTracePrompt = 0;
-  else if( yyTracePrompt==0 ) yyTraceFILE = 0;
+void ParseTrace(void *yyp, FILE *TraceFILE, char *zTracePrompt){
+  yyParser *yypParser = (yyParser*)yyp;
+  yypParser->yyTraceFILE = TraceFILE;
+  yypParser->yyTracePrompt = zTracePrompt;
+  if( TraceFILE==0 ) yypParser->yyTracePrompt = 0;
+  else if( zTracePrompt==0 ) yypParser->yyTraceFILE = 0;
 }
 #endif /* NDEBUG */
 
@@ -281,16 +360,19 @@ static const char *const yyRuleName[] = {
 ** Try to increase the size of the parser stack.  Return the number
 ** of errors.  Return 0 on success.
 */
-static int yyGrowStack(yyParser *p){
+static YYCOLD int yyGrowStack(yyParser *p){
   int newSize;
   int idx;
+  int i;
   yyStackEntry *pNew;
 
   newSize = p->yystksz*2 + 100;
-  idx = p->yytos ? (int)(p->yytos - p->yystack) : 0;
-  if( p->yystack==&p->yystk0 ){
+  idx = (int)(p->yytos - p->yystack);
+  if( p->yystack==p->yystk0 ){
     pNew = malloc(newSize*sizeof(pNew[0]));
-    if( pNew ) pNew[0] = p->yystk0;
+    if( pNew ){
+      for(i=0; i<=idx && i<p->yystksz; i++) pNew[i] = p->yystk0[i];
+    }
   }else{
     pNew = realloc(p->yystack, newSize*sizeof(pNew[0]));
   }
@@ -298,9 +380,9 @@ static int yyGrowStack(yyParser *p){
     p->yystack = pNew;
     p->yytos = &p->yystack[idx];
 #ifndef NDEBUG
-    if( yyTraceFILE ){
-      fprintf(yyTraceFILE,"%sStack grows from %d to %d entries.\n",
-              yyTracePrompt, p->yystksz, newSize);
+    if( p->yyTraceFILE ){
+      fprintf(p->yyTraceFILE,"%sStack grows from %d to %d entries.\n",
+              p->yyTracePrompt, p->yystksz, newSize);
     }
 #endif
     p->yystksz = newSize;
@@ -323,17 +405,16 @@ static int yyGrowStack(yyParser *p){
 void ParseInit(void *yypRawParser ParseCTX_PDECL){
   yyParser *yypParser = (yyParser*)yypRawParser;
   ParseCTX_STORE
+#ifndef NDEBUG
+  yypParser->yyTraceFILE = 0;
+  yypParser->yyTracePrompt = 0;
+#endif
 #ifdef YYTRACKMAXSTACKDEPTH
   yypParser->yyhwm = 0;
 #endif
 #if YYSTACKDEPTH<=0
-  yypParser->yytos = NULL;
-  yypParser->yystack = NULL;
-  yypParser->yystksz = 0;
-  if( yyGrowStack(yypParser) ){
-    yypParser->yystack = &yypParser->yystk0;
-    yypParser->yystksz = 1;
-  }
+  yypParser->yystack = yypParser->yystk0;
+  yypParser->yystksz = YYSTACKINLINE;
 #endif
 #ifndef YYNOERRORRECOVERY
   yypParser->yyerrcnt = -1;
@@ -344,6 +425,15 @@ void ParseInit(void *yypRawParser ParseCTX_PDECL){
 #if YYSTACKDEPTH>0
   yypParser->yystackEnd = &yypParser->yystack[YYSTACKDEPTH-1];
 #endif
+#ifdef YYPROFILE
+  {
+    int i;
+    for(i=0; i<YYNSTATE; i++){
+      yypParser->yyProfileTkn[i] = yypParser->yyProfileNt[i] = 0;
+    }
+    for(i=0; i<YYNRULE; i++) yypParser->yyProfileRule[i] = 0;
+  }
+#endif
 }
 
 #ifndef Parse_ENGINEALWAYSONSTACK
@@ -415,9 +505,9 @@ static void yy_pop_parser_stack(yyParser *pParser){
   assert( pParser->yytos > pParser->yystack );
   yytos = pParser->yytos--;
 #ifndef NDEBUG
-  if( yyTraceFILE ){
-    fprintf(yyTraceFILE,"%sPopping %s\n",
-      yyTracePrompt,
+  if( pParser->yyTraceFILE ){
+    fprintf(pParser->yyTraceFILE,"%sPopping %s\n",
+      pParser->yyTracePrompt,
       yyTokenName[yytos->major]);
   }
 #endif
@@ -431,7 +521,7 @@ void ParseFinalize(void *p){
   yyParser *pParser = (yyParser*)p;
   while( pParser->yytos>pParser->yystack ) yy_pop_parser_stack(pParser);
 #if YYSTACKDEPTH<=0
-  if( pParser->yystack!=&pParser->yystk0 ) free(pParser->yystack);
+  if( pParser->yystack!=pParser->yystk0 ) free(pParser->yystack);
 #endif
 }
 
@@ -490,7 +580,7 @@ int ParseCoverage(FILE *out){
   for(stateno=0; stateno<YYNSTATE; stateno++){
     i = yy_shift_ofst[stateno];
     for(iLookAhead=0; iLookAhead<YYNTOKEN; iLookAhead++){
-      if( yy_lookahead[i+iLookAhead]!=iLookAhead ) continue;
+      if( yy_lookahead[i+YYCLASS(iLookAhead)]!=YYCLASS(iLookAhead) ) continue;
       if( yycoverage[stateno][iLookAhead]==0 ) nMissed++;
       if( out ){
         fprintf(out,"State %d lookahead %s %s\n", stateno,
@@ -503,40 +593,73 @@ int ParseCoverage(FILE *out){
 }
 #endif
 
+/*
+** Write the counts of parser yyp, built with -DYYPROFILE, in the form that
+** lemon --profile=FILE reads back.  The counts are the lookups of each
+** state's token row and goto row and the reductions by each rule, and
+** each parser keeps its own.  States are written under the numbers that
+** lemon gave them before sorting, which do not change from one build to
+** the next.
+*/
+#if defined(YYPROFILE)
+void ParseProfile(void *yyp, FILE *out){
+  yyParser *yypParser = (yyParser*)yyp;
+  int i;
+  fprintf(out, "lemon-profile %d %d\n", YYNSTATEID, YYNRULE);
+  for(i=0; i<YYNSTATE; i++){
+    if( yypParser->yyProfileTkn[i]==0 && yypParser->yyProfileNt[i]==0 ){
+      continue;
+    }
+    fprintf(out, "state %d %lu %lu\n", yyStateId[i],
+            yypParser->yyProfileTkn[i], yypParser->yyProfileNt[i]);
+  }
+  for(i=0; i<YYNRULE; i++){
+    if( yypParser->yyProfileRule[i] ){
+      fprintf(out, "rule %d %lu\n", i, yypParser->yyProfileRule[i]);
+    }
+  }
+}
+#endif
+
 /*
 ** Find the appropriate action for a parser given the terminal
 ** look-ahead token iLookAhead.
 */
 static YYACTIONTYPE yy_find_shift_action(
+  yyParser *yypParser,      /* The parser */
   YYCODETYPE iLookAhead,    /* The look-ahead token */
   YYACTIONTYPE stateno      /* Current state number */
 ){
   int i;
+  YYCODETYPE iClass;        /* Column of iLookAhead in the token rows */
 
   if( stateno>YY_MAX_SHIFT ) return stateno;
-  assert( stateno <= YY_SHIFT_MAX );
 #if defined(YYCOVERAGE)
   yycoverage[stateno][iLookAhead] = 1;
+#endif
+#if defined(YYPROFILE)
+  yypParser->yyProfileTkn[stateno]++;
 #endif
   do{
     i = stateno <= YY_SHIFT_COUNT ? yy_shift_ofst[stateno] : stateno;
     assert( i>=0 );
     assert( i<=YY_ACTTAB_COUNT );
-    assert( i+YYNTOKEN<=(int)YY_NLOOKAHEAD );
+    assert( i+YYNCLASS<=(int)YY_NLOOKAHEAD );
     assert( iLookAhead!=YYNOCODE );
     assert( iLookAhead < YYNTOKEN );
-    i += iLookAhead;
+    iClass = YYCLASS(iLookAhead);
+    i += iClass;
     assert( i<(int)YY_NLOOKAHEAD );
-    if( yy_lookahead[i]!=iLookAhead ){
-#ifdef YYFALLBACK
+    if( yy_lookahead[i]!=iClass ){
+#if defined(YYFALLBACK) && !defined(YYFALLBACKFOLDED)
       YYCODETYPE iFallback;            /* Fallback token */
       assert( iLookAhead<sizeof(yyFallback)/sizeof(yyFallback[0]) );
       iFallback = yyFallback[iLookAhead];
       if( iFallback!=0 ){
 #ifndef NDEBUG
-        if( yyTraceFILE ){
-          fprintf(yyTraceFILE, "%sFALLBACK %s => %s\n",
-             yyTracePrompt, yyTokenName[iLookAhead], yyTokenName[iFallback]);
+        if( yypParser->yyTraceFILE ){
+          fprintf(yypParser->yyTraceFILE, "%sFALLBACK %s => %s\n",
+             yypParser->yyTracePrompt, yyTokenName[iLookAhead], yyTokenName[iFallback]);
         }
 #endif
         assert( yyFallback[iFallback]==0 ); /* Fallback loop must terminate */
@@ -544,15 +667,15 @@ static YYACTIONTYPE yy_find_shift_action(
         continue;
       }
 #endif
-#ifdef YYWILDCARD
+#if defined(YYWILDCARD) && !defined(YYFALLBACKFOLDED)
       {
-        int j = i - iLookAhead + YYWILDCARD;
+        int j = i - iClass + YYCLASS(YYWILDCARD);
         assert( j<(int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])) );
-        if( yy_lookahead[j]==YYWILDCARD && iLookAhead>0 ){
+        if( yy_lookahead[j]==YYCLASS(YYWILDCARD) && iLookAhead>0 ){
 #ifndef NDEBUG
-          if( yyTraceFILE ){
-            fprintf(yyTraceFILE, "%sWILDCARD %s => %s\n",
-               yyTracePrompt, yyTokenName[iLookAhead],
+          if( yypParser->yyTraceFILE ){
+            fprintf(yypParser->yyTraceFILE, "%sWILDCARD %s => %s\n",
+               yypParser->yyTracePrompt, yyTokenName[iLookAhead],
                yyTokenName[YYWILDCARD]);
           }
 #endif /* NDEBUG */
@@ -573,10 +696,14 @@ static YYACTIONTYPE yy_find_shift_action(
 ** look-ahead token iLookAhead.
 */
 static YYACTIONTYPE yy_find_reduce_action(
+  yyParser *yypParser,      /* The parser */
   YYACTIONTYPE stateno,     /* Current state number */
   YYCODETYPE iLookAhead     /* The look-ahead token */
 ){
   int i;
+#if defined(YYPROFILE)
+  yypParser->yyProfileNt[stateno]++;
+#endif
 #ifdef YYERRORSYMBOL
   if( stateno>YY_REDUCE_COUNT ){
     return yy_default[stateno];
@@ -601,12 +728,13 @@ static YYACTIONTYPE yy_find_reduce_action(
 /*
 ** The following routine is called if the stack overflows.
 */
-static void yyStackOverflow(yyParser *yypParser){
+#if defined(YYPUSHCHECK) || defined(YYTOKENCHECK)
+static YYCOLD void yyStackOverflow(yyParser *yypParser){
    ParseARG_FETCH
    ParseCTX_FETCH
 #ifndef NDEBUG
-   if( yyTraceFILE ){
-     fprintf(yyTraceFILE,"%sStack Overflow!\n",yyTracePrompt);
+   if( yypParser->yyTraceFILE ){
+     fprintf(yypParser->yyTraceFILE,"%sStack Overflow!\n",yypParser->yyTracePrompt);
    }
 #endif
    while( yypParser->yytos>yypParser->yystack ) yy_pop_parser_stack(yypParser);
@@ -618,20 +746,21 @@ static void yyStackOverflow(yyParser *yypParser){
    ParseARG_STORE /* Suppress warning about unused %extra_argument var */
    ParseCTX_STORE
 }
+#endif
 
 /*
 ** Print tracing information for a SHIFT action
 */
 #ifndef NDEBUG
 static void yyTraceShift(yyParser *yypParser, int yyNewState, const char *zTag){
-  if( yyTraceFILE ){
+  if( YYUNLIKELY(yypParser->yyTraceFILE) ){
     if( yyNewState<YYNSTATE ){
-      fprintf(yyTraceFILE,"%s%s '%s', go to state %d\n",
-         yyTracePrompt, zTag, yyTokenName[yypParser->yytos->major],
+      fprintf(yypParser->yyTraceFILE,"%s%s '%s', go to state %d\n",
+         yypParser->yyTracePrompt, zTag, yyTokenName[yypParser->yytos->major],
          yyNewState);
     }else{
-      fprintf(yyTraceFILE,"%s%s '%s', pending reduce %d\n",
-         yyTracePrompt, zTag, yyTokenName[yypParser->yytos->major],
+      fprintf(yypParser->yyTraceFILE,"%s%s '%s', pending reduce %d\n",
+         yypParser->yyTracePrompt, zTag, yyTokenName[yypParser->yytos->major],
          yyNewState - YY_MIN_REDUCE);
     }
   }
@@ -657,14 +786,18 @@ static void yy_shift(
     assert( yypParser->yyhwm == (int)(yypParser->yytos - yypParser->yystack) );
   }
 #endif
-#if YYSTACKDEPTH>0 
-  if( yypParser->yytos>yypParser->yystackEnd ){
+#if !defined(YYPUSHCHECK) && YYSTACKDEPTH>0
+  assert( yypParser->yytos<=yypParser->yystackEnd+YYSTACKHEADROOM );
+#elif !defined(YYPUSHCHECK)
+  assert( yypParser->yytos<&yypParser->yystack[yypParser->yystksz] );
+#elif YYSTACKDEPTH>0
+  if( YYUNLIKELY(yypParser->yytos>yypParser->yystackEnd) ){
     yypParser->yytos--;
     yyStackOverflow(yypParser);
     return;
   }
 #else
-  if( yypParser->yytos>=&yypParser->yystack[yypParser->yystksz] ){
+  if( YYUNLIKELY(yypParser->yytos>=&yypParser->yystack[yypParser->yystksz]) ){
     if( yyGrowStack(yypParser) ){
       yypParser->yytos--;
       yyStackOverflow(yypParser);
@@ -694,7 +827,28 @@ static const signed char yyRuleInfoNRhs[] = {
 %%
 };
 
-static void yy_accept(yyParser*);  /* Forward Declaration */
+static YYCOLD void yy_accept(yyParser*);  /* Forward Declaration */
+
+/*
+** With the -R option, lemon writes each reduce action as a function of
+** its own and yy_reduce() calls it through yyReduceTable[], in place of
+** the switch below.  The functions and the table come at the end of the
+** file.  YYREDUCEACTION(N) begins the function for rule N, YYREDUCEREF(N)
+** is its name, YYREDUCETABLEDEF begins the table, and YYREDUCEBEGIN and
+** YYREDUCEEND go around all of them.
+*/
+#ifdef YYREDUCETABLE
+#define YYREDUCEACTION(N) static void yyReduce##N( \
+  yyParser *yypParser, yyStackEntry *yymsp, \
+  int yyLookahead, ParseTOKENTYPE yyLookaheadToken ParseCTX_PDECL)
+#define YYREDUCEREF(N) yyReduce##N
+#define YYREDUCETABLEDEF static const yyReduceFunc yyReduceTable[YYNRULE]
+#define YYREDUCEBEGIN
+#define YYREDUCEEND
+typedef void (*yyReduceFunc)(yyParser*, yyStackEntry*,
+                             int, ParseTOKENTYPE ParseCTX_PDECL);
+static const yyReduceFunc yyReduceTable[YYNRULE];
+#endif
 
 /*
 ** Perform a reduce action and the shift that must immediately
@@ -717,20 +871,26 @@ static YYACTIONTYPE yy_reduce(
   YYACTIONTYPE yyact;             /* The next action */
   yyStackEntry *yymsp;            /* The top of the parser's stack */
   int yysize;                     /* Amount to pop the stack */
+#ifndef YYREDUCETABLE
   ParseARG_FETCH
+#endif
   (void)yyLookahead;
   (void)yyLookaheadToken;
   yymsp = yypParser->yytos;
+#if defined(YYPROFILE)
+  yypParser->yyProfileRule[yyruleno]++;
+#endif
 #ifndef NDEBUG
-  if( yyTraceFILE && yyruleno<(int)(sizeof(yyRuleName)/sizeof(yyRuleName[0])) ){
+  if( YYUNLIKELY(yypParser->yyTraceFILE)
+   && yyruleno<(int)(sizeof(yyRuleName)/sizeof(yyRuleName[0])) ){
     yysize = yyRuleInfoNRhs[yyruleno];
     if( yysize ){
-      fprintf(yyTraceFILE, "%sReduce %d [%s], go to state %d.\n",
-        yyTracePrompt,
+      fprintf(yypParser->yyTraceFILE, "%sReduce %d [%s], go to state %d.\n",
+        yypParser->yyTracePrompt,
         yyruleno, yyRuleName[yyruleno], yymsp[yysize].stateno);
     }else{
-      fprintf(yyTraceFILE, "%sReduce %d [%s].\n",
-        yyTracePrompt, yyruleno, yyRuleName[yyruleno]);
+      fprintf(yypParser->yyTraceFILE, "%sReduce %d [%s].\n",
+        yypParser->yyTracePrompt, yyruleno, yyRuleName[yyruleno]);
     }
   }
 #endif /* NDEBUG */
@@ -740,13 +900,18 @@ static YYACTIONTYPE yy_reduce(
   ** enough on the stack to push the LHS value */
   if( yyRuleInfoNRhs[yyruleno]==0 ){
 #ifdef YYTRACKMAXSTACKDEPTH
-    if( (int)(yypParser->yytos - yypParser->yystack)>yypParser->yyhwm ){
+    /* Count the entry that the LHS is about to occupy */
+    if( (int)(yypParser->yytos - yypParser->yystack)>=yypParser->yyhwm ){
       yypParser->yyhwm++;
-      assert( yypParser->yyhwm == (int)(yypParser->yytos - yypParser->yystack));
+      assert( yypParser->yyhwm == (int)(yypParser->yytos - yypParser->yystack)+1);
     }
 #endif
-#if YYSTACKDEPTH>0 
-    if( yypParser->yytos>=yypParser->yystackEnd ){
+#if !defined(YYPUSHCHECK) && YYSTACKDEPTH>0
+    assert( yypParser->yytos<yypParser->yystackEnd+YYSTACKHEADROOM );
+#elif !defined(YYPUSHCHECK)
+    assert( yypParser->yytos<&yypParser->yystack[yypParser->yystksz-1] );
+#elif YYSTACKDEPTH>0
+    if( YYUNLIKELY(yypParser->yytos>=yypParser->yystackEnd) ){
       yyStackOverflow(yypParser);
       /* The call to yyStackOverflow() above pops the stack until it is
       ** empty, causing the main parser loop to exit.  So the return value
@@ -754,7 +919,7 @@ static YYACTIONTYPE yy_reduce(
       return 0;
     }
 #else
-    if( yypParser->yytos>=&yypParser->yystack[yypParser->yystksz-1] ){
+    if( YYUNLIKELY(yypParser->yytos>=&yypParser->yystack[yypParser->yystksz-1]) ){
       if( yyGrowStack(yypParser) ){
         yyStackOverflow(yypParser);
         /* The call to yyStackOverflow() above pops the stack until it is
@@ -767,6 +932,12 @@ static YYACTIONTYPE yy_reduce(
 #endif
   }
 
+#ifdef YYREDUCETABLE
+  if( yyReduceTable[yyruleno] ){
+    yyReduceTable[yyruleno](yypParser, yymsp, yyLookahead, yyLookaheadToken
+                            ParseCTX_PARAM);
+  }
+#else
   switch( yyruleno ){
   /* Beginning here are the reduction cases.  A typical example
   ** follows:
@@ -780,10 +951,12 @@ static YYACTIONTYPE yy_reduce(
 %%
 /********** End reduce actions ************************************************/
   };
+#endif /* YYREDUCETABLE */
   assert( yyruleno<sizeof(yyRuleInfoLhs)/sizeof(yyRuleInfoLhs[0]) );
   yygoto = yyRuleInfoLhs[yyruleno];
   yysize = yyRuleInfoNRhs[yyruleno];
-  yyact = yy_find_reduce_action(yymsp[yysize].stateno,(YYCODETYPE)yygoto);
+  yyact = yy_find_reduce_action(yypParser,yymsp[yysize].stateno,
+                                (YYCODETYPE)yygoto);
 
   /* There are no SHIFTREDUCE actions on nonterminals because the table
   ** generator has simplified them to pure REDUCE actions. */
@@ -804,14 +977,14 @@ static YYACTIONTYPE yy_reduce(
 ** The following code executes when the parse fails
 */
 #ifndef YYNOERRORRECOVERY
-static void yy_parse_failed(
+static YYCOLD void yy_parse_failed(
   yyParser *yypParser           /* The parser */
 ){
   ParseARG_FETCH
   ParseCTX_FETCH
 #ifndef NDEBUG
-  if( yyTraceFILE ){
-    fprintf(yyTraceFILE,"%sFail!\n",yyTracePrompt);
+  if( yypParser->yyTraceFILE ){
+    fprintf(yypParser->yyTraceFILE,"%sFail!\n",yypParser->yyTracePrompt);
   }
 #endif
   while( yypParser->yytos>yypParser->yystack ) yy_pop_parser_stack(yypParser);
@@ -828,7 +1001,7 @@ static void yy_parse_failed(
 /*
 ** The following code executes when a syntax error first occurs.
 */
-static void yy_syntax_error(
+static YYCOLD void yy_syntax_error(
   yyParser *yypParser,           /* The parser */
   int yymajor,                   /* The major type of the error token */
   ParseTOKENTYPE yyminor         /* The minor type of the error token */
@@ -846,14 +1019,14 @@ static void yy_syntax_error(
 /*
 ** The following is executed when the parser accepts
 */
-static void yy_accept(
+static YYCOLD void yy_accept(
   yyParser *yypParser           /* The parser */
 ){
   ParseARG_FETCH
   ParseCTX_FETCH
 #ifndef NDEBUG
-  if( yyTraceFILE ){
-    fprintf(yyTraceFILE,"%sAccept!\n",yyTracePrompt);
+  if( yypParser->yyTraceFILE ){
+    fprintf(yypParser->yyTraceFILE,"%sAccept!\n",yypParser->yyTracePrompt);
   }
 #endif
 #ifndef YYNOERRORRECOVERY
@@ -869,6 +1042,121 @@ static void yy_accept(
   ParseCTX_STORE
 }
 
+/*
+** Handle a syntax error on the lookahead token.  This is kept out of
+** line so that the shift/reduce loop in Parse() stays small.  Return
+** true if Parse() is done with the token, or false if it should look up
+** the token again in the state now at the top of the stack.
+*/
+static YYCOLD int yy_parse_error(
+  yyParser *yypParser,         /* The parser */
+  int yymajor,                 /* The major token code number */
+  ParseTOKENTYPE yyminor,      /* The value for the token */
+  int yyerrorhit               /* True if yymajor has invoked an error */
+){
+  YYMINORTYPE yyminorunion;
+#ifdef YYERRORSYMBOL
+  YYACTIONTYPE yyact = YY_ERROR_ACTION;
+  int yymx;
+#else
+  (void)yyerrorhit;
+#endif
+  yyminorunion.yy0 = yyminor;
+#ifndef NDEBUG
+  if( yypParser->yyTraceFILE ){
+    fprintf(yypParser->yyTraceFILE,"%sSyntax Error!\n",yypParser->yyTracePrompt);
+  }
+#endif
+#ifdef YYERRORSYMBOL
+  /* A syntax error has occurred.
+  ** The response to an error depends upon whether or not the
+  ** grammar defines an error token "ERROR".  
+  **
+  ** This is what we do if the grammar does define ERROR:
+  **
+  **  * Call the %syntax_error function.
+  **
+  **  * Begin popping the stack until we enter a state where
+  **    it is legal to shift the error symbol, then shift
+  **    the error symbol.
+  **
+  **  * Set the error count to three.
+  **
+  **  * Begin accepting and shifting new tokens.  No new error
+  **    processing will occur until three tokens have been
+  **    shifted successfully.
+  **
+  */
+  if( yypParser->yyerrcnt<0 ){
+    yy_syntax_error(yypParser,yymajor,yyminor);
+  }
+  yymx = yypParser->yytos->major;
+  if( yymx==YYERRORSYMBOL || yyerrorhit ){
+#ifndef NDEBUG
+    if( yypParser->yyTraceFILE ){
+      fprintf(yypParser->yyTraceFILE,"%sDiscard input token %s\n",
+         yypParser->yyTracePrompt,yyTokenName[yymajor]);
+    }
+#endif
+    yy_destructor(yypParser, (YYCODETYPE)yymajor, &yyminorunion);
+    yymajor = YYNOCODE;
+  }else{
+    while( yypParser->yytos > yypParser->yystack
+        && (yyact = yy_find_reduce_action(yypParser,
+                    yypParser->yytos->stateno,
+                    YYERRORSYMBOL)) > YY_MAX_SHIFTREDUCE
+    ){
+      yy_pop_parser_stack(yypParser);
+    }
+    if( yypParser->yytos == yypParser->yystack || yymajor==0 ){
+      yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
+      yy_parse_failed(yypParser);
+#ifndef YYNOERRORRECOVERY
+      yypParser->yyerrcnt = -1;
+#endif
+      yymajor = YYNOCODE;
+    }else if( yymx!=YYERRORSYMBOL ){
+      yy_shift(yypParser,yyact,YYERRORSYMBOL,yyminor);
+    }
+  }
+  yypParser->yyerrcnt = 3;
+  return yymajor==YYNOCODE;
+#elif defined(YYNOERRORRECOVERY)
+  /* If the YYNOERRORRECOVERY macro is defined, then do not attempt to
+  ** do any kind of error recovery.  Instead, simply invoke the syntax
+  ** error routine and continue going as if nothing had happened.
+  **
+  ** Applications can set this macro (for example inside %include) if
+  ** they intend to abandon the parse upon the first syntax error seen.
+  */
+  yy_syntax_error(yypParser,yymajor, yyminor);
+  yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
+  return 1;
+#else  /* YYERRORSYMBOL is not defined */
+  /* This is what we do if the grammar does not define ERROR:
+  **
+  **  * Report an error message, and throw away the input token.
+  **
+  **  * If the input token is $, then fail the parse.
+  **
+  ** As before, subsequent error messages are suppressed until
+  ** three input tokens have been successfully shifted.
+  */
+  if( yypParser->yyerrcnt<=0 ){
+    yy_syntax_error(yypParser,yymajor, yyminor);
+  }
+  yypParser->yyerrcnt = 3;
+  yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
+  if( yymajor==0 ){
+    yy_parse_failed(yypParser);
+#ifndef YYNOERRORRECOVERY
+    yypParser->yyerrcnt = -1;
+#endif
+  }
+  return 1;
+#endif
+}
+
 /* The main parser program.
 ** The first argument is a pointer to a structure obtained from
 ** "ParseAlloc" which describes the current state of the parser.
@@ -894,43 +1182,57 @@ void Parse(
   ParseTOKENTYPE yyminor       /* The value for the token */
   ParseARG_PDECL               /* Optional %extra_argument parameter */
 ){
-  YYMINORTYPE yyminorunion;
   YYACTIONTYPE yyact;   /* The parser action. */
-#if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
-  int yyendofinput;     /* True if we are at the end of input */
-#endif
-#ifdef YYERRORSYMBOL
   int yyerrorhit = 0;   /* True if yymajor has invoked an error */
-#endif
   yyParser *yypParser = (yyParser*)yyp;  /* The parser */
   ParseCTX_FETCH
   ParseARG_STORE
 
   assert( yypParser->yytos!=0 );
-#if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
-  yyendofinput = (yymajor==0);
+#ifdef YYTOKENCHECK
+  /* No token pushes more than YYSTACKHEADROOM entries, so this one
+  ** check covers every push the token makes */
+#if YYSTACKDEPTH>0
+  if( YYUNLIKELY(yypParser->yytos>yypParser->yystackEnd) ){
+    yyStackOverflow(yypParser);
+    return;
+  }
+#else
+  while( YYUNLIKELY(yypParser->yytos+YYSTACKHEADROOM>=&yypParser->yystack[yypParser->yystksz]) ){
+    if( yyGrowStack(yypParser) ){
+      yyStackOverflow(yypParser);
+      return;
+    }
+  }
+#endif
 #endif
 
   yyact = yypParser->yytos->stateno;
 #ifndef NDEBUG
-  if( yyTraceFILE ){
+  if( YYUNLIKELY(yypParser->yyTraceFILE) ){
     if( yyact < YY_MIN_REDUCE ){
-      fprintf(yyTraceFILE,"%sInput '%s' in state %d\n",
-              yyTracePrompt,yyTokenName[yymajor],yyact);
+      fprintf(yypParser->yyTraceFILE,"%sInput '%s' in state %d\n",
+              yypParser->yyTracePrompt,yyTokenName[yymajor],yyact);
     }else{
-      fprintf(yyTraceFILE,"%sInput '%s' with pending reduce %d\n",
-              yyTracePrompt,yyTokenName[yymajor],yyact-YY_MIN_REDUCE);
+      fprintf(yypParser->yyTraceFILE,"%sInput '%s' with pending reduce %d\n",
+              yypParser->yyTracePrompt,yyTokenName[yymajor],yyact-YY_MIN_REDUCE);
     }
   }
 #endif
 
   do{
     assert( yyact==yypParser->yytos->stateno );
-    yyact = yy_find_shift_action((YYCODETYPE)yymajor,yyact);
+    yyact = yy_find_shift_action(yypParser,(YYCODETYPE)yymajor,yyact);
     if( yyact >= YY_MIN_REDUCE ){
-      yyact = yy_reduce(yypParser,yyact-YY_MIN_REDUCE,yymajor,
-                        yyminor ParseCTX_PARAM);
-    }else if( yyact <= YY_MAX_SHIFTREDUCE ){
+      /* A goto that lands in a state whose only action is a reduce comes
+      ** back as another reduce.  That reduce does not depend on the
+      ** lookahead, so run the whole chain here instead of looking the
+      ** lookahead up again on each step. */
+      do{
+        yyact = yy_reduce(yypParser,yyact-YY_MIN_REDUCE,yymajor,
+                          yyminor ParseCTX_PARAM);
+      }while( yyact >= YY_MIN_REDUCE );
+    }else if( YYLIKELY(yyact <= YY_MAX_SHIFTREDUCE) ){
       yy_shift(yypParser,yyact,(YYCODETYPE)yymajor,yyminor);
 #ifndef YYNOERRORRECOVERY
       yypParser->yyerrcnt--;
@@ -942,117 +1244,21 @@ void Parse(
       return;
     }else{
       assert( yyact == YY_ERROR_ACTION );
-      yyminorunion.yy0 = yyminor;
-#ifdef YYERRORSYMBOL
-      int yymx;
-#endif
-#ifndef NDEBUG
-      if( yyTraceFILE ){
-        fprintf(yyTraceFILE,"%sSyntax Error!\n",yyTracePrompt);
-      }
-#endif
-#ifdef YYERRORSYMBOL
-      /* A syntax error has occurred.
-      ** The response to an error depends upon whether or not the
-      ** grammar defines an error token "ERROR".  
-      **
-      ** This is what we do if the grammar does define ERROR:
-      **
-      **  * Call the %syntax_error function.
-      **
-      **  * Begin popping the stack until we enter a state where
-      **    it is legal to shift the error symbol, then shift
-      **    the error symbol.
-      **
-      **  * Set the error count to three.
-      **
-      **  * Begin accepting and shifting new tokens.  No new error
-      **    processing will occur until three tokens have been
-      **    shifted successfully.
-      **
-      */
-      if( yypParser->yyerrcnt<0 ){
-        yy_syntax_error(yypParser,yymajor,yyminor);
-      }
-      yymx = yypParser->yytos->major;
-      if( yymx==YYERRORSYMBOL || yyerrorhit ){
-#ifndef NDEBUG
-        if( yyTraceFILE ){
-          fprintf(yyTraceFILE,"%sDiscard input token %s\n",
-             yyTracePrompt,yyTokenName[yymajor]);
-        }
-#endif
-        yy_destructor(yypParser, (YYCODETYPE)yymajor, &yyminorunion);
-        yymajor = YYNOCODE;
-      }else{
-        while( yypParser->yytos > yypParser->yystack
-            && (yyact = yy_find_reduce_action(
-                        yypParser->yytos->stateno,
-                        YYERRORSYMBOL)) > YY_MAX_SHIFTREDUCE
-        ){
-          yy_pop_parser_stack(yypParser);
-        }
-        if( yypParser->yytos == yypParser->yystack || yymajor==0 ){
-          yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
-          yy_parse_failed(yypParser);
-#ifndef YYNOERRORRECOVERY
-          yypParser->yyerrcnt = -1;
-#endif
-          yymajor = YYNOCODE;
-        }else if( yymx!=YYERRORSYMBOL ){
-          yy_shift(yypParser,yyact,YYERRORSYMBOL,yyminor);
-        }
-      }
-      yypParser->yyerrcnt = 3;
+      if( yy_parse_error(yypParser,yymajor,yyminor,yyerrorhit) ) break;
       yyerrorhit = 1;
-      if( yymajor==YYNOCODE ) break;
       yyact = yypParser->yytos->stateno;
-#elif defined(YYNOERRORRECOVERY)
-      /* If the YYNOERRORRECOVERY macro is defined, then do not attempt to
-      ** do any kind of error recovery.  Instead, simply invoke the syntax
-      ** error routine and continue going as if nothing had happened.
-      **
-      ** Applications can set this macro (for example inside %include) if
-      ** they intend to abandon the parse upon the first syntax error seen.
-      */
-      yy_syntax_error(yypParser,yymajor, yyminor);
-      yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
-      break;
-#else  /* YYERRORSYMBOL is not defined */
-      /* This is what we do if the grammar does not define ERROR:
-      **
-      **  * Report an error message, and throw away the input token.
-      **
-      **  * If the input token is $, then fail the parse.
-      **
-      ** As before, subsequent error messages are suppressed until
-      ** three input tokens have been successfully shifted.
-      */
-      if( yypParser->yyerrcnt<=0 ){
-        yy_syntax_error(yypParser,yymajor, yyminor);
-      }
-      yypParser->yyerrcnt = 3;
-      yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
-      if( yyendofinput ){
-        yy_parse_failed(yypParser);
-#ifndef YYNOERRORRECOVERY
-        yypParser->yyerrcnt = -1;
-#endif
-      }
-      break;
-#endif
     }
   }while( yypParser->yytos>yypParser->yystack );
 #ifndef NDEBUG
-  if( yyTraceFILE ){
+  if( YYUNLIKELY(yypParser->yyTraceFILE) ){
     yyStackEntry *i;
     char cDiv = '[';
-    fprintf(yyTraceFILE,"%sReturn. Stack=",yyTracePrompt);
+    fprintf(yypParser->yyTraceFILE,"%sReturn. Stack=",yypParser->yyTracePrompt);
     for(i=&yypParser->yystack[1]; i<=yypParser->yytos; i++){
-      fprintf(yyTraceFILE,"%c%s", cDiv, yyTokenName[i->major]);
+      fprintf(yypParser->yyTraceFILE,"%c%s", cDiv, yyTokenName[i->major]);
       cDiv = ' ';
     }
-    fprintf(yyTraceFILE,"]\n");
+    fprintf(yypParser->yyTraceFILE,"]\n");
   }
 #endif
   return;
@@ -1071,3 +1277,142 @@ int ParseFallback(int iToken){
 #endif
   return 0;
 }
+
+#ifdef YYRECOGNIZER
+/*
+** Return 1 if the nMajor token codes in aMajor[] make up a complete
+** input, or 0 at the first syntax error.  The end of input is implied.
+** This is the parse of a %recognizer grammar: it uses the same tables as
+** the full parser, but its stack holds state numbers only, no reduce code
+** runs and there is no error recovery.  The stack starts out on the C
+** stack.  With YYSTACKDEPTH>0 it is that deep and the input is rejected
+** if it overflows, as the full parser would; otherwise it grows on the
+** heap.  The parser yyp is used for tracing and for the counts of
+** -DYYPROFILE only.  Its own stack is not touched.
+*/
+int ParseAccepts(void *yyp, const int *aMajor, int nMajor){
+#if YYSTACKDEPTH>0
+  YYACTIONTYPE aLocal[YYSTACKDEPTH];
+#else
+  YYACTIONTYPE aLocal[100];
+  YYACTIONTYPE *pNew;
+  int j;
+#endif
+  YYACTIONTYPE *aStack = aLocal;      /* The stack of states */
+  int nStack = (int)(sizeof(aLocal)/sizeof(aLocal[0]));  /* Its size */
+  int iTop = 0;                       /* Top of the stack */
+  int i = 0;                          /* Next token in aMajor[] */
+  int rc = 0;
+  YYACTIONTYPE yyact;
+  YYCODETYPE yymajor;
+
+  aStack[0] = 0;
+  yymajor = 0;
+  if( nMajor>0 ){
+    if( aMajor[0]<=0 || aMajor[0]>=YYNTOKEN ) return 0;
+    yymajor = (YYCODETYPE)aMajor[0];
+  }
+  for(;;){
+    yyact = yy_find_shift_action((yyParser*)yyp,yymajor, aStack[iTop]);
+    if( yyact>=YY_MIN_REDUCE ){
+      unsigned int yyruleno = yyact - YY_MIN_REDUCE;
+      iTop += yyRuleInfoNRhs[yyruleno];
+      assert( iTop>=0 );
+      yyact = yy_find_reduce_action((yyParser*)yyp, aStack[iTop],
+                                    (YYCODETYPE)yyRuleInfoLhs[yyruleno]);
+    }else if( YYLIKELY(yyact<=YY_MAX_SHIFTREDUCE) ){
+      if( yyact>YY_MAX_SHIFT ) yyact += YY_MIN_REDUCE - YY_MIN_SHIFTREDUCE;
+      if( ++i<nMajor ){
+        if( aMajor[i]<=0 || aMajor[i]>=YYNTOKEN ) break;
+        yymajor = (YYCODETYPE)aMajor[i];
+      }else{
+        yymajor = 0;
+      }
+    }else{
+      rc = yyact==YY_ACCEPT_ACTION;
+      break;
+    }
+    if( YYUNLIKELY(++iTop>=nStack) ){
+#if YYSTACKDEPTH>0
+      break;
+#else
+      pNew = (YYACTIONTYPE*)(aStack==aLocal ? malloc(nStack*2*sizeof(aStack[0]))
+                     : realloc(aStack, nStack*2*sizeof(aStack[0])));
+      if( pNew==0 ) break;
+      if( aStack==aLocal ){
+        for(j=0; j<nStack; j++) pNew[j] = aLocal[j];
+      }
+      aStack = pNew;
+      nStack *= 2;
+#endif
+    }
+    aStack[iTop] = yyact;
+  }
+#if YYSTACKDEPTH<=0
+  if( aStack!=aLocal ) free(aStack);
+#endif
+  return rc;
+}
+
+#endif /* YYRECOGNIZER */
+
+#ifdef YYSCANNER
+#ifndef YYSCANMINOR
+# define YYSCANMINOR(V,MAJOR,Z,N)
+#endif
+/*
+** Break the n bytes of z[] into tokens using the scanner built from
+** %token_pattern and %token_skip and pass each token to Parse().  If
+** bLast is true, z[] is the rest of the input: every byte must belong
+** to a token, and the end of input is passed too.  Otherwise more input
+** follows.  The scan then stops before a token that might continue past
+** the end of z[].
+**
+** The value of each token starts out as zero.  The %include section can
+** define YYSCANMINOR(V,MAJOR,Z,N) to set the value V of a token with
+** code MAJOR from its N bytes of text at Z.
+**
+** Return the number of bytes used.  The bytes that are left over (fewer
+** than one token) must be passed again at the start of the next chunk.
+** If no pattern matches the byte at offset i, return -1-i; the parser
+** gets nothing more in that case.
+*/
+int ParseScanChunk(
+  void *yyp,                   /* The parser */
+  const char *z,               /* The next chunk of input */
+  int n,                       /* Number of bytes in z[] */
+  int bLast                    /* True if z[] ends the input */
+  ParseARG_PDECL               /* Optional %extra_argument parameter */
+){
+  static const ParseTOKENTYPE yyzerominor;
+  int i = 0, len, major;
+  while( i<n ){
+    major = ParseScanPartial(&z[i], n-i, bLast, &len);
+    if( major==YYSCANMORE ) return i;
+    if( major==0 ) return -1-i;
+    if( major>0 ){
+      ParseTOKENTYPE yyminor = yyzerominor;
+      YYSCANMINOR(yyminor, major, &z[i], len);
+      Parse(yyp, major, yyminor ParseARG_PARAM);
+    }
+    i += len;
+  }
+  if( bLast ) Parse(yyp, 0, yyzerominor ParseARG_PARAM);
+  return n;
+}
+
+/*
+** Scan and parse a whole input.  Return n, or the offset of the first
+** byte that no pattern matches.  The end of input is not passed to the
+** parser in that case.
+*/
+int ParseScanInput(
+  void *yyp,                   /* The parser */
+  const char *z,               /* The input */
+  int n                        /* Number of bytes in z[] */
+  ParseARG_PDECL               /* Optional %extra_argument parameter */
+){
+  int rc = ParseScanChunk(yyp, z, n, 1 ParseARG_PARAM);
+  return rc<0 ? -1-rc : rc;
+}
+#endif /* YYSCANNER */
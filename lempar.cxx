@@ -130,6 +130,18 @@ namespace {
     >::type type;
   };
 
+  // The value the %token_pattern scanner gives a token.  A token type
+  // that can be made from a pointer and a length (std::string_view, a
+  // span) refers to the text in the input buffer without copying it.
+  // Other token types are value-initialized.
+  template<class T>
+  typename std::enable_if<std::is_constructible<T, const char *, std::size_t>::value, T>::type
+  yy_scan_token(const char *z, int n) { return T(z, (std::size_t)n); }
+
+  template<class T>
+  typename std::enable_if<!std::is_constructible<T, const char *, std::size_t>::value, T>::type
+  yy_scan_token(const char *, int) { return T(); }
+
 }
 
 /************ Begin %include sections from the grammar ************************/
@@ -155,6 +167,9 @@ namespace {
 **                       values which should be used if the original symbol
 **                       would not parse.  This permits keywords to sometimes
 **                       be used as identifiers, for example.
+**    YYFALLBACKFOLDED   If defined, lemon -F has already copied the fallback
+**                       and wildcard actions into yy_action[], so neither
+**                       is looked up at run time.
 **    YYACTIONTYPE       is the data type used for "action codes" - numbers
 **                       that indicate what to do in response to the next
 **                       token.
@@ -173,6 +188,12 @@ namespace {
 **                       for terminal symbols is called "yy0".
 **    YYSTACKDEPTH       is the maximum depth of the parser's stack.  If
 **                       zero the stack is dynamically sized using realloc()
+**    YYSTACKDEPTH_BOUND is defined if no input can make the stack deeper
+**                       than this
+**    YYSTACKHEADROOM    is defined if no token pushes more than this many
+**                       entries onto the stack
+**    YYSTACKINLINE      is how many entries a dynamically sized stack holds
+**                       inside the parser before it moves to the heap
 **    ParseARG_SDECL     A static variable declaration for the %extra_argument
 **    ParseARG_PDECL     A parameter declaration for the %extra_argument
 **    ParseARG_PARAM     Code to pass %extra_argument as a subroutine parameter
@@ -184,6 +205,12 @@ namespace {
 **    YYNSTATE           the combined number of states.
 **    YYNRULE            the number of rules in the grammar
 **    YYNTOKEN           Number of terminal symbols
+**    YYTOKENCLASS       If defined, the number of terminal classes.  lemon -e
+**                       indexes the token rows by yy_token_class[] instead
+**                       of by terminal.
+**    YYRECOGNIZER       If defined, the grammar has %recognizer.  Its rules
+**                       have no code, and ParseAccepts() checks a whole
+**                       array of token codes with a stack of states only.
 **    YY_MAX_SHIFT       Maximum value for shift actions
 **    YY_MIN_SHIFTREDUCE Minimum value for shift-reduce actions
 **    YY_MAX_SHIFTREDUCE Maximum value for shift-reduce actions
@@ -201,6 +228,47 @@ namespace {
 /************* End control #defines *******************************************/
 #define YY_NLOOKAHEAD ((int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])))
 
+/* The column of a terminal in the token rows of the action table */
+#ifdef YYTOKENCLASS
+# define YYCLASS(X) yy_token_class[X]
+# define YYNCLASS   YYTOKENCLASS
+#else
+# define YYCLASS(X) (X)
+# define YYNCLASS   YYNTOKEN
+#endif
+
+/* lemon defines YYSTACKDEPTH_BOUND when no input can take the stack
+** deeper than that, and YYSTACKHEADROOM when no token pushes more than
+** that many entries.  With the bound, the stack is made that deep, unless
+** YYSTACKDEPTH is set lower, and a push is never checked.  Otherwise,
+** with the headroom (YYTOKENCHECK), the stack is checked once per token
+** and the headroom is kept past YYSTACKDEPTH.  Without either
+** (YYPUSHCHECK), every push is checked.  Define YYNOSTACKBOUND to check
+** every push anyway. */
+#ifdef YYNOSTACKBOUND
+# undef YYSTACKDEPTH_BOUND
+# undef YYSTACKHEADROOM
+#endif
+#if defined(YYSTACKDEPTH_BOUND) \
+ && (YYSTACKDEPTH<=0 || YYSTACKDEPTH>=YYSTACKDEPTH_BOUND)
+# undef YYSTACKDEPTH
+# define YYSTACKDEPTH YYSTACKDEPTH_BOUND
+# undef YYSTACKHEADROOM
+# define YYSTACKHEADROOM 0
+#elif defined(YYSTACKHEADROOM)
+# define YYTOKENCHECK 1
+#else
+# define YYSTACKHEADROOM 0
+# define YYPUSHCHECK 1
+#endif
+
+/* A stack that grows (YYSTACKDEPTH<=0) starts out in YYSTACKINLINE entries
+** inside the parser itself, so a parser costs no allocation until the input
+** nests deeper than that. */
+#ifndef YYSTACKINLINE
+# define YYSTACKINLINE 16
+#endif
+
 namespace {
 
 /* Define the yytestcase() macro to be a no-op if is not already defined
@@ -215,6 +283,21 @@ namespace {
 # define yytestcase(X)
 #endif
 
+/* Branch hints, and a marker for the routines that run rarely: error
+** recovery, stack overflow, accept and failure.  Keeping those out of
+** line leaves parse() with a compact shift/reduce loop.  Define
+** YYNOHOTCOLD to turn the hints off.
+*/
+#if defined(__GNUC__) && !defined(YYNOHOTCOLD)
+# define YYLIKELY(X)   __builtin_expect(!!(X),1)
+# define YYUNLIKELY(X) __builtin_expect(!!(X),0)
+# define YYCOLD        __attribute__((cold,noinline))
+#else
+# define YYLIKELY(X)   (X)
+# define YYUNLIKELY(X) (X)
+# define YYCOLD
+#endif
+
 
 /* Next are the tables used to determine what action to take based on the
 ** current state and lookahead token.  These tables are used to implement
@@ -341,11 +424,21 @@ class yypParser : public LEMON_SUPER {
     virtual void reset() final override;
     virtual bool will_accept() const final override;
     virtual int fallback(int iToken) const final override;
+#ifdef YYSCANNER
+    virtual int scan(const char *, int) final override;
+    virtual int scan_chunk(const char *, int, bool) final override;
+#endif
+#ifdef YYSYNC
+    virtual int scan_sync(const char *, int, int) const final override;
+#endif
+#ifdef YYRECOGNIZER
+    virtual bool accepts(const int *, int) const final override;
+#endif
     /*
     ** Return the peak depth of the stack for a parser.
     */
     #ifdef YYTRACKMAXSTACKDEPTH
-    int yypParser::stack_peak(){
+    int stack_peak() const {
       return yyhwm;
     }
     #endif
@@ -354,12 +447,16 @@ class yypParser : public LEMON_SUPER {
     int coverage(FILE *out);
     #endif
 
+    #ifdef YYPROFILE
+    void profile(FILE *out) const;
+    #endif
+
     const yyStackEntry *begin() const { return yystack; }
     const yyStackEntry *end() const { return yytos + 1; }
 
   protected:
   private:
-  yyStackEntry *yytos;          /* Pointer to top element of the stack */
+  yyStackEntry *yytos = nullptr; /* Pointer to top element of the stack */
 #ifdef YYTRACKMAXSTACKDEPTH
   int yyhwm = 0;                 /* Maximum value of yyidx */
 #endif
@@ -367,24 +464,26 @@ class yypParser : public LEMON_SUPER {
   int yyerrcnt = -1;                 /* Shifts left before out of the error */
 #endif
 #if YYSTACKDEPTH<=0
-  int yystksz = 0;                  /* Current side of the stack */
-  yyStackEntry *yystack = nullptr;        /* The parser's stack */
-  yyStackEntry yystk0;          /* First stack entry */
-  int yyGrowStack();
+  int yystksz = YYSTACKINLINE;      /* Current side of the stack */
+  yyStackEntry *yystack = yystk0;   /* The parser's stack */
+  yyStackEntry yystk0[YYSTACKINLINE];  /* The stack until it grows */
+  YYCOLD int yyGrowStack();
 #else
-  yyStackEntry yystack[YYSTACKDEPTH];  /* The parser's stack */
+  yyStackEntry yystack[YYSTACKDEPTH+YYSTACKHEADROOM];  /* The stack */
   yyStackEntry *yystackEnd;            /* Last entry in the stack */
 #endif
 
 
 
-  void yy_accept();
-  void yy_parse_failed();
-  void yy_syntax_error(int yymajor, ParseTOKENTYPE &yyminor);
+  YYCOLD void yy_accept();
+  YYCOLD void yy_parse_failed();
+  YYCOLD void yy_syntax_error(int yymajor, ParseTOKENTYPE &yyminor);
+  YYCOLD int yy_parse_error(int yymajor, ParseTOKENTYPE &yyminor, int yyerrorhit);
 
   void yy_transfer(yyStackEntry *yySource, yyStackEntry *yyDest);
 
   void yy_pop_parser_stack();
+  void yy_pop_all();
   YYACTIONTYPE yy_find_shift_action(YYCODETYPE iLookAhead, YYACTIONTYPE stateno) const;
   YYACTIONTYPE yy_find_reduce_action(YYACTIONTYPE stateno, YYCODETYPE iLookAhead) const;
 
@@ -393,7 +492,13 @@ class yypParser : public LEMON_SUPER {
   void yy_shift_error(YYACTIONTYPE yyNewState);
 #endif
   YYACTIONTYPE yy_reduce(unsigned int yyruleno, int yyLookahead, const ParseTOKENTYPE &yyLookaheadToken);
-  void yyStackOverflow();
+  template<int N>
+  void yy_reduce_action(yyStackEntry *yymsp, int yyLookahead, const ParseTOKENTYPE &yyLookaheadToken);
+  typedef void (yypParser::*yyReduceFunc)(yyStackEntry*, int, const ParseTOKENTYPE &);
+  static const yyReduceFunc yyReduceTable[];
+#if defined(YYPUSHCHECK) || defined(YYTOKENCHECK)
+  YYCOLD void yyStackOverflow();
+#endif
 
 #ifndef NDEBUG
   void yyTraceShift(int yyNewState, const char *zTag) const;
@@ -405,6 +510,12 @@ class yypParser : public LEMON_SUPER {
   mutable unsigned char yycoverage[YYNSTATE][YYNTOKEN] = {};
 #endif
 
+#ifdef YYPROFILE
+  mutable unsigned long yyProfileTkn[YYNSTATE] = {};
+  mutable unsigned long yyProfileNt[YYNSTATE] = {};
+  unsigned long yyProfileRule[YYNRULE] = {};
+#endif
+
 #ifndef NDEBUG
   FILE *yyTraceFILE = 0;
   const char *yyTracePrompt = 0;
@@ -469,20 +580,25 @@ const char *const yyRuleName[] = {
 */
 int yypParser::yyGrowStack(){
   int newSize;
+  int idx;
   yyStackEntry *pNew;
   yyStackEntry *pOld = yystack;
   int oldSize = yystksz;
 
   newSize = oldSize*2 + 100;
-  pNew = (yyStackEntry *)calloc(newSize, sizeof(pNew[0]));
+  idx = (int)(yytos - yystack);
+  pNew = (yyStackEntry *)malloc(newSize*sizeof(pNew[0]));
   if( pNew ){
     yystack = pNew;
-    for (int i = 0; i < oldSize; ++i) {
+    /* Only the entries up to yytos hold values, and yy_shift() calls
+    ** this with yytos already one past the end */
+    for (int i = 0; i <= idx && i < oldSize; ++i) {
       pNew[i].stateno = pOld[i].stateno;
       pNew[i].major = pOld[i].major;
       yy_move(pOld[i].major, &pNew[i].minor, &pOld[i].minor);
     }
-    if (pOld != &yystk0) free(pOld);
+    if (pOld != yystk0) free(pOld);
+    yytos = &yystack[idx];
 #ifndef NDEBUG
     if( yyTraceFILE ){
       fprintf(yyTraceFILE,"%sStack grows from %d to %d entries.\n",
@@ -507,6 +623,7 @@ void yy_destructor(
   YYCODETYPE yymajor,     /* Type code for object to destroy */
   YYMINORTYPE *yypminor   /* The object to be destroyed */
 ){
+  if( yyTrivialDestructors ) return;
   switch( yymajor ){
     /* Here is inserted the actions which take place when a
     ** terminal or non-terminal is destroyed.  This can happen
@@ -569,19 +686,30 @@ void yypParser::yy_pop_parser_stack(){
   yy_destructor(yymsp->major, &yymsp->minor);
 }
 
+/*
+** Pop everything off the parser's stack.  Unless it is being traced, the
+** stack is dropped at once, after running yy_destructor() on just the
+** entries whose value has a destructor that does something.
+*/
+void yypParser::yy_pop_all(){
+#ifndef NDEBUG
+  if( yyTraceFILE ){
+    while( yytos>yystack ) yy_pop_parser_stack();
+    return;
+  }
+#endif
+  if( !yyTrivialDestructors ){
+    for(yyStackEntry *yymsp = yytos; yymsp>yystack; yymsp--){
+      if( yyNontrivialMinor[yymsp->major] ) yy_destructor(yymsp->major, &yymsp->minor);
+    }
+  }
+  yytos = yystack;
+}
+
 
 template<class ...Args>
 yypParser::yypParser(Args&&... args) : LEMON_SUPER(std::forward<Args>(args)...)
 {
-#if YYSTACKDEPTH<=0
-  if( yyGrowStack() ){
-    yystack = &yystk0;
-    yystksz = 1;
-  }
-#else
-  std::memset(yystack, 0, sizeof(yystack));
-#endif
-
   yytos = yystack;
   yystack[0].stateno = 0;
   yystack[0].major = 0;
@@ -592,7 +720,7 @@ yypParser::yypParser(Args&&... args) : LEMON_SUPER(std::forward<Args>(args)...)
 
 void yypParser::reset() {
 
-  while( yytos>yystack ) yy_pop_parser_stack();
+  yy_pop_all();
 
 #ifndef YYNOERRORRECOVERY
   yyerrcnt = -1;
@@ -616,9 +744,9 @@ void yypParser::reset() {
 */
 
 yypParser::~yypParser() {
-  while( yytos>yystack ) yy_pop_parser_stack();
+  yy_pop_all();
 #if YYSTACKDEPTH<=0
-  if( yystack!=&yystk0 ) free(yystack);
+  if( yystack!=yystk0 ) free(yystack);
 #endif
 }
 
@@ -638,7 +766,7 @@ int yypParser::coverage(FILE *out){
   for(stateno=0; stateno<YYNSTATE; stateno++){
     i = yy_shift_ofst[stateno];
     for(iLookAhead=0; iLookAhead<YYNTOKEN; iLookAhead++){
-      if( yy_lookahead[i+iLookAhead]!=iLookAhead ) continue;
+      if( yy_lookahead[i+YYCLASS(iLookAhead)]!=YYCLASS(iLookAhead) ) continue;
       if( yycoverage[stateno][iLookAhead]==0 ) nMissed++;
       if( out ){
         fprintf(out,"State %d lookahead %s %s\n", stateno,
@@ -651,6 +779,26 @@ int yypParser::coverage(FILE *out){
 }
 #endif
 
+/*
+** Write the counts of a parser built with -DYYPROFILE in the form that
+** lemon --profile=FILE reads back.  The counts are the lookups of each
+** state's token row and goto row and the reductions by each rule.
+*/
+#if defined(YYPROFILE)
+void yypParser::profile(FILE *out) const {
+  int i;
+  fprintf(out, "lemon-profile %d %d\n", YYNSTATEID, YYNRULE);
+  for(i=0; i<YYNSTATE; i++){
+    if( yyProfileTkn[i]==0 && yyProfileNt[i]==0 ) continue;
+    fprintf(out, "state %d %lu %lu\n", yyStateId[i],
+            yyProfileTkn[i], yyProfileNt[i]);
+  }
+  for(i=0; i<YYNRULE; i++){
+    if( yyProfileRule[i] ) fprintf(out, "rule %d %lu\n", i, yyProfileRule[i]);
+  }
+}
+#endif
+
 /*
 ** Find the appropriate action for a parser given the terminal
 ** look-ahead token iLookAhead.
@@ -660,23 +808,27 @@ YYACTIONTYPE yypParser::yy_find_shift_action(
   YYACTIONTYPE stateno      /* Current state number */
 ) const {
   int i;
+  YYCODETYPE iClass;        /* Column of iLookAhead in the token rows */
 
   if( stateno>YY_MAX_SHIFT ) return stateno;
-  assert( stateno <= YY_SHIFT_MAX );
 #if defined(YYCOVERAGE)
   yycoverage[stateno][iLookAhead] = 1;
+#endif
+#if defined(YYPROFILE)
+  yyProfileTkn[stateno]++;
 #endif
   do{
     i = stateno <= YY_SHIFT_COUNT ? yy_shift_ofst[stateno] : stateno;
     assert( i>=0 );
     assert( i<=YY_ACTTAB_COUNT );
-    assert( i+YYNTOKEN<=(int)YY_NLOOKAHEAD );
+    assert( i+YYNCLASS<=(int)YY_NLOOKAHEAD );
     assert( iLookAhead!=YYNOCODE );
     assert( iLookAhead < YYNTOKEN );
-    i += iLookAhead;
+    iClass = YYCLASS(iLookAhead);
+    i += iClass;
     assert( i<(int)YY_NLOOKAHEAD );
-    if( yy_lookahead[i]!=iLookAhead ){
-#ifdef YYFALLBACK
+    if( yy_lookahead[i]!=iClass ){
+#if defined(YYFALLBACK) && !defined(YYFALLBACKFOLDED)
       YYCODETYPE iFallback;            /* Fallback token */
       assert( iLookAhead<sizeof(yyFallback)/sizeof(yyFallback[0]) );
       iFallback = yyFallback[iLookAhead];
@@ -692,11 +844,11 @@ YYACTIONTYPE yypParser::yy_find_shift_action(
         continue;
       }
 #endif
-#ifdef YYWILDCARD
+#if defined(YYWILDCARD) && !defined(YYFALLBACKFOLDED)
       {
-        int j = i - iLookAhead + YYWILDCARD;
+        int j = i - iClass + YYCLASS(YYWILDCARD);
         assert( j<(int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])) );
-        if( yy_lookahead[j]==YYWILDCARD && iLookAhead>0 ){
+        if( yy_lookahead[j]==YYCLASS(YYWILDCARD) && iLookAhead>0 ){
 #ifndef NDEBUG
           if( yyTraceFILE ){
             fprintf(yyTraceFILE, "%sWILDCARD %s => %s\n",
@@ -725,6 +877,9 @@ YYACTIONTYPE yypParser::yy_find_reduce_action(
   YYCODETYPE iLookAhead     /* The look-ahead token */
 ) const {
   int i;
+#if defined(YYPROFILE)
+  yyProfileNt[stateno]++;
+#endif
 #ifdef YYERRORSYMBOL
   if( stateno>YY_REDUCE_COUNT ){
     return yy_default[stateno];
@@ -749,13 +904,14 @@ YYACTIONTYPE yypParser::yy_find_reduce_action(
 /*
 ** The following routine is called if the stack overflows.
 */
+#if defined(YYPUSHCHECK) || defined(YYTOKENCHECK)
 void yypParser::yyStackOverflow(){
 #ifndef NDEBUG
    if( yyTraceFILE ){
      fprintf(yyTraceFILE,"%sStack Overflow!\n",yyTracePrompt);
    }
 #endif
-   while( yytos>yystack ) yy_pop_parser_stack();
+   yy_pop_all();
    /* Here code is inserted which will execute if the parser
    ** stack every overflows */
 /******** Begin %stack_overflow code ******************************************/
@@ -763,13 +919,14 @@ void yypParser::yyStackOverflow(){
 /******** End %stack_overflow code ********************************************/
   LEMON_SUPER::stack_overflow();
 }
+#endif
 
 /*
 ** Print tracing information for a SHIFT action
 */
 #ifndef NDEBUG
 void yypParser::yyTraceShift(int yyNewState, const char *zTag) const {
-  if( yyTraceFILE ){
+  if( YYUNLIKELY(yyTraceFILE) ){
     if( yyNewState<YYNSTATE ){
       fprintf(yyTraceFILE,"%s%s '%s', go to state %d\n",
          yyTracePrompt, zTag, yyTokenName[yytos->major],
@@ -798,14 +955,18 @@ void yypParser::yy_shift(
     assert(yyhwm == yyidx());
   }
 #endif
-#if YYSTACKDEPTH>0 
-  if( yytos>yystackEnd ){
+#if !defined(YYPUSHCHECK) && YYSTACKDEPTH>0
+  assert( yytos<=yystackEnd+YYSTACKHEADROOM );
+#elif !defined(YYPUSHCHECK)
+  assert( yytos<&yystack[yystksz] );
+#elif YYSTACKDEPTH>0
+  if( YYUNLIKELY(yytos>yystackEnd) ){
     yytos--;
     yyStackOverflow();
     return;
   }
 #else
-  if( yytos>=&yystack[yystksz] ){
+  if( YYUNLIKELY(yytos>=&yystack[yystksz]) ){
     if( yyGrowStack() ){
       yytos--;
       yyStackOverflow();
@@ -836,14 +997,18 @@ void yypParser::yy_shift_error(
     assert(yyhwm == yyidx());
   }
 #endif
-#if YYSTACKDEPTH>0 
-  if( yytos>yystackEnd ){
+#if !defined(YYPUSHCHECK) && YYSTACKDEPTH>0
+  assert( yytos<=yystackEnd+YYSTACKHEADROOM );
+#elif !defined(YYPUSHCHECK)
+  assert( yytos<&yystack[yystksz] );
+#elif YYSTACKDEPTH>0
+  if( YYUNLIKELY(yytos>yystackEnd) ){
     yytos--;
     yyStackOverflow();
     return;
   }
 #else
-  if( yytos>=&yystack[yystksz] ){
+  if( YYUNLIKELY(yytos>=&yystack[yystksz]) ){
     if( yyGrowStack() ){
       yytos--;
       yyStackOverflow();
@@ -873,6 +1038,23 @@ static const signed char yyRuleInfoNRhs[] = {
 %%
 };
 
+/*
+** With the -R option, lemon writes each reduce action as a function of
+** its own and yy_reduce() calls it through yyReduceTable[], in place of
+** the switch below.  The functions and the table come at the end of the
+** file, back in the namespace of yypParser.  YYREDUCEACTION(N) begins the
+** function for rule N, YYREDUCEREF(N) is its name, YYREDUCETABLEDEF begins
+** the table, and YYREDUCEBEGIN and YYREDUCEEND go around all of them.
+*/
+#ifdef YYREDUCETABLE
+#define YYREDUCEACTION(N) template<> void yypParser::yy_reduce_action<N>( \
+  yyStackEntry *yymsp, int yyLookahead, const ParseTOKENTYPE &yyLookaheadToken)
+#define YYREDUCEREF(N) &yypParser::yy_reduce_action<N>
+#define YYREDUCETABLEDEF const yypParser::yyReduceFunc yypParser::yyReduceTable[]
+#define YYREDUCEBEGIN namespace {
+#define YYREDUCEEND }
+#endif
+
 /*
 ** Perform a reduce action and the shift that must immediately
 ** follow the reduce.
@@ -887,8 +1069,12 @@ YYACTIONTYPE yypParser::yy_reduce(
   yyStackEntry *yymsp;            /* The top of the parser's stack */
   int yysize;                     /* Amount to pop the stack */
   yymsp = yytos;
+#if defined(YYPROFILE)
+  yyProfileRule[yyruleno]++;
+#endif
 #ifndef NDEBUG
-  if( yyTraceFILE && yyruleno<(int)(sizeof(yyRuleName)/sizeof(yyRuleName[0])) ){
+  if( YYUNLIKELY(yyTraceFILE)
+   && yyruleno<(int)(sizeof(yyRuleName)/sizeof(yyRuleName[0])) ){
     yysize = yyRuleInfoNRhs[yyruleno];
     if( yysize ){
       fprintf(yyTraceFILE, "%sReduce %d [%s], go to state %d.\n",
@@ -906,13 +1092,18 @@ YYACTIONTYPE yypParser::yy_reduce(
   ** enough on the stack to push the LHS value */
   if( yyRuleInfoNRhs[yyruleno]==0 ){
 #ifdef YYTRACKMAXSTACKDEPTH
-    if( yyidx()>yyhwm ){
+    /* Count the entry that the LHS is about to occupy */
+    if( yyidx()>=yyhwm ){
       yyhwm++;
-      assert(yyhwm == yyidx());
+      assert(yyhwm == yyidx()+1);
     }
 #endif
-#if YYSTACKDEPTH>0 
-    if( yytos>=yystackEnd ){
+#if !defined(YYPUSHCHECK) && YYSTACKDEPTH>0
+    assert( yytos<yystackEnd+YYSTACKHEADROOM );
+#elif !defined(YYPUSHCHECK)
+    assert( yytos<&yystack[yystksz-1] );
+#elif YYSTACKDEPTH>0
+    if( YYUNLIKELY(yytos>=yystackEnd) ){
       yyStackOverflow();
       /* The call to yyStackOverflow() above pops the stack until it is
       ** empty, causing the main parser loop to exit.  So the return value
@@ -920,7 +1111,7 @@ YYACTIONTYPE yypParser::yy_reduce(
       return 0;
     }
 #else
-    if( yytos>=&yystack[yystksz-1] ){
+    if( YYUNLIKELY(yytos>=&yystack[yystksz-1]) ){
       if( yyGrowStack() ){
         yyStackOverflow();
         /* The call to yyStackOverflow() above pops the stack until it is
@@ -933,6 +1124,11 @@ YYACTIONTYPE yypParser::yy_reduce(
 #endif
   }
 
+#ifdef YYREDUCETABLE
+  if( yyReduceTable[yyruleno] ){
+    (this->*yyReduceTable[yyruleno])(yymsp, yyLookahead, yyLookaheadToken);
+  }
+#else
   switch( yyruleno ){
   /* Beginning here are the reduction cases.  A typical example
   ** follows:
@@ -946,6 +1142,7 @@ YYACTIONTYPE yypParser::yy_reduce(
 %%
 /********** End reduce actions ************************************************/
   };
+#endif /* YYREDUCETABLE */
   assert( yyruleno<sizeof(yyRuleInfoLhs)/sizeof(yyRuleInfoLhs[0]) );
   yygoto = yyRuleInfoLhs[yyruleno];
   yysize = yyRuleInfoNRhs[yyruleno];
@@ -976,7 +1173,7 @@ void yypParser::yy_parse_failed(){
     fprintf(yyTraceFILE,"%sFail!\n",yyTracePrompt);
   }
 #endif
-  while( yytos>yystack ) yy_pop_parser_stack();
+  yy_pop_all();
   /* Here code is inserted which will be executed whenever the
   ** parser fails */
 /************ Begin %parse_failure code ***************************************/
@@ -1022,6 +1219,119 @@ void yypParser::yy_accept(){
   LEMON_SUPER::parse_accept();
 }
 
+/*
+** Handle a syntax error on the lookahead token.  This is kept out of
+** line so that the shift/reduce loop in parse() stays small.  Return
+** true if parse() is done with the token, or false if it should look up
+** the token again in the state now at the top of the stack.
+*/
+int yypParser::yy_parse_error(
+  int yymajor,                 /* The major token code number */
+  ParseTOKENTYPE &yyminor,     /* The value for the token */
+  int yyerrorhit               /* True if yymajor has invoked an error */
+){
+#ifdef YYERRORSYMBOL
+  YYACTIONTYPE yyact = YY_ERROR_ACTION;
+  int yymx;
+#else
+  (void)yyerrorhit;
+#endif
+#ifndef NDEBUG
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sSyntax Error!\n",yyTracePrompt);
+  }
+#endif
+#ifdef YYERRORSYMBOL
+  /* A syntax error has occurred.
+  ** The response to an error depends upon whether or not the
+  ** grammar defines an error token "ERROR".  
+  **
+  ** This is what we do if the grammar does define ERROR:
+  **
+  **  * Call the %syntax_error function.
+  **
+  **  * Begin popping the stack until we enter a state where
+  **    it is legal to shift the error symbol, then shift
+  **    the error symbol.
+  **
+  **  * Set the error count to three.
+  **
+  **  * Begin accepting and shifting new tokens.  No new error
+  **    processing will occur until three tokens have been
+  **    shifted successfully.
+  **
+  */
+  if( yyerrcnt<0 ){
+    yy_syntax_error(yymajor,yyminor);
+  }
+  yymx = yytos->major;
+  if( yymx==YYERRORSYMBOL || yyerrorhit ){
+#ifndef NDEBUG
+    if( yyTraceFILE ){
+      fprintf(yyTraceFILE,"%sDiscard input token %s\n",
+         yyTracePrompt,yyTokenName[yymajor]);
+    }
+#endif
+    //yy_destructor(yyminor);
+    yymajor = YYNOCODE;
+  }else{
+    while( yytos > yystack
+        && (yyact = yy_find_reduce_action(
+                    yytos->stateno,
+                    YYERRORSYMBOL)) > YY_MAX_SHIFTREDUCE
+    ){
+      yy_pop_parser_stack();
+    }
+    if( yytos == yystack || yymajor==0 ){
+      //yy_destructor(yyminor);
+      yy_parse_failed();
+#ifndef YYNOERRORRECOVERY
+      yyerrcnt = -1;
+#endif
+      yymajor = YYNOCODE;
+    }else if( yymx!=YYERRORSYMBOL ){
+      yy_shift_error(yyact);
+    }
+  }
+  yyerrcnt = 3;
+  return yymajor==YYNOCODE;
+#elif defined(YYNOERRORRECOVERY)
+  /* If the YYNOERRORRECOVERY macro is defined, then do not attempt to
+  ** do any kind of error recovery.  Instead, simply invoke the syntax
+  ** error routine and continue going as if nothing had happened.
+  **
+  ** Applications can set this macro (for example inside %include) if
+  ** they intend to abandon the parse upon the first syntax error seen.
+  */
+  yy_syntax_error(yymajor,yyminor);
+  //yy_destructor(yyminor);
+  return 1;
+
+#else  /* YYERRORSYMBOL is not defined */
+  /* This is what we do if the grammar does not define ERROR:
+  **
+  **  * Report an error message, and throw away the input token.
+  **
+  **  * If the input token is $, then fail the parse.
+  **
+  ** As before, subsequent error messages are suppressed until
+  ** three input tokens have been successfully shifted.
+  */
+  if( yyerrcnt<=0 ){
+    yy_syntax_error(yymajor,yyminor);
+  }
+  yyerrcnt = 3;
+  //yy_destructor(yyminor);
+  if( yymajor==0 ){
+    yy_parse_failed();
+#ifndef YYNOERRORRECOVERY
+    yyerrcnt = -1;
+#endif
+  }
+  return 1;
+#endif
+}
+
 /* The main parser program.
 ** The first argument is a pointer to a structure obtained from
 ** "ParseAlloc" which describes the current state of the parser.
@@ -1050,21 +1360,30 @@ void yypParser::parse(
 ){
   //YYMINORTYPE yyminorunion;
   YYACTIONTYPE yyact;            /* The parser action. */
-#if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
-  int yyendofinput;     /* True if we are at the end of input */
-#endif
-#ifdef YYERRORSYMBOL
   int yyerrorhit = 0;   /* True if yymajor has invoked an error */
-#endif
 
   assert( yytos!=0 );
-#if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
-  yyendofinput = (yymajor==0);
+#ifdef YYTOKENCHECK
+  /* No token pushes more than YYSTACKHEADROOM entries, so this one
+  ** check covers every push the token makes */
+#if YYSTACKDEPTH>0
+  if( YYUNLIKELY(yytos>yystackEnd) ){
+    yyStackOverflow();
+    return;
+  }
+#else
+  while( YYUNLIKELY(yytos+YYSTACKHEADROOM>=&yystack[yystksz]) ){
+    if( yyGrowStack() ){
+      yyStackOverflow();
+      return;
+    }
+  }
+#endif
 #endif
 
   yyact = yytos->stateno;
 #ifndef NDEBUG
-  if( yyTraceFILE ){
+  if( YYUNLIKELY(yyTraceFILE) ){
     if( yyact < YY_MIN_REDUCE ){
       fprintf(yyTraceFILE,"%sInput '%s' in state %d\n",
               yyTracePrompt,yyTokenName[yymajor],yyact);
@@ -1079,8 +1398,14 @@ void yypParser::parse(
     assert( yyact==yytos->stateno );
     yyact = yy_find_shift_action((YYCODETYPE)yymajor,yyact);
     if( yyact >= YY_MIN_REDUCE ){
-      yyact = yy_reduce(yyact-YY_MIN_REDUCE,yymajor, yyminor);
-    }else if( yyact <= YY_MAX_SHIFTREDUCE ){
+      /* A goto that lands in a state whose only action is a reduce comes
+      ** back as another reduce.  That reduce does not depend on the
+      ** lookahead, so run the whole chain here instead of looking the
+      ** lookahead up again on each step. */
+      do{
+        yyact = yy_reduce(yyact-YY_MIN_REDUCE,yymajor, yyminor);
+      }while( yyact >= YY_MIN_REDUCE );
+    }else if( YYLIKELY(yyact <= YY_MAX_SHIFTREDUCE) ){
       yy_shift(yyact,(YYCODETYPE)yymajor,std::move(yyminor));
 #ifndef YYNOERRORRECOVERY
       yyerrcnt--;
@@ -1092,110 +1417,13 @@ void yypParser::parse(
       return;
     }else{
       assert( yyact == YY_ERROR_ACTION );
-      //yyminorunion.yy0 = yyminor;
-#ifdef YYERRORSYMBOL
-      int yymx;
-#endif
-#ifndef NDEBUG
-      if( yyTraceFILE ){
-        fprintf(yyTraceFILE,"%sSyntax Error!\n",yyTracePrompt);
-      }
-#endif
-#ifdef YYERRORSYMBOL
-      /* A syntax error has occurred.
-      ** The response to an error depends upon whether or not the
-      ** grammar defines an error token "ERROR".  
-      **
-      ** This is what we do if the grammar does define ERROR:
-      **
-      **  * Call the %syntax_error function.
-      **
-      **  * Begin popping the stack until we enter a state where
-      **    it is legal to shift the error symbol, then shift
-      **    the error symbol.
-      **
-      **  * Set the error count to three.
-      **
-      **  * Begin accepting and shifting new tokens.  No new error
-      **    processing will occur until three tokens have been
-      **    shifted successfully.
-      **
-      */
-      if( yyerrcnt<0 ){
-        yy_syntax_error(yymajor,yyminor);
-      }
-      yymx = yytos->major;
-      if( yymx==YYERRORSYMBOL || yyerrorhit ){
-#ifndef NDEBUG
-        if( yyTraceFILE ){
-          fprintf(yyTraceFILE,"%sDiscard input token %s\n",
-             yyTracePrompt,yyTokenName[yymajor]);
-        }
-#endif
-        //yy_destructor(yyminor);
-        yymajor = YYNOCODE;
-      }else{
-        while( yytos > yystack
-            && (yyact = yy_find_reduce_action(
-                        yytos->stateno,
-                        YYERRORSYMBOL)) > YY_MAX_SHIFTREDUCE
-        ){
-          yy_pop_parser_stack();
-        }
-        if( yytos == yystack || yymajor==0 ){
-          //yy_destructor(yyminor);
-          yy_parse_failed();
-#ifndef YYNOERRORRECOVERY
-          yyerrcnt = -1;
-#endif
-          yymajor = YYNOCODE;
-        }else if( yymx!=YYERRORSYMBOL ){
-          yy_shift_error(yyact);
-        }
-      }
-      yyerrcnt = 3;
+      if( yy_parse_error(yymajor,yyminor,yyerrorhit) ) break;
       yyerrorhit = 1;
-      if( yymajor==YYNOCODE ) break;
       yyact = yytos->stateno;
-#elif defined(YYNOERRORRECOVERY)
-      /* If the YYNOERRORRECOVERY macro is defined, then do not attempt to
-      ** do any kind of error recovery.  Instead, simply invoke the syntax
-      ** error routine and continue going as if nothing had happened.
-      **
-      ** Applications can set this macro (for example inside %include) if
-      ** they intend to abandon the parse upon the first syntax error seen.
-      */
-      yy_syntax_error(yymajor,yyminor);
-      //yy_destructor(yyminor);
-      break;
-      
-#else  /* YYERRORSYMBOL is not defined */
-      /* This is what we do if the grammar does not define ERROR:
-      **
-      **  * Report an error message, and throw away the input token.
-      **
-      **  * If the input token is $, then fail the parse.
-      **
-      ** As before, subsequent error messages are suppressed until
-      ** three input tokens have been successfully shifted.
-      */
-      if( yyerrcnt<=0 ){
-        yy_syntax_error(yymajor,yyminor);
-      }
-      yyerrcnt = 3;
-      //yy_destructor(yyminor);
-      if( yyendofinput ){
-        yy_parse_failed();
-#ifndef YYNOERRORRECOVERY
-        yyerrcnt = -1;
-#endif
-      }
-      break;
-#endif
     }
   }while( yytos>yystack );
 #ifndef NDEBUG
-  if( yyTraceFILE ){
+  if( YYUNLIKELY(yyTraceFILE) ){
     yyStackEntry *i;
     char cDiv = '[';
     fprintf(yyTraceFILE,"%sReturn. Stack=",yyTracePrompt);
@@ -1273,6 +1501,143 @@ int yypParser::fallback(int iToken) const {
   return 0;
 }
 
+#ifdef YYRECOGNIZER
+/*
+** Return true if the nMajor token codes in aMajor[] make up a complete
+** input, or false at the first syntax error.  The end of input is implied.
+** This is the parse of a %recognizer grammar: it uses the same tables as
+** the full parser, but its stack holds state numbers only, no reduce code
+** runs and there is no error recovery.  The stack starts out on the C
+** stack.  With YYSTACKDEPTH>0 it is that deep and the input is rejected
+** if it overflows, as the full parser would; otherwise it grows on the
+** heap.  The parser's own stack is
+** not touched.
+*/
+bool yypParser::accepts(const int *aMajor, int nMajor) const {
+#if YYSTACKDEPTH>0
+  YYACTIONTYPE aLocal[YYSTACKDEPTH];
+#else
+  YYACTIONTYPE aLocal[100];
+  YYACTIONTYPE *pNew;
+  int j;
+#endif
+  YYACTIONTYPE *aStack = aLocal;      /* The stack of states */
+  int nStack = (int)(sizeof(aLocal)/sizeof(aLocal[0]));  /* Its size */
+  int iTop = 0;                       /* Top of the stack */
+  int i = 0;                          /* Next token in aMajor[] */
+  int rc = 0;
+  YYACTIONTYPE yyact;
+  YYCODETYPE yymajor;
+
+  aStack[0] = 0;
+  yymajor = 0;
+  if( nMajor>0 ){
+    if( aMajor[0]<=0 || aMajor[0]>=YYNTOKEN ) return false;
+    yymajor = (YYCODETYPE)aMajor[0];
+  }
+  for(;;){
+    yyact = yy_find_shift_action(yymajor, aStack[iTop]);
+    if( yyact>=YY_MIN_REDUCE ){
+      unsigned int yyruleno = yyact - YY_MIN_REDUCE;
+      iTop += yyRuleInfoNRhs[yyruleno];
+      assert( iTop>=0 );
+      yyact = yy_find_reduce_action(aStack[iTop],
+                                    (YYCODETYPE)yyRuleInfoLhs[yyruleno]);
+    }else if( YYLIKELY(yyact<=YY_MAX_SHIFTREDUCE) ){
+      if( yyact>YY_MAX_SHIFT ) yyact += YY_MIN_REDUCE - YY_MIN_SHIFTREDUCE;
+      if( ++i<nMajor ){
+        if( aMajor[i]<=0 || aMajor[i]>=YYNTOKEN ) break;
+        yymajor = (YYCODETYPE)aMajor[i];
+      }else{
+        yymajor = 0;
+      }
+    }else{
+      rc = yyact==YY_ACCEPT_ACTION;
+      break;
+    }
+    if( YYUNLIKELY(++iTop>=nStack) ){
+#if YYSTACKDEPTH>0
+      break;
+#else
+      pNew = (YYACTIONTYPE*)(aStack==aLocal ? malloc(nStack*2*sizeof(aStack[0]))
+                     : realloc(aStack, nStack*2*sizeof(aStack[0])));
+      if( pNew==0 ) break;
+      if( aStack==aLocal ){
+        for(j=0; j<nStack; j++) pNew[j] = aLocal[j];
+      }
+      aStack = pNew;
+      nStack *= 2;
+#endif
+    }
+    aStack[iTop] = yyact;
+  }
+#if YYSTACKDEPTH<=0
+  if( aStack!=aLocal ) free(aStack);
+#endif
+  return rc!=0;
+}
+
+#endif /* YYRECOGNIZER */
+
+#ifdef YYSCANNER
+#ifndef YYSCANMINOR
+# define YYSCANMINOR(V,MAJOR,Z,N)
+#endif
+/*
+** Break the n bytes of z[] into tokens using the scanner built from
+** %token_pattern and %token_skip and pass each token to parse().  If
+** last is true, z[] is the rest of the input: every byte must belong
+** to a token, and the end of input is passed too.  Otherwise more input
+** follows.  The scan then stops before a token that might continue past
+** the end of z[].
+**
+** Each token's value comes from yy_scan_token(): its text if the token
+** type can hold it, otherwise value-initialized.  The %include section
+** can define YYSCANMINOR(V,MAJOR,Z,N) to set the value V of a token with
+** code MAJOR from its N bytes of text at Z.
+**
+** Return the number of bytes used.  The bytes that are left over (fewer
+** than one token) must be passed again at the start of the next chunk.
+** If no pattern matches the byte at offset i, return -1-i; the parser
+** gets nothing more in that case.
+*/
+int yypParser::scan_chunk(const char *z, int n, bool last) {
+  int i = 0, len, major;
+  while( i<n ){
+    major = ParseScanPartial(&z[i], n-i, last, &len);
+    if( major==YYSCANMORE ) return i;
+    if( major==0 ) return -1-i;
+    if( major>0 ){
+      ParseTOKENTYPE yyminor = yy_scan_token<ParseTOKENTYPE>(&z[i], len);
+      YYSCANMINOR(yyminor, major, &z[i], len);
+      parse(major, std::move(yyminor));
+    }
+    i += len;
+  }
+  if( last ) parse(0, ParseTOKENTYPE{});
+  return n;
+}
+
+/*
+** Scan and parse a whole input.  Return n, or the offset of the first
+** byte that no pattern matches.  The end of input is not passed to the
+** parser in that case.
+*/
+int yypParser::scan(const char *z, int n) {
+  int rc = scan_chunk(z, n, true);
+  return rc<0 ? -1-rc : rc;
+}
+#ifdef YYSYNC
+/*
+** Return the offset just past the first %sync token in z[] that ends at
+** or after offset min, or n if there is none.
+*/
+int yypParser::scan_sync(const char *z, int n, int min) const {
+  return ParseScanSync(z, n, min);
+}
+#endif /* YYSYNC */
+#endif /* YYSCANNER */
+
 
 
 } // namespace
@@ -0,0 +1,112 @@
+/*
+** Interface for running the LEMON parser generator as a library.
+**
+** Build lemon.c with -DLEMON_LIBRARY to leave out main() (the Makefile's
+** liblemon.a target does this).  Add -DLEMONPLUSPLUS=1 for a lemon--
+** flavored generator.
+**
+** The author of this program disclaims copyright.
+*/
+#ifndef LIBLEMON_H
+#define LIBLEMON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+** Settings for one run of the generator.  Zero-initialize the structure
+** and fill in what you need.  These mirror the command-line options.
+*/
+struct lemon_options {
+  const char *zFilename;     /* Name of the grammar.  Used for messages, for
+                             ** #line directives and to name output files */
+  const char *zGrammar;      /* Text of the grammar, or NULL to read zFilename */
+  int nGrammar;              /* Bytes in zGrammar, or -1 if zero-terminated */
+  const char *zTemplate;     /* Text of the driver template, or NULL */
+  const char *zTemplateName; /* Template file to use when zTemplate is NULL */
+  const char *zOutputDir;    /* Directory for output files, or NULL */
+  const char *zArgv0;        /* Program name.  Used to find the template */
+  int nDefine;               /* Number of entries in azDefine[] */
+  const char **azDefine;     /* Macros that are defined for %ifdef */
+  int basisflag;             /* Print only the basis in the report */
+  int noCompress;            /* Don't compress the action table */
+  int noResort;              /* Do not sort or renumber states */
+  int mhflag;                /* Output a makeheaders compatible file */
+  int nolinenosflag;         /* Do not print #line statements */
+  int quiet;                 /* Don't generate the report */
+  int rpflag;                /* Reprint the grammar as the report instead */
+  int showPrecedenceConflict;/* Report conflicts resolved by precedence */
+  int nconflict;             /* Number of parsing conflicts expected */
+  int writeFiles;            /* Also write the .c, .h and .out files */
+  int captureErrors;         /* Return messages in zErrors, not on stderr */
+  int reduceTable;           /* One function per reduce action, not a switch */
+  int foldFallback;          /* Resolve %fallback and %wildcard in the tables */
+  int tokenClasses;          /* Index the token rows by terminal class */
+  int mergeStates;           /* Merge states that have the same actions */
+  int unitRules;             /* Skip code-less unit rules on terminals too */
+  const char *zProfile;      /* Profile written by ParseProfile(), or NULL */
+};
+
+/*
+** The cost of one phase of the generator ("Parse", "FindStates",
+** "ReportTable" and so on).  Working memory is what the generator
+** allocates for itself; the output buffers are not counted.
+*/
+#define LEMON_MAX_PHASE 16
+struct lemon_phase {
+  const char *zName;         /* Name of the phase, such as "FindStates" */
+  double wallTime;           /* Elapsed seconds */
+  double cpuTime;            /* CPU seconds used by the calling thread */
+  long nPeakBytes;           /* Most working memory in use during the phase */
+};
+
+/*
+** The result of one run.  The text buffers are zero-terminated and
+** belong to the caller; release them with lemon_output_free().
+*/
+struct lemon_output {
+  char *zSource;             /* The generated parser */
+  int nSource;               /* Bytes in zSource */
+  char *zHeader;             /* The generated header */
+  int nHeader;               /* Bytes in zHeader */
+  char *zReport;             /* The report, or the reprinted grammar */
+  int nReport;               /* Bytes in zReport */
+  char *zErrors;             /* Error messages, if captureErrors was set */
+  int nErrors;               /* Bytes in zErrors */
+  int nterminal;             /* Number of terminal symbols */
+  int nsymbol;               /* Number of terminal and nonterminal symbols */
+  int nrule;                 /* Number of rules */
+  int nstate;                /* Number of states */
+  int nconflict;             /* Number of parsing conflicts */
+  int nactiontab;            /* Entries in the yy_action[] table */
+  int nlookaheadtab;         /* Entries in the yy_lookahead[] table */
+  int tablesize;             /* Total size of all tables in bytes */
+  int nfolded;               /* Actions added by foldFallback, or -1 */
+  int nclass;                /* Terminal classes with tokenClasses, or -1 */
+  int nmerged;               /* States removed by mergeStates, or -1 */
+  int nunit;                 /* Terminal actions rewritten by unitRules, or -1 */
+  int nstackbound;           /* Deepest the parser stack can get, or 0 */
+  int nheadroom;             /* Most stack entries one token pushes, or 0 */
+  int nPhase;                /* Number of entries in aPhase[] */
+  struct lemon_phase aPhase[LEMON_MAX_PHASE]; /* Cost of each phase */
+  double wallTime;           /* Seconds spent in lemon_generate() */
+  double cpuTime;            /* CPU seconds used by lemon_generate() */
+  long nPeakBytes;           /* Most working memory in use at once */
+};
+
+/*
+** Generate a parser.  Returns 0 on success or the exit code the lemon
+** program would have used.  Errors never terminate the calling process.
+** Separate threads may call this concurrently.
+*/
+int lemon_generate(const struct lemon_options *, struct lemon_output *);
+
+/* Release the buffers in a struct lemon_output */
+void lemon_output_free(struct lemon_output *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBLEMON_H */